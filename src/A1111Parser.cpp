@@ -0,0 +1,129 @@
+﻿#include "A1111Parser.h"
+#include <charconv>
+#include <cmath>
+
+static constexpr std::string_view NEGATIVE_PROMPT = "Negative prompt:";
+
+// 設定行とみなす項目の数（A1111と同じ）
+static constexpr size_t MIN_FIELDS = 3;
+
+static bool IsSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// 項目名の文字（英数字・_・マルチバイト文字）
+static bool IsWordChar(char c) {
+	auto u = static_cast<unsigned char>(c);
+	return u >= 0x80 || (u >= '0' && u <= '9') || (u >= 'A' && u <= 'Z') || (u >= 'a' && u <= 'z') || u == '_';
+}
+
+static std::string_view TrimRight(std::string_view text) {
+	while (!text.empty() && IsSpace(text.back())) text.remove_suffix(1);
+	return text;
+}
+
+static std::string_view Trim(std::string_view text) {
+	while (!text.empty() && IsSpace(text.front())) text.remove_prefix(1);
+	return TrimRight(text);
+}
+
+// 設定行を項目に分ける（A1111の正規表現と同じく、読めない箇所は次のカンマまで飛ばす）
+static void ParseSettings(std::string_view line, std::vector<A1111Field>& fields) {
+	size_t n = line.size();
+	size_t i = 0;
+	while (i < n) {
+		while (i < n && IsSpace(line[i])) ++i;
+		if (i >= n) break;
+
+		// 名前（先頭は英数字、2文字目以降は空白・-・/も使える）
+		size_t nameStart = i;
+		if (IsWordChar(line[i])) {
+			++i;
+			while (i < n && (IsWordChar(line[i]) || line[i] == ' ' || line[i] == '-' || line[i] == '/')) ++i;
+		}
+		bool ok = i - nameStart >= 2 && i < n && line[i] == ':';
+		A1111Field field;
+		if (ok) {
+			field.name = TrimRight(line.substr(nameStart, i - nameStart));
+			++i;
+			while (i < n && IsSpace(line[i])) ++i;
+
+			// 引用符で囲まれた値はカンマを含められる（Lora hashes など）
+			size_t end = i;
+			if (i < n && line[i] == '"') {
+				end = i + 1;
+				while (end < n && line[end] != '"') end += line[end] == '\\' ? 2 : 1;
+				if (end < n) {
+					size_t after = end + 1;
+					while (after < n && IsSpace(line[after])) ++after;
+					if (after >= n || line[after] == ',') {
+						field.value = line.substr(i + 1, end - i - 1);
+						field.quoted = true;
+						i = after;
+					}
+				}
+			}
+			// 閉じていない引用符はカンマまでをそのまま値にする
+			if (!field.quoted) {
+				end = line.find(',', i);
+				if (end == std::string_view::npos) end = n;
+				field.value = TrimRight(line.substr(i, end - i));
+				i = end;
+			}
+			fields.push_back(field);
+		} else {
+			i = line.find(',', i);
+			if (i == std::string_view::npos) break;
+		}
+		if (i < n) ++i;	// カンマ
+	}
+}
+
+bool A1111Parser::Parse(std::string_view text, A1111Parameters& parameters) {
+	parameters.prompt = {};
+	parameters.negativePrompt = {};
+	parameters.fields.clear();
+
+	text = TrimRight(text);
+	size_t lastNewline = text.rfind('\n');
+	std::string_view settings = lastNewline == std::string_view::npos ? text : text.substr(lastNewline + 1);
+	ParseSettings(settings, parameters.fields);
+	if (parameters.fields.size() < MIN_FIELDS) {
+		parameters.fields.clear();
+		return false;
+	}
+	if (lastNewline == std::string_view::npos) return true;
+
+	// "Negative prompt:" で始まる最初の行から後ろがネガティブプロンプト（複数行のこともある）
+	std::string_view body = text.substr(0, lastNewline);
+	size_t negative = std::string_view::npos;
+	for (size_t pos = 0; pos < body.size(); ++pos) {
+		if (body.substr(pos).starts_with(NEGATIVE_PROMPT)) {
+			negative = pos;
+			break;
+		}
+		pos = body.find('\n', pos);
+		if (pos == std::string_view::npos) break;
+	}
+	if (negative == std::string_view::npos) {
+		parameters.prompt = Trim(body);
+	} else {
+		parameters.prompt = Trim(body.substr(0, negative));
+		parameters.negativePrompt = Trim(body.substr(negative + NEGATIVE_PROMPT.size()));
+	}
+	return true;
+}
+
+std::optional<int64_t> A1111Field::Integer() const {
+	int64_t result = 0;
+	auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+	if (error != std::errc() || end != value.data() + value.size() || value.empty()) return std::nullopt;
+	return result;
+}
+
+std::optional<double> A1111Field::Number() const {
+	double result = 0;
+	auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+	if (error != std::errc() || end != value.data() + value.size() || value.empty() || !std::isfinite(result)) return std::nullopt;
+	return result;
+}
@@ -0,0 +1,35 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// A1111（Stable Diffusion web UI）の設定行の項目
+struct A1111Field {
+	std::string_view name;
+	std::string_view value;	// 引用符で囲まれていた場合は内側（エスケープはそのまま）
+	bool quoted = false;
+
+	// 値全体が数値の場合だけ読む
+	std::optional<int64_t> Integer() const;
+	std::optional<double> Number() const;
+};
+
+// parameters を分けたもの（全て元のテキストを指す）
+struct A1111Parameters {
+	std::string_view prompt;
+	std::string_view negativePrompt;
+	std::vector<A1111Field> fields;	// 設定行の項目（出てきた順）
+};
+
+// A1111の parameters（PNGのtEXt、JPEG・WebPではEXIFのユーザーコメント）を分ける
+//   <プロンプト>
+//   Negative prompt: <ネガティブプロンプト>
+//   Steps: 28, Sampler: Euler a, CFG scale: 7, Seed: 1, Size: 512x768, Lora hashes: "a: 1, b: 2"
+// 値はコピーせずに元のテキストを指し、項目ごとの確保はしない（fields は使い回せる）
+class A1111Parser {
+public:
+	// 最後の行が設定行でなければ false（プロンプトだけのテキストや他のツールの値）
+	static bool Parse(std::string_view text, A1111Parameters& parameters);
+};
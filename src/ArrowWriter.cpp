@@ -0,0 +1,357 @@
+﻿#include "framework.h"
+#include "ArrowWriter.h"
+#include "TextUtils.h"
+#include "Trace.h"
+#include <algorithm>
+
+// 1バッチの行数と値のバイト数の上限（どちらかを超えたら書き出す）
+static constexpr size_t ROWS_PER_BATCH = 64 * 1024;
+static constexpr size_t VALUE_BYTES_PER_BATCH = 64 * 1024 * 1024;
+
+// Arrowの見出し（Message.fbs・Schema.fbs）の値
+static constexpr uint64_t METADATA_V5 = 4;
+static constexpr uint8_t HEADER_SCHEMA = 1;
+static constexpr uint8_t HEADER_DICTIONARY_BATCH = 2;
+static constexpr uint8_t HEADER_RECORD_BATCH = 3;
+static constexpr uint8_t TYPE_INT = 2;
+static constexpr uint8_t TYPE_UTF8 = 5;
+
+static constexpr int64_t SECTION_DICTIONARY = 1;
+static constexpr int64_t TYPE_DICTIONARY = 3;
+
+static void put_le(std::string& out, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; ++i) out += static_cast<char>(value >> (i * 8));
+}
+
+static void patch_le(std::string& out, size_t pos, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; ++i) out[pos + i] = static_cast<char>(value >> (i * 8));
+}
+
+static void pad(std::string& out, size_t align) {
+	out.resize((out.size() + align - 1) / align * align, '\0');
+}
+
+namespace {
+
+// FlatBuffersのテーブル（Arrowの見出しに要る分だけ）
+// 子を親より後ろに書くので、オフセットは全て前から後ろを指す
+class FlatTable {
+public:
+	FlatTable& Scalar(int slot, uint64_t value, uint8_t size) {
+		m_fields.push_back({slot, Kind::Scalar, size, value});
+		return *this;
+	}
+	FlatTable& Table(int slot, FlatTable table) {
+		auto& field = m_fields.emplace_back(Field{slot, Kind::Tables, 4});
+		field.tables.push_back(std::move(table));
+		return *this;
+	}
+	FlatTable& String(int slot, std::string_view text) {
+		m_fields.emplace_back(Field{slot, Kind::String, 4}).text = text;
+		return *this;
+	}
+	FlatTable& Tables(int slot, std::vector<FlatTable> tables) {
+		m_fields.emplace_back(Field{slot, Kind::TableVector, 4}).tables = std::move(tables);
+		return *this;
+	}
+	// int64の組の構造体（FieldNode・Buffer）の配列
+	FlatTable& Pairs(int slot, std::vector<int64_t> values) {
+		m_fields.emplace_back(Field{slot, Kind::Pairs, 4}).values = std::move(values);
+		return *this;
+	}
+
+	// 先頭にルートのオフセットを置いた、8バイト境界までのバッファ
+	std::string Finish() const {
+		std::string out(4, '\0');
+		patch_le(out, 0, Write(out), 4);
+		pad(out, 8);
+		return out;
+	}
+
+private:
+	enum class Kind { Scalar, Tables, String, TableVector, Pairs };
+	struct Field {
+		int slot;
+		Kind kind;
+		uint8_t size;	// テーブル内の大きさ（スカラー以外は子へのオフセットの4バイト）
+		uint64_t scalar = 0;
+		std::vector<FlatTable> tables = {};
+		std::string text = {};
+		std::vector<int64_t> values = {};
+	};
+
+	size_t Write(std::string& out) const {
+		// 大きいものから詰めて、それぞれの大きさの境界に揃える
+		std::vector<size_t> order(m_fields.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return m_fields[a].size > m_fields[b].size; });
+
+		std::vector<size_t> positions(m_fields.size());
+		size_t inlineSize = 4;	// vtableへのオフセット
+		int slots = 0;
+		for (size_t i : order) {
+			size_t size = m_fields[i].size;
+			inlineSize = (inlineSize + size - 1) / size * size;
+			positions[i] = inlineSize;
+			inlineSize += size;
+			slots = std::max(slots, m_fields[i].slot + 1);
+		}
+
+		pad(out, 2);
+		size_t vtable = out.size();
+		put_le(out, 4 + 2 * slots, 2);
+		put_le(out, inlineSize, 2);
+		std::vector<uint16_t> slotPositions(slots);
+		for (size_t i = 0; i < m_fields.size(); ++i) slotPositions[m_fields[i].slot] = static_cast<uint16_t>(positions[i]);
+		for (auto position : slotPositions) put_le(out, position, 2);
+
+		pad(out, 8);
+		size_t table = out.size();
+		out.resize(table + inlineSize, '\0');
+		patch_le(out, table, table - vtable, 4);
+		for (size_t i = 0; i < m_fields.size(); ++i) {
+			const auto& field = m_fields[i];
+			size_t at = table + positions[i];
+			if (field.kind == Kind::Scalar) patch_le(out, at, field.scalar, field.size);
+			else patch_le(out, at, WriteChild(out, field) - at, 4);
+		}
+		return table;
+	}
+
+	static size_t WriteChild(std::string& out, const Field& field) {
+		size_t start;
+		switch (field.kind) {
+		case Kind::Tables:
+			return field.tables[0].Write(out);
+		case Kind::String:
+			pad(out, 4);
+			start = out.size();
+			put_le(out, field.text.size(), 4);
+			out += field.text;
+			out += '\0';
+			return start;
+		case Kind::TableVector:
+			pad(out, 4);
+			start = out.size();
+			put_le(out, field.tables.size(), 4);
+			out.resize(out.size() + 4 * field.tables.size(), '\0');
+			for (size_t i = 0; i < field.tables.size(); ++i) {
+				size_t at = start + 4 + 4 * i;
+				patch_le(out, at, field.tables[i].Write(out) - at, 4);
+			}
+			return start;
+		default:
+			// 要素を8バイト境界に置く
+			while ((out.size() + 4) % 8) out += '\0';
+			start = out.size();
+			put_le(out, field.values.size() / 2, 4);
+			for (auto value : field.values) put_le(out, static_cast<uint64_t>(value), 8);
+			return start;
+		}
+	}
+
+	std::vector<Field> m_fields;
+};
+
+// レコードバッチ（辞書バッチの中身も同じ形）の列の並びと本体
+class BatchBody {
+public:
+	void Node(int64_t length, int64_t nulls) {
+		m_nodes.push_back(length);
+		m_nodes.push_back(nulls);
+	}
+	void Buffer(const void* data, size_t size) {
+		m_buffers.push_back(m_length);
+		m_buffers.push_back(static_cast<int64_t>(size));
+		m_parts.emplace_back(static_cast<const char*>(data), size);
+		m_length += (size + 7) / 8 * 8;
+	}
+	template <class T>
+	void Buffer(const std::vector<T>& values) { Buffer(values.data(), values.size() * sizeof(T)); }
+	void Buffer(std::string_view data) { Buffer(data.data(), data.size()); }
+
+	FlatTable Header(int64_t rows) const {
+		FlatTable batch;
+		batch.Scalar(0, rows, 8).Pairs(1, m_nodes).Pairs(2, m_buffers);
+		return batch;
+	}
+	int64_t Length() const { return m_length; }
+	const std::vector<std::string_view>& Parts() const { return m_parts; }
+
+private:
+	std::vector<int64_t> m_nodes;
+	std::vector<int64_t> m_buffers;
+	std::vector<std::string_view> m_parts;
+	int64_t m_length = 0;
+};
+
+} // namespace
+
+// 続き記号・見出しの長さ・見出し・本体（各バッファは8バイト境界まで埋める）
+static void write_message(BufferedOutput& output, uint8_t headerType, FlatTable header, const BatchBody& body) {
+	FlatTable message;
+	message.Scalar(0, METADATA_V5, 2).Scalar(1, headerType, 1).Table(2, std::move(header)).Scalar(3, body.Length(), 8);
+	auto metadata = message.Finish();
+
+	auto& out = output.Buffer();
+	put_le(out, 0xFFFFFFFF, 4);
+	put_le(out, metadata.size(), 4);
+	out += metadata;
+	for (auto part : body.Parts()) {
+		out += part;
+		pad(out, 8);	// 出力の先頭から8バイト境界（書き出した分も8の倍数）
+	}
+	output.Commit();
+}
+
+static void write_dictionary(BufferedOutput& output, int64_t id, const std::vector<std::string>& values, bool delta) {
+	std::vector<int32_t> offsets{0};
+	std::string data;
+	for (const auto& value : values) {
+		data += value;
+		offsets.push_back(static_cast<int32_t>(data.size()));
+	}
+	BatchBody body;
+	body.Node(values.size(), 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(offsets);
+	body.Buffer(data);
+
+	FlatTable dictionary;
+	dictionary.Scalar(0, id, 8).Table(1, body.Header(values.size())).Scalar(2, delta, 1);
+	write_message(output, HEADER_DICTIONARY_BATCH, std::move(dictionary), body);
+}
+
+static FlatTable int_type(int bits, bool isSigned) {
+	FlatTable type;
+	type.Scalar(0, bits, 4).Scalar(1, isSigned, 1);
+	return type;
+}
+
+static FlatTable make_field(std::string_view name, bool nullable, uint8_t typeType, FlatTable type,
+	int64_t dictionary = -1, int indexBits = 0) {
+	FlatTable field;
+	field.String(0, name).Scalar(1, nullable, 1).Scalar(2, typeType, 1).Table(3, std::move(type));
+	if (dictionary >= 0) {
+		FlatTable encoding;
+		encoding.Scalar(0, dictionary, 8).Table(1, int_type(indexBits, true)).Scalar(2, 0, 1);
+		field.Table(4, std::move(encoding));
+	}
+	field.Tables(5, {});	// 子は無くても空の配列が要る
+	return field;
+}
+
+void ArrowResultWriter::WriteSchema() {
+	std::vector<FlatTable> fields;
+	fields.push_back(make_field("path", false, TYPE_UTF8, FlatTable(), m_paths.id, 32));
+	fields.push_back(make_field("section", false, TYPE_UTF8, FlatTable(), SECTION_DICTIONARY, 8));
+	fields.push_back(make_field("key", false, TYPE_UTF8, FlatTable(), m_keys.id, 32));
+	fields.push_back(make_field("value", false, TYPE_UTF8, FlatTable()));
+	fields.push_back(make_field("type", false, TYPE_UTF8, FlatTable(), TYPE_DICTIONARY, 8));
+	fields.push_back(make_field("offset", true, TYPE_INT, int_type(64, false)));
+
+	FlatTable schema;
+	schema.Scalar(0, 0, 2).Tables(1, std::move(fields));	// リトルエンディアン
+	write_message(m_output, HEADER_SCHEMA, std::move(schema), BatchBody());
+
+	// 節と値の種類は決まった辞書（ExtractorKind・MetaType の順）
+	std::vector<std::string> sections;
+	for (size_t kind = 0; kind < EXTRACTOR_KINDS; ++kind) sections.push_back(section_name(static_cast<ExtractorKind>(kind)));
+	write_dictionary(m_output, SECTION_DICTIONARY, sections, false);
+	write_dictionary(m_output, TYPE_DICTIONARY, { "text", "json", "error", "number" }, false);
+	m_schemaWritten = true;
+}
+
+void ArrowResultWriter::WriteDictionary(Dictionary& dictionary) {
+	if (dictionary.written && dictionary.pending.empty()) return;
+	write_dictionary(m_output, dictionary.id, dictionary.pending, dictionary.written);
+	dictionary.written = true;
+	dictionary.pending.clear();
+}
+
+void ArrowResultWriter::WriteBatch() {
+	TRACE_SCOPE("ArrowResultWriter::WriteBatch");
+	if (!m_schemaWritten) WriteSchema();
+	WriteDictionary(m_paths);
+	WriteDictionary(m_keys);
+	if (!Rows()) return;
+
+	int64_t rows = static_cast<int64_t>(Rows());
+	BatchBody body;
+	body.Node(rows, 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(m_pathColumn);
+	body.Node(rows, 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(m_sectionColumn);
+	body.Node(rows, 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(m_keyColumn);
+	body.Node(rows, 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(m_valueOffsets);
+	body.Buffer(m_values);
+	body.Node(rows, 0);
+	body.Buffer(nullptr, 0);
+	body.Buffer(m_typeColumn);
+	body.Node(rows, m_offsetNulls);
+	if (m_offsetNulls) body.Buffer(m_offsetValidity);
+	else body.Buffer(nullptr, 0);
+	body.Buffer(m_offsetColumn);
+	write_message(m_output, HEADER_RECORD_BATCH, body.Header(rows), body);
+
+	m_pathColumn.clear();
+	m_sectionColumn.clear();
+	m_keyColumn.clear();
+	m_valueOffsets.assign(1, 0);
+	m_values.clear();
+	m_typeColumn.clear();
+	m_offsetColumn.clear();
+	m_offsetValidity.clear();
+	m_offsetNulls = 0;
+}
+
+int32_t ArrowResultWriter::KeyIndex(std::string_view key) {
+	auto it = m_keyIndex.find(key);
+	if (it != m_keyIndex.end()) return it->second;
+	const auto& stored = m_keyStorage.emplace_back(key);
+	return m_keyIndex.emplace(stored, m_keys.Add(stored)).first->second;
+}
+
+void ArrowResultWriter::Write(const InspectionResult& result) {
+	TRACE_SCOPE("ArrowResultWriter::Write");
+	int32_t path = -1;
+	for (size_t kind = 0; kind < EXTRACTOR_KINDS; ++kind) {
+		for (const auto& entry : result.Section(static_cast<ExtractorKind>(kind))) {
+			if (Rows() >= ROWS_PER_BATCH || (Rows() && m_values.size() + entry.value.size() > VALUE_BYTES_PER_BATCH)) WriteBatch();
+			if (path < 0) path = m_paths.Add(path_to_utf8(result.path));
+
+			size_t row = Rows();
+			m_pathColumn.push_back(path);
+			m_sectionColumn.push_back(static_cast<int8_t>(kind));
+			m_keyColumn.push_back(KeyIndex(entry.key));
+			m_values += entry.value;
+			m_valueOffsets.push_back(static_cast<int32_t>(m_values.size()));
+			m_typeColumn.push_back(static_cast<int8_t>(entry.type));
+			bool known = entry.offset != MetaEntry::NO_OFFSET;
+			m_offsetColumn.push_back(known ? entry.offset : 0);
+			if (row % 8 == 0) m_offsetValidity.push_back(0);
+			if (known) m_offsetValidity.back() |= static_cast<uint8_t>(1 << (row % 8));
+			else ++m_offsetNulls;
+		}
+	}
+}
+
+void ArrowResultWriter::Flush() {
+	WriteBatch();
+	m_output.Flush();
+}
+
+void ArrowResultWriter::Finish() {
+	WriteBatch();
+	// ストリームの終わり
+	auto& out = m_output.Buffer();
+	put_le(out, 0xFFFFFFFF, 4);
+	put_le(out, 0, 4);
+	m_output.Flush();
+}
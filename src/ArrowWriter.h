@@ -0,0 +1,63 @@
+﻿#pragma once
+#include "ResultWriter.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Arrow IPCストリーム形式（pyarrow の ipc.open_stream や DuckDB・Polars で読める）
+// 抽出結果の1項目を1行にした縦長の表
+//   path     utf8（辞書）  ファイルのパス
+//   section  utf8（辞書）  meta・c2pa・nai
+//   key      utf8（辞書）
+//   value    utf8
+//   type     utf8（辞書）  text・json・error・number
+//   offset   uint64        元データのファイル内の位置（不明ならnull）
+// 辞書は増えた分だけ差分の辞書バッチで追記し、行は一定の数ごとにレコードバッチで書き出すので、
+// 使うメモリはファイル数によらず1バッチ分とキーの辞書だけで済む
+class ArrowResultWriter : public ResultWriter {
+public:
+	explicit ArrowResultWriter(FILE* file) : m_output(file) {}
+	void Write(const InspectionResult& result) override;
+	void Flush() override;
+	void Finish() override;
+
+private:
+	struct Dictionary {
+		int64_t id;
+		std::vector<std::string> pending = {};	// まだ書き出していない値
+		int32_t size = 0;
+		bool written = false;
+
+		int32_t Add(std::string value) {
+			pending.push_back(std::move(value));
+			return size++;
+		}
+	};
+
+	size_t Rows() const { return m_keyColumn.size(); }
+	int32_t KeyIndex(std::string_view key);
+	void WriteSchema();
+	void WriteDictionary(Dictionary& dictionary);
+	void WriteBatch();
+
+	BufferedOutput m_output;
+	bool m_schemaWritten = false;
+	Dictionary m_paths{0};
+	Dictionary m_keys{2};
+	std::deque<std::string> m_keyStorage;	// m_keyIndex のキーの実体
+	std::unordered_map<std::string_view, int32_t> m_keyIndex;
+
+	// 書き出していない行
+	std::vector<int32_t> m_pathColumn;
+	std::vector<int8_t> m_sectionColumn;
+	std::vector<int32_t> m_keyColumn;
+	std::vector<int32_t> m_valueOffsets{0};
+	std::string m_values;
+	std::vector<int8_t> m_typeColumn;
+	std::vector<uint64_t> m_offsetColumn;
+	std::vector<uint8_t> m_offsetValidity;	// 1ビット1行（1: 値あり）
+	int64_t m_offsetNulls = 0;
+};
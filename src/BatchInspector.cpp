@@ -0,0 +1,127 @@
+﻿#include "framework.h"
+#include "BatchInspector.h"
+#include "ThreadPool.h"
+#include "TextUtils.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+BatchInspector::BatchInspector(BatchOptions options) : m_options(std::move(options)) {
+}
+
+// ディレクトリ内は名前順に深さ優先で辿る（シンボリックリンクのディレクトリは辿らない）
+void BatchInspector::Walk(const std::filesystem::path& path, const std::function<void(const std::filesystem::path&)>& visit) {
+	std::error_code ec;
+	if (path == "-" || std::filesystem::is_regular_file(path, ec)) {
+		visit(path);
+		return;
+	}
+	if (!std::filesystem::is_directory(path, ec)) return;
+
+	std::vector<std::filesystem::directory_entry> entries;
+	for (std::filesystem::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+		entries.push_back(*it);
+	}
+	std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.path() < b.path(); });
+
+	for (const auto& entry : entries) {
+		auto status = entry.symlink_status(ec);
+		if (ec) continue;
+		if (std::filesystem::is_directory(status)) {
+			Walk(entry.path(), visit);
+		} else if (std::filesystem::is_regular_file(entry.status(ec))) {
+			visit(entry.path());
+		}
+	}
+}
+
+// 1ファイル分の処理（"-" は標準入力から読む）
+static InspectionResult InspectPath(const std::filesystem::path& path, const InspectOptions& options) {
+	if (path != "-") return Inspector::Inspect(path, options);
+
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	auto result = Inspector::Inspect(ImageBuffer::FromStream(std::cin), options);
+	result.path = path;
+	return result;
+}
+
+size_t BatchInspector::Run(const std::function<void(const InspectionResult&)>& callback) {
+	struct Slot {
+		InspectionResult result;
+		bool done = false;
+	};
+
+	std::mutex mutex;
+	std::condition_variable completed;
+	ThreadPool pool(m_options.threads);
+	size_t maxInFlight = m_options.maxInFlight ? m_options.maxInFlight : pool.ThreadCount() * 4;
+
+	// 投入順に並んだ処理中の結果（このスレッドだけが触る）
+	std::deque<std::shared_ptr<Slot>> window;
+	size_t emitted = 0;
+
+	// 先頭から完了済みの結果を順番に出力する
+	auto emit = [&](bool wait) {
+		while (!window.empty()) {
+			std::unique_lock lock(mutex);
+			auto& head = window.front();
+			if (!head->done) {
+				if (!wait) return;
+				completed.wait(lock, [&] { return head->done; });
+			}
+			auto slot = std::move(head);
+			window.pop_front();
+			lock.unlock();
+
+			callback(slot->result);
+			++emitted;
+		}
+	};
+
+	for (const auto& input : m_options.inputs) {
+		Walk(input, [&](const std::filesystem::path& path) {
+			// 上限に達していたら先頭が完了するまで待つ
+			while (window.size() >= maxInFlight) {
+				std::unique_lock lock(mutex);
+				completed.wait(lock, [&] { return window.front()->done; });
+				lock.unlock();
+				emit(false);
+			}
+
+			auto slot = std::make_shared<Slot>();
+			window.push_back(slot);
+			pool.Submit([slot, path, &mutex, &completed, this] {
+				// 例外で done にならないと出力が先頭で止まるので、エラーの結果にして渡す
+				InspectionResult result;
+				try {
+					result = InspectPath(path, m_options.inspect);
+				} catch (const std::exception& e) {
+					result = {};
+					result.path = path;
+					result.meta.Add(L"error", L"読み込み失敗（" + utf8_to_unicode(e.what()) + L"）", MetaType::Error);
+				}
+				{
+					std::lock_guard lock(mutex);
+					slot->result = std::move(result);
+					slot->done = true;
+				}
+				completed.notify_all();
+			});
+			emit(false);
+		});
+	}
+
+	emit(true);
+	return emitted;
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include "Inspector.h"
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+struct BatchOptions {
+	std::vector<std::filesystem::path> inputs;	// ファイル・ディレクトリ（"-" は標準入力）
+	size_t threads = 0;							// 0 の場合は論理コア数
+	size_t maxInFlight = 0;						// 同時に保持する結果の上限（0 の場合はスレッド数の4倍）
+	InspectOptions inspect;
+};
+
+// ディレクトリを再帰的に走査して全ファイルを並列に調べる
+// 結果は入力順（ディレクトリ内は名前順）に呼び出し元のスレッドへ渡される
+class BatchInspector {
+public:
+	explicit BatchInspector(BatchOptions options);
+
+	// 処理したファイル数を返す
+	size_t Run(const std::function<void(const InspectionResult&)>& callback);
+
+	// 決まった順序でファイルを列挙する
+	static void Walk(const std::filesystem::path& path, const std::function<void(const std::filesystem::path&)>& visit);
+
+private:
+	BatchOptions m_options;
+};
@@ -0,0 +1,370 @@
+﻿#include "framework.h"
+#include "BenchCorpus.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <zlib.h>
+
+namespace {
+
+// プロンプトらしい文字列
+const char* const WORDS[] = {
+	"masterpiece", "best quality", "1girl", "solo", "long hair", "blue eyes", "smile", "outdoors", "sky", "cloud",
+	"cherry blossoms", "school uniform", "looking at viewer", "upper body", "detailed background", "cat ears",
+	"night", "city lights", "watercolor", "depth of field",
+};
+
+std::string MakePrompt(std::mt19937& rng, size_t bytes) {
+	std::string text;
+	while (text.size() < bytes) {
+		if (!text.empty()) text += ", ";
+		text += WORDS[rng() % std::size(WORDS)];
+	}
+	return text;
+}
+
+// ComfyUIのワークフローのような入れ子のJSON
+std::string MakeWorkflow(std::mt19937& rng, size_t bytes) {
+	std::string json = "{\"nodes\":[";
+	for (int id = 1; json.size() < bytes; ++id) {
+		if (id > 1) json += ',';
+		json += "{\"id\":" + std::to_string(id) + ",\"type\":\"KSampler\",\"widgets_values\":[" +
+			std::to_string(rng()) + ",20,7.5,\"euler\",\"" + MakePrompt(rng, 40) + "\"]}";
+	}
+	return json + "]}";
+}
+
+void PutBe32(std::vector<uint8_t>& out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void PutLe32(std::vector<uint8_t>& out, uint32_t value) {
+	for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void Append(std::vector<uint8_t>& out, std::string_view bytes) {
+	out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+std::vector<uint8_t> Compress(std::string_view input, int windowBits, int level) {
+	z_stream stream = {};
+	deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+	std::vector<uint8_t> out(deflateBound(&stream, static_cast<uLong>(input.size())) + 32);
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+	stream.avail_in = static_cast<uInt>(input.size());
+	stream.next_out = out.data();
+	stream.avail_out = static_cast<uInt>(out.size());
+	deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	return out;
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char* type, std::string_view data) {
+	PutBe32(out, static_cast<uint32_t>(data.size()));
+	size_t start = out.size();
+	Append(out, std::string_view(type, 4));
+	Append(out, data);
+	PutBe32(out, static_cast<uint32_t>(crc32(0, &out[start], static_cast<uInt>(out.size() - start))));
+}
+
+std::string_view AsText(const std::vector<uint8_t>& bytes) {
+	return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// RGBA8のPNG（フィルター無し）
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba, const std::vector<uint8_t>& textChunks) {
+	std::string raw;
+	raw.reserve((width * 4 + 1) * static_cast<size_t>(height));
+	for (uint32_t y = 0; y < height; ++y) {
+		raw += '\0';
+		raw.append(reinterpret_cast<const char*>(&rgba[static_cast<size_t>(y) * width * 4]), width * 4);
+	}
+
+	std::vector<uint8_t> png;
+	Append(png, std::string_view("\x89PNG\r\n\x1a\n", 8));
+	std::vector<uint8_t> ihdr;
+	PutBe32(ihdr, width);
+	PutBe32(ihdr, height);
+	ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0});
+	PutChunk(png, "IHDR", AsText(ihdr));
+	png.insert(png.end(), textChunks.begin(), textChunks.end());
+
+	// IDATは256KBごとに分ける
+	auto compressed = Compress(raw, 15, 1);
+	constexpr size_t IDAT_SIZE = 256 * 1024;
+	for (size_t pos = 0; pos < compressed.size(); pos += IDAT_SIZE) {
+		size_t n = std::min(IDAT_SIZE, compressed.size() - pos);
+		PutChunk(png, "IDAT", std::string_view(reinterpret_cast<const char*>(&compressed[pos]), n));
+	}
+	PutChunk(png, "IEND", {});
+	return png;
+}
+
+// EXIF（TIFF構造、リトルエンディアン）を組み立てる
+class TiffBuilder {
+public:
+	struct Entry {
+		uint16_t tag;
+		uint16_t type;
+		uint32_t count;
+		std::vector<uint8_t> value;	// 4バイトを超えれば後ろに置く
+		int child = -1;				// サブIFDへのポインター
+	};
+
+	int AddIfd() {
+		m_ifds.emplace_back();
+		return static_cast<int>(m_ifds.size()) - 1;
+	}
+	void Ascii(int ifd, uint16_t tag, std::string_view text) {
+		std::vector<uint8_t> value(text.begin(), text.end());
+		value.push_back(0);
+		m_ifds[ifd].push_back({tag, 2, static_cast<uint32_t>(value.size()), value});
+	}
+	void Short(int ifd, uint16_t tag, uint16_t v) {
+		m_ifds[ifd].push_back({tag, 3, 1, {static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8)}});
+	}
+	void Rationals(int ifd, uint16_t tag, uint16_t type, std::initializer_list<std::pair<uint32_t, uint32_t>> values) {
+		std::vector<uint8_t> value;
+		for (auto [n, d] : values) {
+			PutLe32(value, n);
+			PutLe32(value, d);
+		}
+		m_ifds[ifd].push_back({tag, type, static_cast<uint32_t>(values.size()), value});
+	}
+	void Undefined(int ifd, uint16_t tag, std::string_view bytes) {
+		m_ifds[ifd].push_back({tag, 7, static_cast<uint32_t>(bytes.size()), std::vector<uint8_t>(bytes.begin(), bytes.end())});
+	}
+	void Pointer(int ifd, uint16_t tag, int child) {
+		m_ifds[ifd].push_back({tag, 4, 1, {0, 0, 0, 0}, child});
+	}
+
+	// ifds[0] → ifds[next] の連鎖（-1 なら終端）
+	std::vector<uint8_t> Build(int next) const {
+		// IFDの位置を先に決める
+		std::vector<uint32_t> offsets;
+		uint32_t pos = 8;
+		for (const auto& ifd : m_ifds) {
+			offsets.push_back(pos);
+			pos += 2 + static_cast<uint32_t>(ifd.size()) * 12 + 4;
+		}
+
+		std::vector<uint8_t> out = {'I', 'I', 42, 0};
+		PutLe32(out, 8);
+		std::vector<uint8_t> data;	// IFDの後ろに置く値
+		for (size_t i = 0; i < m_ifds.size(); ++i) {
+			const auto& ifd = m_ifds[i];
+			out.push_back(static_cast<uint8_t>(ifd.size()));
+			out.push_back(static_cast<uint8_t>(ifd.size() >> 8));
+			for (const auto& entry : ifd) {
+				out.push_back(static_cast<uint8_t>(entry.tag));
+				out.push_back(static_cast<uint8_t>(entry.tag >> 8));
+				out.push_back(static_cast<uint8_t>(entry.type));
+				out.push_back(static_cast<uint8_t>(entry.type >> 8));
+				PutLe32(out, entry.count);
+				if (entry.child >= 0) {
+					PutLe32(out, offsets[entry.child]);
+				} else if (entry.value.size() <= 4) {
+					auto value = entry.value;
+					value.resize(4);
+					out.insert(out.end(), value.begin(), value.end());
+				} else {
+					PutLe32(out, pos + static_cast<uint32_t>(data.size()));
+					data.insert(data.end(), entry.value.begin(), entry.value.end());
+					if (data.size() & 1) data.push_back(0);
+				}
+			}
+			PutLe32(out, i == 0 && next >= 0 ? offsets[next] : 0);
+		}
+		out.insert(out.end(), data.begin(), data.end());
+		return out;
+	}
+
+private:
+	std::vector<std::vector<Entry>> m_ifds;
+};
+
+std::vector<uint8_t> MakeExif(std::mt19937& rng, size_t commentBytes) {
+	TiffBuilder tiff;
+	int ifd0 = tiff.AddIfd();
+	int exif = tiff.AddIfd();
+	int gps = tiff.AddIfd();
+	int ifd1 = tiff.AddIfd();
+	tiff.Ascii(ifd0, 0x010F, "ExampleCam");
+	tiff.Ascii(ifd0, 0x0110, "EX-" + std::to_string(rng() % 100));
+	tiff.Ascii(ifd0, 0x0131, "PhantomView Bench");
+	tiff.Ascii(ifd0, 0x0132, "2024:01:02 03:04:05");
+	tiff.Pointer(ifd0, 0x8769, exif);
+	tiff.Pointer(ifd0, 0x8825, gps);
+	tiff.Rationals(exif, 0x829A, 5, {{1, 125}});
+	tiff.Rationals(exif, 0x829D, 5, {{28, 10}});
+	tiff.Short(exif, 0x8827, 400);
+	tiff.Ascii(exif, 0x9003, "2024:01:02 03:04:05");
+	tiff.Rationals(exif, 0x9204, 10, {{static_cast<uint32_t>(-1), 3}});
+	tiff.Rationals(exif, 0x920A, 5, {{50, 1}});
+	tiff.Undefined(exif, 0x9286, std::string("ASCII\0\0\0", 8) + MakePrompt(rng, commentBytes));
+	tiff.Ascii(gps, 0x0001, "N");
+	tiff.Rationals(gps, 0x0002, 5, {{35, 1}, {40, 1}, {1234, 100}});
+	tiff.Ascii(gps, 0x0003, "E");
+	tiff.Rationals(gps, 0x0004, 5, {{139, 1}, {45, 1}, {5678, 100}});
+	tiff.Rationals(ifd1, 0x011A, 5, {{72, 1}});
+	tiff.Rationals(ifd1, 0x011B, 5, {{72, 1}});
+	return tiff.Build(ifd1);
+}
+
+std::vector<uint8_t> MakeJpeg(std::mt19937& rng, size_t commentBytes) {
+	auto exif = MakeExif(rng, commentBytes);
+	std::vector<uint8_t> jpeg = {0xFF, 0xD8, 0xFF, 0xE1};
+	size_t length = exif.size() + 8;
+	jpeg.push_back(static_cast<uint8_t>(length >> 8));
+	jpeg.push_back(static_cast<uint8_t>(length));
+	Append(jpeg, std::string_view("Exif\0\0", 6));
+	jpeg.insert(jpeg.end(), exif.begin(), exif.end());
+	// 画像データの代わり（抽出処理はSOSで止まる）
+	jpeg.insert(jpeg.end(), {0xFF, 0xDA, 0x00, 0x02});
+	for (int i = 0; i < 4096; ++i) jpeg.push_back(static_cast<uint8_t>(rng() & 0x7F));
+	jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+	return jpeg;
+}
+
+std::vector<uint8_t> MakeWebp(std::mt19937& rng, size_t commentBytes) {
+	auto exif = MakeExif(rng, commentBytes);
+	std::vector<uint8_t> body;
+	Append(body, "WEBP");
+	// 中身の無いVP8Lチャンク（抽出処理は読み飛ばす）
+	Append(body, "VP8L");
+	PutLe32(body, 1024);
+	for (int i = 0; i < 1024; ++i) body.push_back(static_cast<uint8_t>(rng()));
+	Append(body, "EXIF");
+	PutLe32(body, static_cast<uint32_t>(exif.size()));
+	body.insert(body.end(), exif.begin(), exif.end());
+	if (exif.size() & 1) body.push_back(0);
+
+	std::vector<uint8_t> webp;
+	Append(webp, "RIFF");
+	PutLe32(webp, static_cast<uint32_t>(body.size()));
+	webp.insert(webp.end(), body.begin(), body.end());
+	return webp;
+}
+
+std::vector<uint8_t> MakePngText(std::mt19937& rng, size_t parametersBytes, size_t workflowBytes) {
+	std::vector<uint8_t> chunks;
+	std::string parameters = "parameters";
+	parameters += '\0';
+	parameters += MakePrompt(rng, parametersBytes) + "\nSteps: 28, Sampler: Euler a, CFG scale: 7, Seed: " + std::to_string(rng());
+	PutChunk(chunks, "tEXt", parameters);
+
+	if (workflowBytes) {
+		std::string workflow = "workflow";
+		workflow += std::string("\0\0", 2);
+		auto compressed = Compress(MakeWorkflow(rng, workflowBytes), 15, 6);
+		workflow.append(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+		PutChunk(chunks, "zTXt", workflow);
+
+		std::string comment = "Comment";
+		comment += std::string("\0\0\0ja\0", 6);
+		comment += "コメント";
+		comment += '\0';
+		comment += MakePrompt(rng, parametersBytes);
+		PutChunk(chunks, "iTXt", comment);
+	}
+
+	std::vector<uint8_t> rgba(64 * 64 * 4);
+	for (auto& b : rgba) b = static_cast<uint8_t>(rng());
+	return EncodePng(64, 64, rgba, chunks);
+}
+
+// アルファのLSBに列優先で埋め込んだ画像
+std::vector<uint8_t> MakeNai(std::mt19937& rng, uint32_t width, uint32_t height, const std::vector<uint8_t>& payload) {
+	std::vector<uint8_t> data;
+	Append(data, "stealth_pngcomp");
+	PutBe32(data, static_cast<uint32_t>(payload.size() * 8));	// NovelAIと同じくビット数
+	data.insert(data.end(), payload.begin(), payload.end());
+
+	// 大きな画像でも生成が重くならないよう、色は行ごとの単色にする
+	std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; ++y) {
+		uint8_t r = static_cast<uint8_t>(rng()), g = static_cast<uint8_t>(rng()), b = static_cast<uint8_t>(rng());
+		uint8_t* row = &rgba[static_cast<size_t>(y) * width * 4];
+		for (uint32_t x = 0; x < width; ++x) {
+			row[x * 4 + 0] = r;
+			row[x * 4 + 1] = g;
+			row[x * 4 + 2] = b;
+			row[x * 4 + 3] = 0xFE;
+		}
+	}
+	size_t bits = std::min<size_t>(data.size() * 8, static_cast<size_t>(width) * height);
+	for (size_t i = 0; i < bits; ++i) {
+		size_t x = i / height, y = i % height;
+		rgba[(y * width + x) * 4 + 3] |= (data[i / 8] >> (7 - i % 8)) & 1;
+	}
+	return EncodePng(width, height, rgba, {});
+}
+
+} // namespace
+
+std::vector<uint8_t> BenchCorpus::NaiPayload(uint32_t seed, size_t jsonBytes) {
+	std::mt19937 rng(seed);
+	std::string json = "{\"prompt\":\"" + MakePrompt(rng, jsonBytes) + "\",\"steps\":28,\"scale\":5,\"seed\":" +
+		std::to_string(rng()) + ",\"sampler\":\"k_euler_ancestral\"}";
+	return Compress(json, 15 + 16, 6);
+}
+
+std::vector<CorpusFile> BenchCorpus::Generate(uint32_t seed, size_t maxNaiSide) {
+	std::mt19937 rng(seed);
+	std::vector<CorpusFile> files;
+	auto add = [&](std::string name, std::string kind, std::vector<uint8_t> data) {
+		files.push_back({std::move(name), std::move(kind), std::move(data)});
+	};
+
+	// PNGのテキスト（小: tEXtのみ、中・大: zTXtのワークフローとiTXt付き）
+	const struct { const char* kind; size_t parameters; size_t workflow; int count; } pngs[] = {
+		{"png-text-small", 256, 0, 64},
+		{"png-text-medium", 4 * 1024, 32 * 1024, 32},
+		{"png-text-large", 64 * 1024, 512 * 1024, 8},
+	};
+	for (const auto& spec : pngs) {
+		for (int i = 0; i < spec.count; ++i) {
+			add(std::string(spec.kind) + "-" + std::to_string(i) + ".png", spec.kind, MakePngText(rng, spec.parameters, spec.workflow));
+		}
+	}
+	for (int i = 0; i < 64; ++i) add("jpeg-exif-" + std::to_string(i) + ".jpg", "jpeg-exif", MakeJpeg(rng, 64 + i * 32));
+	for (int i = 0; i < 64; ++i) add("webp-exif-" + std::to_string(i) + ".webp", "webp-exif", MakeWebp(rng, 64 + i * 32));
+
+	// NAIのステルス埋め込み
+	const struct { const char* kind; uint32_t width; uint32_t height; int count; } nais[] = {
+		{"nai-512", 512, 512, 8},
+		{"nai-1024", 1024, 1024, 4},
+		{"nai-2048", 2048, 2048, 2},
+		{"nai-4K", 3840, 2160, 1},
+		{"nai-8K", 7680, 4320, 1},
+		{"nai-short", 4096, 128, 4},	// 見出しの行数より低いので全行を展開してから詰める
+	};
+	for (const auto& spec : nais) {
+		if (maxNaiSide && std::max(spec.width, spec.height) > maxNaiSide) continue;
+		for (int i = 0; i < spec.count; ++i) {
+			auto payload = NaiPayload(static_cast<uint32_t>(rng()), 2048);
+			add(std::string(spec.kind) + "-" + std::to_string(i) + ".png", spec.kind, MakeNai(rng, spec.width, spec.height, payload));
+		}
+	}
+	return files;
+}
+
+bool BenchCorpus::Write(const std::vector<CorpusFile>& files, const std::filesystem::path& directory) {
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+	for (const auto& file : files) {
+		auto path = directory / file.name;
+#ifdef _WIN32
+		FILE* out = _wfopen(path.c_str(), L"wb");
+#else
+		FILE* out = fopen(path.c_str(), "wb");
+#endif
+		if (!out) return false;
+		bool ok = fwrite(file.data.data(), 1, file.data.size(), out) == file.data.size();
+		if (fclose(out) != 0 || !ok) return false;
+	}
+	return true;
+}
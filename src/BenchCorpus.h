@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// ベンチマーク用の合成画像
+struct CorpusFile {
+	std::string name;		// ファイル名（拡張子付き）
+	std::string kind;		// 集計の単位（"png-text"、"jpeg-exif"、"nai-4K" など）
+	std::vector<uint8_t> data;
+};
+
+// 再現性のある合成コーパス（同じ seed なら同じバイト列）
+//   PNG  : tEXt/zTXt/iTXt（数百バイト〜数百KB）
+//   JPEG : IFD0・Exif・GPS・IFD1を持つEXIF
+//   WebP : EXIFチャンク
+//   NAI  : アルファチャンネルのステルス埋め込み（512²〜8K）
+class BenchCorpus {
+public:
+	// maxNaiSide より大きいNAI画像は作らない（0 なら8Kまで）
+	static std::vector<CorpusFile> Generate(uint32_t seed, size_t maxNaiSide = 0);
+
+	// gzip圧縮したNAIのペイロード（JSON）
+	static std::vector<uint8_t> NaiPayload(uint32_t seed, size_t jsonBytes);
+
+	// ディレクトリに書き出す（バッチモードの計測用）
+	static bool Write(const std::vector<CorpusFile>& files, const std::filesystem::path& directory);
+};
@@ -0,0 +1,351 @@
+﻿#include "framework.h"
+#include "Benchmark.h"
+#include "BenchCorpus.h"
+#include "Inflater.h"
+#include "LsbPack.h"
+#include "MetaExtractor.h"
+#include "NAIExtractor.h"
+#include "TextUtils.h"
+#include "Utf.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 最速の実行時間（ミリ秒）
+template <class Func>
+double MeasureBest(int repeat, Func func) {
+	double best = 1e300;
+	for (int i = 0; i < repeat; ++i) {
+		auto start = Clock::now();
+		func();
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		if (ms < best) best = ms;
+	}
+	return best;
+}
+
+// 従来のNAI抽出と同じ手順（列優先でアルファをコピー → 1ビットずつ → シフトで詰める）
+std::vector<uint8_t> PackLsbReference(const uint8_t* p, ptrdiff_t stride, size_t width, size_t height) {
+	std::vector<unsigned char> alpha;
+	alpha.reserve(width * height);
+	for (size_t x = 0; x < width; ++x) {
+		for (size_t y = 0; y < height; ++y) {
+			const unsigned char* row = p + static_cast<ptrdiff_t>(y) * stride;
+			alpha.push_back(row[x * 4 + 3]);
+		}
+	}
+	std::vector<uint8_t> lsb_bits;
+	lsb_bits.reserve(alpha.size());
+	for (unsigned char a : alpha) {
+		lsb_bits.push_back(a & 0x01);
+	}
+	std::vector<uint8_t> lsb_bytes;
+	uint8_t acc = 0;
+	int bit_count = 0;
+	for (size_t i = 0; i < lsb_bits.size(); ++i) {
+		acc = (acc << 1) | lsb_bits[i];
+		bit_count++;
+		if (bit_count == 8) {
+			lsb_bytes.push_back(acc);
+			acc = 0;
+			bit_count = 0;
+		}
+	}
+	if (bit_count > 0) {
+		acc <<= (8 - bit_count);
+		lsb_bytes.push_back(acc);
+	}
+	return lsb_bytes;
+}
+
+// LSB抽出：従来の手順と各カーネルの比較
+void BenchLsbPack(FILE* out, bool csv) {
+	struct Size { const char* name; size_t width; size_t height; };
+	const Size sizes[] = {
+		{ "1024x1024", 1024, 1024 },
+		{ "4K", 3840, 2160 },
+		{ "8K", 7680, 4320 },
+		{ "8K-odd", 7679, 4321 },
+	};
+
+	if (!csv) fprintf(out, "[LSB pack]\n");
+	std::mt19937 rng(12345);
+	for (const auto& size : sizes) {
+		ptrdiff_t stride = static_cast<ptrdiff_t>(size.width * 4);
+		std::vector<uint8_t> pixels(size.width * size.height * 4);
+		for (auto& b : pixels) b = static_cast<uint8_t>(rng());
+		double mpix = size.width * size.height / 1e6;
+
+		std::vector<uint8_t> expected;
+		double baseline = MeasureBest(3, [&] { expected = PackLsbReference(pixels.data(), stride, size.width, size.height); });
+		if (csv) {
+			fprintf(out, "lsb,%s,reference,,,,,%.3f,,,\n", size.name, baseline);
+		} else {
+			fprintf(out, "  %-10s %-10s %9.2f ms %9.1f MP/s\n", size.name, "reference", baseline, mpix / baseline * 1000);
+		}
+
+		auto print = [&](const char* variant, double ms, bool match) {
+			if (csv) {
+				fprintf(out, "lsb,%s,%s,,,,,%.3f,,,%s\n", size.name, variant, ms, match ? "" : "MISMATCH");
+			} else {
+				fprintf(out, "  %-10s %-10s %9.2f ms %9.1f MP/s  x%.1f%s\n", size.name, variant, ms,
+					mpix / ms * 1000, baseline / ms, match ? "" : "  MISMATCH");
+			}
+		};
+		for (auto kernel : { LsbKernel::Scalar, LsbKernel::SSE2, LsbKernel::AVX2 }) {
+			if (resolve_lsb_kernel(kernel) != kernel) continue;
+			std::vector<uint8_t> packed;
+			double ms = MeasureBest(5, [&] {
+				packed = pack_lsb_column_major(pixels.data(), stride, size.width, size.height, 3, kernel);
+			});
+			print(lsb_kernel_name(kernel), ms, packed == expected);
+		}
+
+		// GDI+で展開した画像・低いPNGと同じく、アルファとRGBを両方求める場合（RGBの埋め込みは無い）
+		// rgb-all は全列のRGBを詰めたとき、nai は見出しの合わないRGBを打ち切る NAIExtractor の手順
+		std::vector<uint8_t> alpha, rgb;
+		double ms = MeasureBest(3, [&] {
+			pack_lsb_column_major_rgba(pixels.data(), stride, size.width, size.height, 2, &alpha, &rgb);
+		});
+		print("rgb-all", ms, alpha == expected);
+		ms = MeasureBest(5, [&] {
+			NAIExtractor::PackLsb(pixels.data(), stride, size.width, size.height, 2, &alpha, &rgb);
+		});
+		print("nai", ms, alpha == expected);
+	}
+}
+
+#ifdef _WIN32
+// 従来の文字コード変換（長さを求めてから一時バッファに変換し、結果へコピーする）
+std::wstring Utf8ToUnicodeReference(std::string_view utf8) {
+	if (utf8.empty()) return std::wstring();
+	int length = static_cast<int>(utf8.size());
+	int size = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), length, nullptr, 0);
+	if (size == 0) return std::wstring();
+	std::vector<wchar_t> buffer(size);
+	if (MultiByteToWideChar(CP_UTF8, 0, utf8.data(), length, buffer.data(), size) == 0) return std::wstring();
+	return std::wstring(buffer.begin(), buffer.end());
+}
+
+std::string UnicodeToUtf8Reference(const std::wstring& unicode) {
+	if (unicode.empty()) return std::string();
+	int size = WideCharToMultiByte(CP_UTF8, 0, unicode.c_str(), -1, nullptr, 0, nullptr, nullptr);
+	if (size == 0) return std::string();
+	std::vector<char> buffer(size);
+	if (WideCharToMultiByte(CP_UTF8, 0, unicode.c_str(), -1, buffer.data(), size, nullptr, nullptr) == 0) return std::string();
+	return std::string(buffer.begin(), buffer.end() - 1);
+}
+#endif
+
+// 文字コード変換：従来の変換（Windowsのみ）と各カーネルの比較
+void BenchUtf(FILE* out, bool csv) {
+	// 4MB前後の文字列（JSONのようなASCII・日本語混じり・絵文字・壊れたバイト列）
+	const size_t target = 4 * 1024 * 1024;
+	std::mt19937 rng(4321);
+	auto repeat = [&](std::string_view unit) {
+		std::string text;
+		text.reserve(target + unit.size());
+		while (text.size() < target) text += unit;
+		return text;
+	};
+	std::string random(target, '\0');
+	for (auto& c : random) c = static_cast<char>(rng());
+	struct Text { const char* name; std::string utf8; };
+	const Text texts[] = {
+		{ "ascii", repeat("{\"prompt\": \"masterpiece, best quality, 1girl, solo, looking at viewer\", \"steps\": 28, \"scale\": 5.0},\n") },
+		{ "japanese", repeat("{\"prompt\": \"\xE5\xB0\x91\xE5\xA5\xB3\xE3\x80\x81\xE9\x9D\x92\xE3\x81\x84\xE7\x9B\xAE\", \"steps\": 28},\n") },
+		{ "emoji", repeat("\xF0\x9F\x8E\xA8\xF0\x9F\x96\x8C abc \xF0\x9F\x8C\xB8") },
+		{ "invalid", random },
+	};
+
+	if (!csv) fprintf(out, "[UTF transcoding]\n");
+	auto print = [&](const std::string& name, const char* variant, double mb, double ms, double baseline, bool match) {
+		if (csv) {
+			fprintf(out, "utf,%s,%s,,%.3f,,%.1f,%.3f,,,%s\n", name.c_str(), variant, mb, mb / ms * 1000, ms, match ? "" : "MISMATCH");
+		} else {
+			fprintf(out, "  %-18s %-10s %9.2f ms %9.1f MB/s  x%.1f%s\n", name.c_str(), variant, ms, mb / ms * 1000,
+				baseline / ms, match ? "" : "  MISMATCH");
+		}
+	};
+	// カーネルは確保済みのバッファへの変換だけ、それ以外は文字列を返すまでを計る
+	for (const auto& text : texts) {
+		double mb = text.utf8.size() / (1024.0 * 1024.0);
+
+		// UTF-8 → wchar_t
+		std::wstring expected(wide_max_length_from_utf8(text.utf8.size()), L'\0');
+		expected.resize(utf8_to_wide(text.utf8, expected.data(), UtfKernel::Scalar));
+		std::string name = std::string("to-wide/") + text.name;
+		double baseline = 0;
+#ifdef _WIN32
+		{
+			std::wstring wide;
+			baseline = MeasureBest(3, [&] { wide = Utf8ToUnicodeReference(text.utf8); });
+			print(name, "win32", mb, baseline, baseline, wide == expected);
+		}
+#endif
+		for (auto kernel : { UtfKernel::Scalar, UtfKernel::SSE2 }) {
+			if (resolve_utf_kernel(kernel) != kernel) continue;
+			std::wstring wide(wide_max_length_from_utf8(text.utf8.size()), L'\0');
+			size_t length = 0;
+			double ms = MeasureBest(5, [&] { length = utf8_to_wide(text.utf8, wide.data(), kernel); });
+			if (baseline == 0) baseline = ms;
+			wide.resize(length);
+			print(name, utf_kernel_name(kernel), mb, ms, baseline, wide == expected);
+		}
+		{
+			std::wstring wide;
+			double ms = MeasureBest(5, [&] { wide = utf8_to_unicode(text.utf8); });
+			print(name, "string", mb, ms, baseline, wide == expected);
+		}
+
+		// wchar_t → UTF-8（壊れたバイト列は U+FFFD に置き換わった後の文字列を変換する）
+		std::string roundTrip(utf8_max_length_from_wide(expected.size()), '\0');
+		roundTrip.resize(wide_to_utf8(expected, roundTrip.data(), UtfKernel::Scalar));
+		name = std::string("to-utf8/") + text.name;
+		baseline = 0;
+#ifdef _WIN32
+		{
+			std::string narrow;
+			baseline = MeasureBest(3, [&] { narrow = UnicodeToUtf8Reference(expected); });
+			print(name, "win32", mb, baseline, baseline, narrow == roundTrip);
+		}
+#endif
+		for (auto kernel : { UtfKernel::Scalar, UtfKernel::SSE2 }) {
+			if (resolve_utf_kernel(kernel) != kernel) continue;
+			std::string narrow(utf8_max_length_from_wide(expected.size()), '\0');
+			size_t length = 0;
+			double ms = MeasureBest(5, [&] { length = wide_to_utf8(expected, narrow.data(), kernel); });
+			if (baseline == 0) baseline = ms;
+			narrow.resize(length);
+			print(name, utf_kernel_name(kernel), mb, ms, baseline, narrow == roundTrip);
+		}
+		{
+			std::string narrow;
+			double ms = MeasureBest(5, [&] { narrow = unicode_to_utf8(expected); });
+			print(name, "string", mb, ms, baseline, narrow == roundTrip);
+		}
+	}
+}
+
+// 1ファイルずつの処理時間の集計
+struct StageStats {
+	size_t files = 0;
+	size_t bytes = 0;
+	size_t failures = 0;
+	std::vector<double> latencies;	// ミリ秒
+
+	double Total() const {
+		double total = 0;
+		for (double ms : latencies) total += ms;
+		return total;
+	}
+	double Percentile(double p) const {
+		if (latencies.empty()) return 0;
+		auto sorted = latencies;
+		std::sort(sorted.begin(), sorted.end());
+		return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+	}
+};
+
+void PrintStage(FILE* out, bool csv, const char* stage, const std::string& kind, const StageStats& stats, int rounds) {
+	double seconds = stats.Total() / 1000;
+	double mb = stats.bytes / 1e6;
+	double filesPerSecond = seconds > 0 ? stats.latencies.size() / seconds : 0;
+	double mbPerSecond = seconds > 0 ? mb * rounds / seconds : 0;
+	const char* status = stats.failures ? "MISMATCH" : "";
+	if (csv) {
+		fprintf(out, "extract,%s,%s,%zu,%.3f,%.1f,%.1f,%.3f,%.3f,%.3f,%s\n", kind.c_str(), stage, stats.files, mb,
+			filesPerSecond, mbPerSecond, stats.Percentile(0.5), stats.Percentile(0.95), stats.Percentile(1.0), status);
+	} else {
+		fprintf(out, "  %-20s %-16s %4zu files %8.2f MB %10.1f files/s %8.1f MB/s  p50 %8.3f  p95 %8.3f  max %8.3f ms%s%s\n",
+			stage, kind.c_str(), stats.files, mb, filesPerSecond, mbPerSecond, stats.Percentile(0.5), stats.Percentile(0.95),
+			stats.Percentile(1.0), *status ? "  " : "", status);
+	}
+}
+
+// 形式ごとの抽出処理（合成コーパスに対して）
+void BenchExtractors(FILE* out, bool csv, size_t maxNaiSide) {
+	auto start = Clock::now();
+	auto corpus = BenchCorpus::Generate(20240101, maxNaiSide);
+	double generateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	if (!csv) fprintf(out, "[Extract] corpus: %zu files, generated in %.0f ms\n", corpus.size(), generateMs);
+
+	// 種類の並び順はコーパスの順
+	std::vector<std::string> kinds;
+	std::map<std::string, std::vector<const CorpusFile*>> byKind;
+	for (const auto& file : corpus) {
+		auto& files = byKind[file.kind];
+		if (files.empty()) kinds.push_back(file.kind);
+		files.push_back(&file);
+	}
+
+	for (const auto& kind : kinds) {
+		const auto& files = byKind[kind];
+		bool nai = kind.starts_with("nai-");
+		const char* stage = nai ? "ExtractNAI" :
+			kind.starts_with("png-") ? "ExtractFromPNG" :
+			kind.starts_with("jpeg-") ? "ExtractFromJPEG" : "ExtractFromWEBP";
+
+		// 小さいファイルは繰り返して計測のばらつきを抑える
+		size_t kindBytes = 0;
+		for (const auto* file : files) kindBytes += file->data.size();
+		int rounds = static_cast<int>(std::clamp<size_t>(64 * 1024 * 1024 / std::max<size_t>(kindBytes, 1), 1, 20));
+
+		StageStats stats;
+		stats.files = files.size();
+		stats.bytes = kindBytes;
+		for (int round = 0; round < rounds; ++round) {
+			for (const auto* file : files) {
+				auto image = ImageBuffer::FromSpan(file->data);
+				auto begin = Clock::now();
+				auto result = nai ? NAIExtractor::ExtractNAI(image) : MetaExtractor::ExtractMeta(image);
+				stats.latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+				// 抽出できなかった・展開に失敗した場合は結果が変わったものとして数える
+				bool ok = !result.empty();
+				for (const auto& entry : result) {
+					if (entry.type == MetaType::Error) ok = false;
+				}
+				if (round == 0 && !ok) ++stats.failures;
+			}
+		}
+		PrintStage(out, csv, stage, kind, stats, rounds);
+	}
+
+	// NAIのペイロードのgzip展開だけ（DecompressGzipData と同じ処理）
+	for (size_t jsonBytes : { 2 * 1024, 64 * 1024, 1024 * 1024 }) {
+		auto payload = BenchCorpus::NaiPayload(7, jsonBytes);
+		StageStats stats;
+		stats.files = 1;
+		stats.bytes = payload.size();
+		int rounds = 50;
+		for (int round = 0; round < rounds; ++round) {
+			std::string json;
+			auto begin = Clock::now();
+			auto status = Inflater::ForThread().Inflate(payload, InflateFormat::Gzip, json);
+			auto value = utf8_to_unicode(json);
+			stats.latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+			if (round == 0 && (status != InflateStatus::Ok || value.empty())) ++stats.failures;
+		}
+		PrintStage(out, csv, "DecompressGzipData", "json-" + std::to_string(jsonBytes / 1024) + "KB", stats, rounds);
+	}
+}
+
+} // namespace
+
+int RunBenchmarks(FILE* out, const BenchmarkOptions& options) {
+	auto wanted = [&](const char* suite) { return options.suite.empty() || options.suite == suite; };
+	if (options.csv) fprintf(out, "suite,case,variant,files,mb,files_per_s,mb_per_s,p50_ms,p95_ms,max_ms,status\n");
+	if (wanted("lsb")) BenchLsbPack(out, options.csv);
+	if (wanted("utf")) BenchUtf(out, options.csv);
+	if (wanted("extract")) BenchExtractors(out, options.csv, options.maxNaiSide);
+	fflush(out);
+	return 0;
+}
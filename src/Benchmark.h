@@ -0,0 +1,13 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+struct BenchmarkOptions {
+	std::string suite;		// "lsb"・"utf"・"extract"（空なら全て）
+	bool csv = false;		// 回帰の比較用にCSVで出力する
+	size_t maxNaiSide = 0;	// これより大きいNAI画像は計測しない（0 なら8Kまで）
+};
+
+// マイクロベンチマークを実行して結果を出力する
+int RunBenchmarks(FILE* out, const BenchmarkOptions& options = {});
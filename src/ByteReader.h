@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// ビッグエンディアン16ビット値
+inline uint16_t read_be16(const uint8_t* p) {
+	return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+// ビッグエンディアン32ビット値
+inline uint32_t read_be32(const uint8_t* p) {
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+		(static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// リトルエンディアン16ビット値
+inline uint16_t read_le16(const uint8_t* p) {
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+// リトルエンディアン32ビット値
+inline uint32_t read_le32(const uint8_t* p) {
+	return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+		(static_cast<uint32_t>(p[3]) << 24);
+}
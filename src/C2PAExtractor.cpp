@@ -1,25 +1,80 @@
 ﻿#include "framework.h"
 #include "C2PAExtractor.h"
 #include "TextUtils.h"
+#include "FormatProbe.h"
+#include "C2PAStore.h"
+#include "Trace.h"
 #include <c2pa.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <mutex>
 
-info_list C2PAExtractor::ExtractC2PA(const std::wstring& imagePath) {
-    info_list result;
+#ifdef _WIN32
+// c2pa_c.dll は遅延読み込みにしてあり、マニフェストストアのあるファイルを開いたときに初めて読み込む
+#include <delayimp.h>
+#pragma comment(lib, "delayimp.lib")
+#endif
+
+// C2PAライブラリを使えるか（初回に読み込みを試す）
+static bool LoadEngine() {
+#ifdef _WIN32
+    static std::once_flag once;
+    static bool loaded = false;
+    std::call_once(once, [] {
+        TRACE_SCOPE("c2pa_c.dll");
+        // DLLが無い場合に関数呼び出しで構造化例外にならないよう、先に全ての関数を解決しておく
+        loaded = SUCCEEDED(__HrLoadAllImportsForDll("c2pa_c.dll"));
+    });
+    return loaded;
+#else
+    return true;
+#endif
+}
+
+// C2PAリーダーに渡すフォーマット（MIMEタイプ）を決める
+static std::string GuessFormat(const ImageBuffer& image, ImageFormat format) {
+    if (const char* mime = FormatProbe::MimeType(format)) return mime;
+
+    // シグネチャで判定できない場合は拡張子に任せる
+    std::wstring ext = path_to_unicode(image.path().extension());
+    if (!ext.empty()) ext.erase(0, 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
+    return unicode_to_utf8(ext);
+}
+
+MetaList C2PAExtractor::ExtractC2PA(const ImageBuffer& image) {
+    MetaList result;
+    if (image.empty()) return result;
+
+    // マニフェストストアが無ければリーダーを作らない（作ると例外で失敗するだけ）
+    auto format = FormatProbe::Sniff(image.span());
+    if (can_locate_c2pa_store(format) && locate_c2pa_store(image.span(), format).empty()) return result;
+    if (!LoadEngine()) return result;
 
     try {
-        // ファイルパスをUTF-8に変換
-        std::string utf8Path = unicode_to_utf8(imagePath);
+        // マップ済みのデータをストリームとして読み込む（ファイルは開き直さない）
+        MemoryStreamBuf buf(image.span());
+        std::istream stream(&buf);
 
         // C2PA情報を読み込み
-        c2pa::Reader reader(utf8Path);
+        c2pa::Reader reader(GuessFormat(image, format), stream);
 
         // マニフェストをJSONとして取得
-        std::string manifest_json = reader.json();
+        std::string manifest_json;
+        {
+            TRACE_SCOPE("c2pa::Reader::json");
+            manifest_json = reader.json();
+        }
 
         if (!manifest_json.empty()) {
-            result.push_back({L"C2PA_JSON", utf8_to_unicode(manifest_json)});
+            result.Add("C2PA_JSON", std::move(manifest_json), MetaType::Json);
         }
 	} catch (...) {
 	}
     return result;
 }
+
+MetaList C2PAExtractor::ExtractC2PA(const std::wstring& imagePath) {
+    return ExtractC2PA(ImageBuffer::FromFile(imagePath));
+}
\ No newline at end of file
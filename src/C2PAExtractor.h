@@ -1,7 +1,9 @@
 ﻿#pragma once
-#include "InfoList.h"
+#include "MetaList.h"
+#include "ImageBuffer.h"
 
 class C2PAExtractor {
 public:
-    static info_list ExtractC2PA(const std::wstring& filePath);
+    static MetaList ExtractC2PA(const ImageBuffer& image);
+    static MetaList ExtractC2PA(const std::wstring& filePath);
 };
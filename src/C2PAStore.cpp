@@ -0,0 +1,139 @@
+﻿#include "framework.h"
+#include "C2PAStore.h"
+#include "ByteReader.h"
+#include "Isobmff.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+// マニフェストストアの記述ボックス（jumd）の種類
+static constexpr uint8_t C2PA_STORE_TYPE[16] = {
+	0x63, 0x32, 0x70, 0x61, 0x00, 0x11, 0x00, 0x10, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71,
+};
+
+// ISOBMFFでマニフェストストアを入れるuuidボックスの識別子
+static constexpr uint8_t C2PA_UUID[16] = {
+	0xD8, 0xFE, 0xC3, 0xD6, 0x1B, 0x0E, 0x48, 0x3C, 0x92, 0x97, 0x58, 0x28, 0x87, 0x7E, 0xC4, 0x81,
+};
+
+static bool TypeIs(const uint8_t* p, std::string_view type) {
+	return memcmp(p, type.data(), 4) == 0;
+}
+
+bool is_c2pa_jumbf(std::span<const uint8_t> box) {
+	// jumb スーパーボックス
+	if (box.size() < 8 || !TypeIs(&box[4], "jumb")) return false;
+	size_t pos = read_be32(&box[0]) == 1 ? 16 : 8;
+
+	// 先頭の子は記述ボックス（jumd）で、種類のUUIDを持つ
+	if (box.size() < pos + 8 + 16 || !TypeIs(&box[pos + 4], "jumd")) return false;
+	return memcmp(&box[pos + 8], C2PA_STORE_TYPE, 16) == 0;
+}
+
+bool can_locate_c2pa_store(ImageFormat format) {
+	switch (format) {
+	case ImageFormat::Png:
+	case ImageFormat::Jpeg:
+	case ImageFormat::WebP:
+	case ImageFormat::Heif:
+	case ImageFormat::Avif:
+	case ImageFormat::JpegXl:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static std::span<const uint8_t> LocateInPng(std::span<const uint8_t> data) {
+	for (size_t pos = 8; pos + 8 <= data.size();) {
+		uint32_t length = read_be32(&data[pos]);
+		if (length > data.size() - pos - 8) break;
+		auto body = data.subspan(pos + 8, length);
+		if (TypeIs(&data[pos + 4], "caBX") && is_c2pa_jumbf(body)) return body;
+		if (TypeIs(&data[pos + 4], "IEND")) break;
+		pos += 12 + static_cast<size_t>(length);
+	}
+	return {};
+}
+
+static std::span<const uint8_t> LocateInJpeg(std::span<const uint8_t> data) {
+	size_t pos = 2;
+	while (pos + 4 <= data.size() && data[pos] == 0xFF) {
+		uint8_t marker = data[pos + 1];
+		if (marker == 0xFF) {
+			++pos;
+			continue;
+		}
+		if (marker == 0xDA || marker == 0xD9) break;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			pos += 2;
+			continue;
+		}
+		uint16_t size = read_be16(&data[pos + 2]);
+		if (size < 2 || pos + 2 + size > data.size()) break;
+		auto segment = data.subspan(pos + 4, size - 2);
+		pos += 2 + size;
+
+		// "JP"・ボックスの番号（2バイト）・通し番号（4バイト）の後にJUMBFが続く
+		if (marker != 0xEB || segment.size() < 8 || segment[0] != 'J' || segment[1] != 'P') continue;
+		if (read_be32(&segment[4]) != 1) continue;
+		auto box = segment.subspan(8);
+		if (is_c2pa_jumbf(box)) return box;
+	}
+	return {};
+}
+
+static std::span<const uint8_t> LocateInWebp(std::span<const uint8_t> data) {
+	if (data.size() < 12) return {};
+	size_t end = std::min<size_t>(data.size(), static_cast<size_t>(read_le32(&data[4])) + 8);
+	for (size_t pos = 12; pos + 8 <= end;) {
+		uint32_t size = read_le32(&data[pos + 4]);
+		size_t start = pos + 8;
+		if (size > end - start) break;
+		auto body = data.subspan(start, size);
+		if (TypeIs(&data[pos], "C2PA") && is_c2pa_jumbf(body)) return body;
+		pos = start + size + (size & 1);
+	}
+	return {};
+}
+
+static std::span<const uint8_t> LocateInIsobmff(std::span<const uint8_t> data) {
+	std::span<const uint8_t> found;
+	walk_boxes(data, [&](std::string_view type, std::span<const uint8_t>, std::span<const uint8_t> body) {
+		if (type != "uuid" || body.size() < 20 || memcmp(body.data(), C2PA_UUID, 16) != 0) return true;
+
+		// バージョン・フラグ（4バイト）、用途の文字列、"manifest" ならオフセット（8バイト）の後にJUMBF
+		auto rest = body.subspan(20);
+		auto* terminator = static_cast<const uint8_t*>(memchr(rest.data(), 0, rest.size()));
+		if (!terminator) return true;
+		std::string_view purpose(reinterpret_cast<const char*>(rest.data()), terminator - rest.data());
+		size_t offset = purpose.size() + 1 + 8;
+		if (purpose != "manifest" || rest.size() < offset) return true;
+		if (is_c2pa_jumbf(rest.subspan(offset))) found = rest.subspan(offset);
+		return found.empty();
+	});
+	return found;
+}
+
+static std::span<const uint8_t> LocateInJpegXl(std::span<const uint8_t> data) {
+	// コードストリームだけのファイルにはボックスが無い
+	if (data.empty() || data[0] != 0) return {};
+	std::span<const uint8_t> found;
+	walk_boxes(data, [&](std::string_view type, std::span<const uint8_t> box, std::span<const uint8_t>) {
+		if (type == "jumb" && is_c2pa_jumbf(box)) found = box;
+		return found.empty();
+	});
+	return found;
+}
+
+std::span<const uint8_t> locate_c2pa_store(std::span<const uint8_t> data, ImageFormat format) {
+	switch (format) {
+	case ImageFormat::Png: return LocateInPng(data);
+	case ImageFormat::Jpeg: return LocateInJpeg(data);
+	case ImageFormat::WebP: return LocateInWebp(data);
+	case ImageFormat::Heif:
+	case ImageFormat::Avif: return LocateInIsobmff(data);
+	case ImageFormat::JpegXl: return LocateInJpegXl(data);
+	default: return {};
+	}
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+#include "FormatProbe.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// C2PAのマニフェストストア（ラベルが c2pa のJUMBFスーパーボックス）を探す
+// C2PAライブラリを使わずに、コンテナの見出しだけを辿る
+//   PNG   caBXチャンク
+//   JPEG  APP11セグメント（"JP" + JUMBF、複数セグメントに分かれる場合は先頭）
+//   WebP  C2PAチャンク
+//   HEIF/AVIF  C2PAのuuidボックス
+//   JPEG XL    jumbボックス
+
+// 自前で探せる形式か（それ以外の形式は有無を判定できない）
+bool can_locate_c2pa_store(ImageFormat format);
+
+// マニフェストストアのJUMBFボックス（見つからなければ空）
+std::span<const uint8_t> locate_c2pa_store(std::span<const uint8_t> data, ImageFormat format);
+
+// JUMBFボックスが C2PA のマニフェストストアか（先頭の記述ボックスの種類で判定する）
+bool is_c2pa_jumbf(std::span<const uint8_t> box);
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// 処理の取り消し（別のスレッドから Cancel() する）と時間制限
+// 抽出処理は CancellationToken::Current() を長いループの途中で確かめて打ち切る
+class CancellationToken {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// 取り消されることの無いトークン
+	CancellationToken() = default;
+
+	// 取り消せるトークン（コピーしたものは同じ状態を共有する）
+	static CancellationToken Create() {
+		CancellationToken token;
+		token.m_flag = std::make_shared<std::atomic<bool>>(false);
+		return token;
+	}
+
+	void Cancel() const {
+		if (m_flag) m_flag->store(true, std::memory_order_relaxed);
+	}
+	bool CanCancel() const { return m_flag != nullptr; }
+	bool IsCancelled() const {
+		return m_flag && m_flag->load(std::memory_order_relaxed);
+	}
+
+	// 期限を付けたトークン（取り消しは元のトークンと共有する）
+	CancellationToken WithDeadline(Clock::time_point deadline) const {
+		CancellationToken token = *this;
+		token.m_deadline = deadline;
+		return token;
+	}
+	bool Expired() const {
+		return m_deadline != Clock::time_point::max() && Clock::now() >= m_deadline;
+	}
+
+	// 打ち切るべきか（取り消された・期限を過ぎた）
+	bool ShouldStop() const { return IsCancelled() || Expired(); }
+
+	// このスレッドで実行中の処理のトークン
+	static const CancellationToken& Current() {
+		static const CancellationToken none;
+		return s_current ? *s_current : none;
+	}
+
+	// ブロックの間 Current() を差し替える
+	class Scope {
+	public:
+		explicit Scope(const CancellationToken& token) : m_outer(s_current) { s_current = &token; }
+		~Scope() { s_current = m_outer; }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const CancellationToken* m_outer;
+	};
+
+private:
+	std::shared_ptr<std::atomic<bool>> m_flag;
+	Clock::time_point m_deadline = Clock::time_point::max();
+	static inline thread_local const CancellationToken* s_current = nullptr;
+};
@@ -0,0 +1,391 @@
+﻿#include "framework.h"
+#include "CommandLine.h"
+#include "BatchInspector.h"
+#include "BenchCorpus.h"
+#include "Benchmark.h"
+#include "ResultWriter.h"
+#include "Inflater.h"
+#include "ResultCache.h"
+#include "TextIndex.h"
+#include "FolderWatcher.h"
+#include "InspectionPipeline.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "TextUtils.h"
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static const char* USAGE =
+	"usage: PhantomView --batch [options] <file|directory|->...\n"
+	"  -j <threads>           worker threads (default: number of cores)\n"
+	"  --max-in-flight <n>    results held in memory at once (default: threads x 4)\n"
+	"  -o <file>              write results to file (default: stdout)\n"
+	"  --format <fmt>         text (default), ansi, html, jsonl or arrow\n"
+	"  --inflate-limit <MB>   maximum size of a decompressed metadata value (default: 256)\n"
+	"  --key <name>           only report this metadata key (repeatable)\n"
+	"  --budget <ms>          give up on an extractor that runs longer than this for one file\n"
+	"  --cache                reuse results from the on-disk cache\n"
+	"  --cache-dir <dir>      cache location (implies --cache)\n"
+	"  --cache-hash           key the cache by file content instead of file identity\n"
+	"  --trace <file>         write a Chrome trace (chrome://tracing, Perfetto) of every stage\n"
+	"  --stats                print per-stage latency percentiles to stderr when done\n"
+	"       PhantomView --watch [options] <directory>...\n"
+	"  --debounce <ms>        wait this long after the last write before inspecting (default: 500)\n"
+	"       PhantomView --index <index-dir> [options] <file|directory|->...\n"
+	"       PhantomView --query <index-dir> <word | \"phrase\" | prefix*>...\n"
+	"       PhantomView --bench [options]\n"
+	"  --suite <name>         lsb, utf or extract (default: all)\n"
+	"  --csv                  write results as CSV\n"
+	"  --max-nai <px>         skip NovelAI images larger than this (default: 7680)\n"
+	"  --write-corpus <dir>   write the synthetic corpus to a directory and exit\n";
+
+#ifdef _WIN32
+// 標準出力・標準エラー出力（GUIアプリとして起動された場合は親のコンソールに繋ぐ）
+static FILE* OpenConsole(DWORD stdHandle) {
+	HANDLE handle = GetStdHandle(stdHandle);
+	if (!handle || handle == INVALID_HANDLE_VALUE) {
+		// 既に繋いでいる場合は ERROR_ACCESS_DENIED になる
+		if (!AttachConsole(ATTACH_PARENT_PROCESS) && GetLastError() != ERROR_ACCESS_DENIED) return nullptr;
+		handle = GetStdHandle(stdHandle);
+		if (!handle || handle == INVALID_HANDLE_VALUE) return nullptr;
+	}
+	SetConsoleOutputCP(CP_UTF8);
+	int fd = _open_osfhandle(reinterpret_cast<intptr_t>(handle), _O_WRONLY | _O_BINARY);
+	return fd < 0 ? nullptr : _fdopen(fd, "wb");
+}
+#endif
+
+static FILE* OpenStdout() {
+#ifdef _WIN32
+	return OpenConsole(STD_OUTPUT_HANDLE);
+#else
+	return stdout;
+#endif
+}
+
+static FILE* OpenStderr() {
+#ifdef _WIN32
+	return OpenConsole(STD_ERROR_HANDLE);
+#else
+	return stderr;
+#endif
+}
+
+static FILE* OpenOutput(const std::wstring& path) {
+	if (path.empty() || path == L"-") return OpenStdout();
+#ifdef _WIN32
+	return _wfopen(path.c_str(), L"wb");
+#else
+	return fopen(unicode_to_utf8(path).c_str(), "wb");
+#endif
+}
+
+static void PrintUsage() {
+	if (FILE* out = OpenStdout()) {
+		fputs(USAGE, out);
+		fflush(out);
+	}
+}
+
+bool IsCommandLineMode(const std::vector<std::wstring>& args) {
+	return !args.empty() && args[0].starts_with(L"--");
+}
+
+// バッチ・索引モードで共通の引数
+struct BatchArgs {
+	BatchOptions options;
+	std::wstring outputPath;
+	OutputFormat format = OutputFormat::Text;
+	bool useCache = false;
+	bool cacheByContent = false;
+	std::wstring cacheDirectory;
+	std::unique_ptr<ResultCache> cache;
+	unsigned long debounce = 500;	// 監視モードの待ち時間（ミリ秒）
+	std::wstring tracePath;			// Chrome のトレースの出力先
+	bool traceStats = false;		// 段階ごとの所要時間を最後に出力する
+};
+
+// first 番目以降の引数を読む（不正な引数があれば false）
+static bool ParseBatchArgs(const std::vector<std::wstring>& args, size_t first, BatchArgs& parsed) {
+	auto& options = parsed.options;
+	for (size_t i = first; i < args.size(); ++i) {
+		const auto& arg = args[i];
+		bool hasValue = i + 1 < args.size();
+		if (arg == L"-j" && hasValue) {
+			options.threads = std::stoul(args[++i]);
+		} else if (arg == L"--max-in-flight" && hasValue) {
+			options.maxInFlight = std::stoul(args[++i]);
+		} else if (arg == L"--inflate-limit" && hasValue) {
+			// unsigned long は Windows では32ビットなので、64ビットで読んで size_t に収まるか確かめる
+			uint64_t megabytes = std::stoull(args[++i]);
+			if (megabytes > SIZE_MAX / (1024 * 1024)) return false;
+			Inflater::SetDefaultLimit(static_cast<size_t>(megabytes) * 1024 * 1024);
+		} else if (arg == L"--key" && hasValue) {
+			options.inspect.keys.push_back(args[++i]);
+		} else if (arg == L"--budget" && hasValue) {
+			options.inspect.budget = std::chrono::milliseconds(std::stoul(args[++i]));
+		} else if (arg == L"--cache") {
+			parsed.useCache = true;
+		} else if (arg == L"--cache-hash") {
+			parsed.useCache = true;
+			parsed.cacheByContent = true;
+		} else if (arg == L"--cache-dir" && hasValue) {
+			parsed.useCache = true;
+			parsed.cacheDirectory = args[++i];
+		} else if (arg == L"--format" && hasValue) {
+			const auto& name = args[++i];
+			if (name == L"ansi") parsed.format = OutputFormat::Ansi;
+			else if (name == L"html") parsed.format = OutputFormat::Html;
+			else if (name == L"jsonl") parsed.format = OutputFormat::JsonLines;
+			else if (name == L"arrow") parsed.format = OutputFormat::Arrow;
+			else if (name != L"text") return false;
+		} else if (arg == L"--trace" && hasValue) {
+			parsed.tracePath = args[++i];
+		} else if (arg == L"--stats") {
+			parsed.traceStats = true;
+		} else if (arg == L"--debounce" && hasValue) {
+			parsed.debounce = std::stoul(args[++i]);
+		} else if (arg == L"-o" && hasValue) {
+			parsed.outputPath = args[++i];
+		} else if (arg.starts_with(L"-") && arg != L"-") {
+			return false;
+		} else {
+			options.inputs.push_back(arg);
+		}
+	}
+	if (options.inputs.empty()) return false;
+
+	// キャッシュが開けなければ使わずに続ける
+	if (parsed.useCache) {
+		parsed.cache = ResultCache::Open(parsed.cacheDirectory.empty() ? ResultCache::DefaultDirectory() : parsed.cacheDirectory, parsed.cacheByContent);
+		options.inspect.cache = parsed.cache.get();
+	}
+	if (!parsed.tracePath.empty() || parsed.traceStats) Trace::Enable(!parsed.tracePath.empty());
+	return true;
+}
+
+// 計測結果を書き出す
+static bool FinishTrace(const BatchArgs& parsed) {
+	bool ok = true;
+	if (!parsed.tracePath.empty()) {
+#ifdef _WIN32
+		FILE* out = _wfopen(parsed.tracePath.c_str(), L"wb");
+#else
+		FILE* out = fopen(unicode_to_utf8(parsed.tracePath).c_str(), "wb");
+#endif
+		ok = out && Trace::WriteChromeTrace(out);
+		if (out) fclose(out);
+	}
+	if (parsed.traceStats) {
+		if (FILE* err = OpenStderr()) {
+			fputs(Trace::Summary().c_str(), err);
+			fflush(err);
+		}
+	}
+	return ok;
+}
+
+// バッチモード
+static int RunBatch(const std::vector<std::wstring>& args) {
+	BatchArgs parsed;
+	if (!ParseBatchArgs(args, 1, parsed)) {
+		PrintUsage();
+		return 2;
+	}
+
+	const auto& outputPath = parsed.outputPath;
+	FILE* out = OpenOutput(outputPath);
+	if (!out) return 1;
+
+	auto writer = create_result_writer(out, parsed.format);
+	BatchInspector batch(parsed.options);
+	batch.Run([&](const InspectionResult& result) { writer->Write(result); });
+	writer->Finish();
+
+	if (!outputPath.empty() && outputPath != L"-") fclose(out);
+	return FinishTrace(parsed) ? 0 : 1;
+}
+
+// 監視モード（Ctrl+Cで終了）
+static FolderWatcher* g_watcher = nullptr;
+
+#ifdef _WIN32
+static BOOL WINAPI StopWatching(DWORD) {
+	if (g_watcher) g_watcher->Stop();
+	return TRUE;
+}
+#else
+static void StopWatching(int) {
+	if (g_watcher) g_watcher->Stop();
+}
+#endif
+
+static int RunWatch(const std::vector<std::wstring>& args) {
+	BatchArgs parsed;
+	if (!ParseBatchArgs(args, 1, parsed)) {
+		PrintUsage();
+		return 2;
+	}
+
+	FolderWatcher watcher(parsed.options.inputs, std::chrono::milliseconds(parsed.debounce));
+	if (!watcher.Start()) return 1;
+
+	const auto& outputPath = parsed.outputPath;
+	FILE* out = OpenOutput(outputPath);
+	if (!out) return 1;
+
+	g_watcher = &watcher;
+#ifdef _WIN32
+	SetConsoleCtrlHandler(StopWatching, TRUE);
+#else
+	std::signal(SIGINT, StopWatching);
+	std::signal(SIGTERM, StopWatching);
+#endif
+
+	// 新しいファイルだけを調べ、終わった順に出力する
+	// 調べている間に書き換えられたファイルは、古い内容の抽出を打ち切って調べ直す
+	auto writer = create_result_writer(out, parsed.format);
+	std::mutex outputMutex;
+	{
+		ThreadPool pool(parsed.options.threads);
+		InspectionPipeline pipeline(pool);
+		PipelineCallbacks callbacks;
+		callbacks.onComplete = [&](const InspectionResult& result) {
+			std::lock_guard lock(outputMutex);
+			writer->Write(result);
+			writer->Flush();
+		};
+
+		std::map<std::filesystem::path, std::shared_ptr<InspectionJob>> running;
+		std::vector<std::filesystem::path> ready;
+		while (watcher.Wait(ready)) {
+			std::erase_if(running, [](const auto& entry) {
+				return entry.second->Result().wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			});
+			for (const auto& path : ready) {
+				auto& job = running[path];
+				if (job) job->Cancel();
+				// 削除・名前変更で消えたファイルは出力しない（調べている途中なら打ち切る）
+				std::error_code ec;
+				if (!std::filesystem::exists(path, ec)) {
+					running.erase(path);
+					continue;
+				}
+				job = pipeline.Start(path, parsed.options.inspect, callbacks);
+			}
+		}
+		// 終了時は実行中の抽出を待たずに打ち切る
+		for (auto& [path, job] : running) job->Cancel();
+	}
+	g_watcher = nullptr;
+	writer->Finish();
+
+	if (!outputPath.empty() && outputPath != L"-") fclose(out);
+	return FinishTrace(parsed) ? 0 : 1;
+}
+
+// 索引の作成（既存の索引にはセグメントを追加する）
+static int RunIndex(const std::vector<std::wstring>& args) {
+	BatchArgs parsed;
+	if (args.size() < 2 || !ParseBatchArgs(args, 2, parsed)) {
+		PrintUsage();
+		return 2;
+	}
+
+	// 索引には全てのキーを入れる
+	parsed.options.inspect.keys.clear();
+	TextIndexWriter writer(args[1]);
+	BatchInspector batch(parsed.options);
+	size_t count = batch.Run([&](const InspectionResult& result) { writer.Add(result); });
+	if (!writer.Flush() || !FinishTrace(parsed)) return 1;
+
+	if (FILE* out = OpenStdout()) {
+		fprintf(out, "indexed %zu files\n", count);
+		fflush(out);
+	}
+	return 0;
+}
+
+// 索引の検索
+static int RunQuery(const std::vector<std::wstring>& args) {
+	if (args.size() < 3) {
+		PrintUsage();
+		return 2;
+	}
+	std::wstring query;
+	for (size_t i = 2; i < args.size(); ++i) {
+		if (!query.empty()) query += L' ';
+		query += args[i];
+	}
+
+	FILE* out = OpenStdout();
+	if (!out) return 1;
+	auto index = TextIndex::Open(args[1]);
+	if (!index) return 1;
+	for (const auto& path : index->Query(unicode_to_utf8(query))) {
+		fprintf(out, "%s\n", path_to_utf8(path).c_str());
+	}
+	fflush(out);
+	return 0;
+}
+
+// --bench [options]
+static int RunBench(const std::vector<std::wstring>& args) {
+	BenchmarkOptions options;
+	std::wstring corpusDirectory;
+	for (size_t i = 1; i < args.size(); ++i) {
+		const auto& arg = args[i];
+		bool hasValue = i + 1 < args.size();
+		if (arg == L"--suite" && hasValue) {
+			options.suite = unicode_to_utf8(args[++i]);
+		} else if (arg == L"--csv") {
+			options.csv = true;
+		} else if (arg == L"--max-nai" && hasValue) {
+			options.maxNaiSide = std::stoul(args[++i]);
+		} else if (arg == L"--write-corpus" && hasValue) {
+			corpusDirectory = args[++i];
+		} else {
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (!corpusDirectory.empty()) {
+		return BenchCorpus::Write(BenchCorpus::Generate(20240101, options.maxNaiSide), corpusDirectory) ? 0 : 1;
+	}
+	FILE* out = OpenStdout();
+	return out ? RunBenchmarks(out, options) : 1;
+}
+
+int RunCommandLine(const std::vector<std::wstring>& args) {
+	try {
+		if (!args.empty() && args[0] == L"--batch") return RunBatch(args);
+		if (!args.empty() && args[0] == L"--watch") return RunWatch(args);
+		if (!args.empty() && args[0] == L"--index") return RunIndex(args);
+		if (!args.empty() && args[0] == L"--query") return RunQuery(args);
+		if (!args.empty() && args[0] == L"--bench") return RunBench(args);
+	} catch (const std::exception&) {
+		// 数値の引数が不正な場合など
+	}
+	PrintUsage();
+	return 2;
+}
+
+#ifndef _WIN32
+int main(int argc, char** argv) {
+	std::vector<std::wstring> args;
+	for (int i = 1; i < argc; ++i) {
+		args.push_back(utf8_to_unicode(argv[i]));
+	}
+	return RunCommandLine(args);
+}
+#endif
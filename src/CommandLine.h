@@ -0,0 +1,9 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// コマンドライン引数がヘッドレスモードの指定かどうか
+bool IsCommandLineMode(const std::vector<std::wstring>& args);
+
+// ヘッドレスモードの実行（戻り値は終了コード）
+int RunCommandLine(const std::vector<std::wstring>& args);
@@ -0,0 +1,400 @@
+﻿#include "framework.h"
+#include "ExifReader.h"
+#include "TextUtils.h"
+#include "ByteReader.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+// 値の解釈に使うタグ
+enum ExifTag : uint16_t {
+	TAG_EXIF_IFD = 0x8769,
+	TAG_GPS_IFD = 0x8825,
+	TAG_INTEROP_IFD = 0xA005,
+	TAG_EXPOSURETIME = 0x829A,
+	TAG_USERCOMMENT = 0x9286,
+	TAG_XPTITLE = 0x9C9B,
+	TAG_XPSUBJECT = 0x9C9F,
+};
+
+// EXIFデータ型の定義
+enum ExifDataType : uint16_t {
+	TYPE_BYTE = 1,
+	TYPE_ASCII = 2,
+	TYPE_SHORT = 3,
+	TYPE_LONG = 4,
+	TYPE_RATIONAL = 5,
+	TYPE_SBYTE = 6,
+	TYPE_UNDEFINED = 7,
+	TYPE_SSHORT = 8,
+	TYPE_SLONG = 9,
+	TYPE_SRATIONAL = 10,
+	TYPE_FLOAT = 11,
+	TYPE_DOUBLE = 12,
+	TYPE_IFD = 13,
+};
+
+// 辿るIFDの上限（壊れたファイルや循環参照への対策）
+static constexpr size_t MAX_IFDS = 32;
+static constexpr uint16_t MAX_ENTRIES_PER_IFD = 1000;
+
+// 複数個の値を表示する上限
+static constexpr uint32_t MAX_LISTED_VALUES = 64;
+
+static constexpr size_t TypeSize(uint16_t type) {
+	switch (type) {
+	case TYPE_BYTE: case TYPE_ASCII: case TYPE_SBYTE: case TYPE_UNDEFINED: return 1;
+	case TYPE_SHORT: case TYPE_SSHORT: return 2;
+	case TYPE_LONG: case TYPE_SLONG: case TYPE_FLOAT: case TYPE_IFD: return 4;
+	case TYPE_RATIONAL: case TYPE_SRATIONAL: case TYPE_DOUBLE: return 8;
+	default: return 0;
+	}
+}
+
+// タグ名の表（グループ・タグ番号の順に並べておき、二分探索で引く）
+struct ExifTagName {
+	ExifGroup group;
+	uint16_t tag;
+	const wchar_t* name;
+};
+
+static constexpr ExifTagName TAG_NAMES[] = {
+	{ExifGroup::Tiff, 0x010E, L"画像の説明"},
+	{ExifGroup::Tiff, 0x010F, L"メーカー"},
+	{ExifGroup::Tiff, 0x0110, L"モデル"},
+	{ExifGroup::Tiff, 0x0112, L"画像の向き"},
+	{ExifGroup::Tiff, 0x011A, L"水平解像度"},
+	{ExifGroup::Tiff, 0x011B, L"垂直解像度"},
+	{ExifGroup::Tiff, 0x0128, L"解像度の単位"},
+	{ExifGroup::Tiff, 0x0131, L"ソフトウェア"},
+	{ExifGroup::Tiff, 0x0132, L"撮影日時"},
+	{ExifGroup::Tiff, 0x013B, L"アーティスト"},
+	{ExifGroup::Tiff, 0x0213, L"YCbCr配置"},
+	{ExifGroup::Tiff, 0x8298, L"著作権"},
+	{ExifGroup::Tiff, 0x829A, L"露出時間"},
+	{ExifGroup::Tiff, 0x829D, L"F値"},
+	{ExifGroup::Tiff, 0x8822, L"露出プログラム"},
+	{ExifGroup::Tiff, 0x8827, L"ISO感度"},
+	{ExifGroup::Tiff, 0x8830, L"感度種別"},
+	{ExifGroup::Tiff, 0x9000, L"Exifバージョン"},
+	{ExifGroup::Tiff, 0x9003, L"原画像の生成日時"},
+	{ExifGroup::Tiff, 0x9004, L"デジタル化日時"},
+	{ExifGroup::Tiff, 0x9010, L"タイムゾーン"},
+	{ExifGroup::Tiff, 0x9011, L"原画像のタイムゾーン"},
+	{ExifGroup::Tiff, 0x9201, L"シャッタースピード"},
+	{ExifGroup::Tiff, 0x9202, L"絞り値"},
+	{ExifGroup::Tiff, 0x9204, L"露出補正"},
+	{ExifGroup::Tiff, 0x9205, L"開放F値"},
+	{ExifGroup::Tiff, 0x9207, L"測光方式"},
+	{ExifGroup::Tiff, 0x9208, L"光源"},
+	{ExifGroup::Tiff, 0x9209, L"フラッシュ"},
+	{ExifGroup::Tiff, 0x920A, L"焦点距離"},
+	{ExifGroup::Tiff, 0x927C, L"メーカーノート"},
+	{ExifGroup::Tiff, 0x9286, L"ユーザーコメント"},
+	{ExifGroup::Tiff, 0x9290, L"日時の秒以下"},
+	{ExifGroup::Tiff, 0x9291, L"原画像の日時の秒以下"},
+	{ExifGroup::Tiff, 0x9C9B, L"タイトル"},
+	{ExifGroup::Tiff, 0x9C9C, L"コメント"},
+	{ExifGroup::Tiff, 0x9C9D, L"作成者"},
+	{ExifGroup::Tiff, 0x9C9E, L"キーワード"},
+	{ExifGroup::Tiff, 0x9C9F, L"件名"},
+	{ExifGroup::Tiff, 0xA000, L"Flashpixバージョン"},
+	{ExifGroup::Tiff, 0xA001, L"色空間"},
+	{ExifGroup::Tiff, 0xA002, L"画像の幅"},
+	{ExifGroup::Tiff, 0xA003, L"画像の高さ"},
+	{ExifGroup::Tiff, 0xA402, L"露出モード"},
+	{ExifGroup::Tiff, 0xA403, L"ホワイトバランス"},
+	{ExifGroup::Tiff, 0xA405, L"35mm換算焦点距離"},
+	{ExifGroup::Tiff, 0xA406, L"撮影シーンタイプ"},
+	{ExifGroup::Tiff, 0xA420, L"画像ユニークID"},
+	{ExifGroup::Tiff, 0xA430, L"カメラ所有者名"},
+	{ExifGroup::Tiff, 0xA431, L"カメラのシリアル番号"},
+	{ExifGroup::Tiff, 0xA432, L"レンズの仕様"},
+	{ExifGroup::Tiff, 0xA433, L"レンズのメーカー"},
+	{ExifGroup::Tiff, 0xA434, L"レンズのモデル"},
+	{ExifGroup::Gps, 0x0000, L"GPSバージョン"},
+	{ExifGroup::Gps, 0x0001, L"北緯・南緯"},
+	{ExifGroup::Gps, 0x0002, L"緯度"},
+	{ExifGroup::Gps, 0x0003, L"東経・西経"},
+	{ExifGroup::Gps, 0x0004, L"経度"},
+	{ExifGroup::Gps, 0x0005, L"高度の基準"},
+	{ExifGroup::Gps, 0x0006, L"高度"},
+	{ExifGroup::Gps, 0x0007, L"GPS時刻"},
+	{ExifGroup::Gps, 0x0012, L"測地系"},
+	{ExifGroup::Gps, 0x001D, L"GPS日付"},
+	{ExifGroup::Interop, 0x0001, L"互換性インデックス"},
+	{ExifGroup::Interop, 0x0002, L"互換性バージョン"},
+};
+
+static constexpr bool TagLess(const ExifTagName& a, const ExifTagName& b) {
+	return a.group != b.group ? a.group < b.group : a.tag < b.tag;
+}
+static_assert(std::is_sorted(std::begin(TAG_NAMES), std::end(TAG_NAMES), TagLess), "TAG_NAMES must be sorted");
+
+// バイトオーダーごとの読み出し
+template <bool LittleEndian>
+struct ExifBytes {
+	static uint16_t U16(const uint8_t* p) { return LittleEndian ? read_le16(p) : read_be16(p); }
+	static uint32_t U32(const uint8_t* p) { return LittleEndian ? read_le32(p) : read_be32(p); }
+};
+
+// UTF-16をワイド文字列に追加する
+template <bool LittleEndian>
+static void AppendUtf16(std::wstring& out, std::span<const uint8_t> data) {
+	for (size_t i = 0; i + 1 < data.size(); i += 2) {
+		uint32_t unit = ExifBytes<LittleEndian>::U16(&data[i]);
+		if constexpr (sizeof(wchar_t) == 4) {
+			if (unit >= 0xD800 && unit <= 0xDBFF && i + 3 < data.size()) {
+				uint32_t low = ExifBytes<LittleEndian>::U16(&data[i + 2]);
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+					i += 2;
+				}
+			}
+		}
+		out += static_cast<wchar_t>(unit);
+	}
+}
+
+// 末尾のNULL文字と空白を除く
+static void TrimTrailing(std::wstring& text) {
+	while (!text.empty() && (text.back() == L'\0' || text.back() == L' ')) text.pop_back();
+}
+
+static std::wstring FormatDouble(double value) {
+	wchar_t buffer[64];
+	swprintf(buffer, 64, L"%.2f", value);
+	return buffer;
+}
+
+ExifReader::ExifReader(std::span<const uint8_t> tiff) : m_data(tiff) {
+	if (tiff.size() < 8) return;
+
+	// バイトオーダーを判定
+	if (tiff[0] == 'I' && tiff[1] == 'I') m_littleEndian = true;
+	else if (tiff[0] != 'M' || tiff[1] != 'M') return;
+
+	if (m_littleEndian) Walk<true>();
+	else Walk<false>();
+}
+
+template <bool LittleEndian>
+void ExifReader::Walk() {
+	using Bytes = ExifBytes<LittleEndian>;
+	const auto data = m_data;
+
+	// TIFFマジックナンバーを確認
+	if (Bytes::U16(&data[2]) != 0x2A) return;
+	m_valid = true;
+
+	// 辿るIFD（深さ優先、サブIFDは親のIFDの直後に辿る）
+	struct Pending {
+		uint32_t offset;
+		ExifGroup group;
+		uint8_t ifd;
+		bool chain;		// 次のIFD（IFD0→IFD1）を辿るか
+	};
+	std::vector<uint32_t> visited;
+	std::vector<Pending> stack;
+	stack.push_back({Bytes::U32(&data[4]), ExifGroup::Tiff, 0, true});
+
+	while (!stack.empty() && visited.size() < MAX_IFDS) {
+		Pending ifd = stack.back();
+		stack.pop_back();
+
+		// 範囲外・循環参照
+		if (ifd.offset < 8 || static_cast<size_t>(ifd.offset) + 2 > data.size()) continue;
+		if (std::find(visited.begin(), visited.end(), ifd.offset) != visited.end()) continue;
+		visited.push_back(ifd.offset);
+
+		uint16_t entryCount = Bytes::U16(&data[ifd.offset]);
+		if (entryCount > MAX_ENTRIES_PER_IFD) continue; // 異常値
+		size_t entriesEnd = static_cast<size_t>(ifd.offset) + 2 + entryCount * 12;
+
+		// 次のIFDは、このIFDのサブIFDより後に辿る
+		if (ifd.chain && entriesEnd + 4 <= data.size()) {
+			uint32_t next = Bytes::U32(&data[entriesEnd]);
+			if (next) stack.push_back({next, ifd.group, static_cast<uint8_t>(ifd.ifd + 1), true});
+		}
+
+		std::vector<Pending> children;
+		for (uint16_t i = 0; i < entryCount; ++i) {
+			size_t entryOffset = static_cast<size_t>(ifd.offset) + 2 + i * 12;
+			if (entryOffset + 12 > data.size()) break;
+
+			ExifEntry entry;
+			entry.group = ifd.group;
+			entry.ifd = ifd.ifd;
+			entry.tag = Bytes::U16(&data[entryOffset]);
+			entry.type = Bytes::U16(&data[entryOffset + 2]);
+			entry.count = Bytes::U32(&data[entryOffset + 4]);
+
+			size_t typeSize = TypeSize(entry.type);
+			if (typeSize == 0) continue;
+
+			// 4バイト以内ならエントリ内、超える場合はオフセット
+			uint64_t byteCount = static_cast<uint64_t>(entry.count) * typeSize;
+			entry.valueOffset = byteCount <= 4 ? static_cast<uint32_t>(entryOffset + 8) : Bytes::U32(&data[entryOffset + 8]);
+			if (entry.valueOffset + byteCount > data.size()) continue;
+
+			// サブIFD
+			if (ifd.group == ExifGroup::Tiff && (entry.tag == TAG_EXIF_IFD || entry.tag == TAG_GPS_IFD || entry.tag == TAG_INTEROP_IFD)) {
+				if (entry.type == TYPE_LONG || entry.type == TYPE_IFD) {
+					ExifGroup group = entry.tag == TAG_GPS_IFD ? ExifGroup::Gps :
+						entry.tag == TAG_INTEROP_IFD ? ExifGroup::Interop : ExifGroup::Tiff;
+					children.push_back({Bytes::U32(&data[entry.valueOffset]), group, ifd.ifd, false});
+				}
+				continue;
+			}
+			m_entries.push_back(entry);
+		}
+
+		// 見つけた順に辿るため逆順に積む
+		stack.insert(stack.end(), children.rbegin(), children.rend());
+	}
+}
+
+const ExifEntry* ExifReader::Find(ExifGroup group, uint16_t tag) const {
+	for (const auto& entry : m_entries) {
+		if (entry.group == group && entry.tag == tag) return &entry;
+	}
+	return nullptr;
+}
+
+std::wstring ExifReader::TagName(const ExifEntry& entry) {
+	ExifTagName key{entry.group, entry.tag, nullptr};
+	auto it = std::lower_bound(std::begin(TAG_NAMES), std::end(TAG_NAMES), key, TagLess);
+	std::wstring name;
+	if (entry.ifd > 0) name = L"サムネイル";
+	if (it != std::end(TAG_NAMES) && it->group == entry.group && it->tag == entry.tag) {
+		return name + it->name;
+	}
+	switch (entry.group) {
+	case ExifGroup::Gps: return name + L"GPSタグ" + std::to_wstring(entry.tag);
+	case ExifGroup::Interop: return name + L"互換性タグ" + std::to_wstring(entry.tag);
+	default: return name + L"タグ" + std::to_wstring(entry.tag);
+	}
+}
+
+std::wstring ExifReader::Format(const ExifEntry& entry) const {
+	return m_littleEndian ? FormatValue<true>(entry) : FormatValue<false>(entry);
+}
+
+template <bool LittleEndian>
+std::wstring ExifReader::FormatValue(const ExifEntry& entry) const {
+	using Bytes = ExifBytes<LittleEndian>;
+	auto value = m_data.subspan(entry.valueOffset, entry.count * TypeSize(entry.type));
+	std::wstring result;
+
+	// 文字列として扱うもの
+	if (entry.type == TYPE_ASCII) {
+		std::string_view str(reinterpret_cast<const char*>(value.data()), value.size());
+		result = utf8_to_unicode(str);
+		TrimTrailing(result);
+		return result;
+	}
+	if (entry.group == ExifGroup::Tiff && entry.tag == TAG_USERCOMMENT && value.size() >= 8) {
+		// 先頭8バイトが文字コード
+		auto text = value.subspan(8);
+		if (memcmp(value.data(), "UNICODE\0", 8) == 0) {
+			AppendUtf16<LittleEndian>(result, text);
+		} else {
+			result = utf8_to_unicode(std::string_view(reinterpret_cast<const char*>(text.data()), text.size()));
+		}
+		TrimTrailing(result);
+		return result;
+	}
+	if (entry.group == ExifGroup::Tiff && entry.tag >= TAG_XPTITLE && entry.tag <= TAG_XPSUBJECT && entry.type == TYPE_BYTE) {
+		// Windowsのプロパティ（常にUTF-16LE）
+		AppendUtf16<true>(result, value);
+		TrimTrailing(result);
+		return result;
+	}
+	if (entry.type == TYPE_UNDEFINED && entry.count > 4) {
+		// メーカーノートなどのバイナリは表示しない
+		return result;
+	}
+
+	// 数値（複数個なら空白区切り）
+	uint32_t count = std::min(entry.count, MAX_LISTED_VALUES);
+	size_t size = TypeSize(entry.type);
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint8_t* p = &value[i * size];
+		std::wstring item;
+		switch (entry.type) {
+		case TYPE_BYTE:
+		case TYPE_UNDEFINED:
+			item = std::to_wstring(*p);
+			break;
+		case TYPE_SBYTE:
+			item = std::to_wstring(static_cast<int8_t>(*p));
+			break;
+		case TYPE_SHORT:
+			item = std::to_wstring(Bytes::U16(p));
+			break;
+		case TYPE_SSHORT:
+			item = std::to_wstring(static_cast<int16_t>(Bytes::U16(p)));
+			break;
+		case TYPE_LONG:
+		case TYPE_IFD:
+			item = std::to_wstring(Bytes::U32(p));
+			break;
+		case TYPE_SLONG:
+			item = std::to_wstring(static_cast<int32_t>(Bytes::U32(p)));
+			break;
+		case TYPE_RATIONAL: {
+			uint32_t numerator = Bytes::U32(p);
+			uint32_t denominator = Bytes::U32(p + 4);
+			if (denominator == 0) break;
+			// 露出時間は 1/125 のように分数で表示する
+			if (entry.tag == TAG_EXPOSURETIME && numerator > 0 && numerator < denominator) {
+				item = L"1/" + FormatDouble(static_cast<double>(denominator) / numerator);
+				while (item.back() == L'0') item.pop_back();
+				if (item.back() == L'.') item.pop_back();
+			} else {
+				item = FormatDouble(static_cast<double>(numerator) / denominator);
+			}
+			break;
+		}
+		case TYPE_SRATIONAL: {
+			int32_t numerator = static_cast<int32_t>(Bytes::U32(p));
+			int32_t denominator = static_cast<int32_t>(Bytes::U32(p + 4));
+			if (denominator == 0) break;
+			item = FormatDouble(static_cast<double>(numerator) / denominator);
+			break;
+		}
+		case TYPE_FLOAT: {
+			uint32_t bits = Bytes::U32(p);
+			float f;
+			memcpy(&f, &bits, sizeof(f));
+			item = FormatDouble(f);
+			break;
+		}
+		case TYPE_DOUBLE: {
+			uint64_t bits = (static_cast<uint64_t>(Bytes::U32(LittleEndian ? p + 4 : p)) << 32) | Bytes::U32(LittleEndian ? p : p + 4);
+			double d;
+			memcpy(&d, &bits, sizeof(d));
+			item = FormatDouble(d);
+			break;
+		}
+		}
+		if (item.empty()) continue;
+		if (!result.empty()) result += L" ";
+		result += item;
+	}
+	if (entry.count > count) result += L" …";
+	return result;
+}
+
+MetaList ExifReader::ToList(uint64_t base) const {
+	MetaList list;
+	for (const auto& entry : m_entries) {
+		std::wstring value = Format(entry);
+		if (!value.empty()) {
+			uint64_t offset = base == MetaEntry::NO_OFFSET ? base : base + entry.valueOffset;
+			list.Add(TagName(entry), value, MetaType::Text, offset);
+		}
+	}
+	return list;
+}
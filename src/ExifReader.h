@@ -0,0 +1,55 @@
+﻿#pragma once
+#include "MetaList.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// タグ番号の空間（GPSと互換性IFDは番号が重なるので分ける）
+enum class ExifGroup : uint8_t {
+	Tiff,		// IFD0・IFD1・Exif IFD
+	Gps,
+	Interop,
+};
+
+// IFDのエントリ（値はまだ解釈しない）
+struct ExifEntry {
+	ExifGroup group;
+	uint8_t ifd;			// 0: 主画像、1: サムネイル（サブIFDは親の番号を引き継ぐ）
+	uint16_t tag;
+	uint16_t type;
+	uint32_t count;
+	uint32_t valueOffset;	// 値の位置（TIFFヘッダーの先頭から、4バイト以内ならエントリ内）
+};
+
+// EXIF（TIFF構造）の読み取り
+// IFD0→IFD1の連鎖とExif・GPS・互換性のサブIFDを辿り、エントリの位置だけを集める
+// 値の解釈（複数個の値や有理数の整形）は Format() を呼んだときに行う
+class ExifReader {
+public:
+	explicit ExifReader(std::span<const uint8_t> tiff);
+
+	bool Valid() const { return m_valid; }
+	const std::vector<ExifEntry>& Entries() const { return m_entries; }
+	const ExifEntry* Find(ExifGroup group, uint16_t tag) const;
+
+	// 表示名と値
+	static std::wstring TagName(const ExifEntry& entry);
+	std::wstring Format(const ExifEntry& entry) const;
+
+	// 値が空でないエントリを全て整形する（base はTIFFヘッダーのファイル内の位置）
+	MetaList ToList(uint64_t base = MetaEntry::NO_OFFSET) const;
+
+	// TIFFヘッダーから始まるEXIFデータを読む
+	static MetaList Read(std::span<const uint8_t> tiff, uint64_t base = MetaEntry::NO_OFFSET) { return ExifReader(tiff).ToList(base); }
+
+private:
+	template <bool LittleEndian> void Walk();
+	template <bool LittleEndian> std::wstring FormatValue(const ExifEntry& entry) const;
+
+	std::span<const uint8_t> m_data;
+	std::vector<ExifEntry> m_entries;
+	bool m_littleEndian = false;
+	bool m_valid = false;
+};
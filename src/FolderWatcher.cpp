@@ -0,0 +1,236 @@
+﻿#include "framework.h"
+#include "FolderWatcher.h"
+#include <algorithm>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::FolderWatcher(std::vector<std::filesystem::path> roots, std::chrono::milliseconds debounce)
+	: m_roots(std::move(roots)), m_debounce(debounce), m_lastDrain(std::filesystem::file_time_type::clock::now()) {
+}
+
+FolderWatcher::~FolderWatcher() {
+#ifdef _WIN32
+	for (auto& directory : m_directories) {
+		if (directory->handle != INVALID_HANDLE_VALUE) {
+			CancelIoEx(directory->handle, &directory->overlapped);
+			DWORD bytes;
+			GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, TRUE);
+			CloseHandle(directory->handle);
+		}
+		if (directory->overlapped.hEvent) CloseHandle(directory->overlapped.hEvent);
+	}
+	if (m_stopEvent) CloseHandle(m_stopEvent);
+#else
+	if (m_inotify >= 0) close(m_inotify);
+	if (m_stopFd >= 0) close(m_stopFd);
+#endif
+}
+
+// イベントがあったファイル（落ち着くまで待つ）
+void FolderWatcher::Touch(const std::filesystem::path& path) {
+	m_pending[path] = Clock::now();
+}
+
+// ディレクトリ内のファイルを拾う（onlyRecent なら最後に取り出した時刻より後に更新されたものだけ）
+void FolderWatcher::TouchTree(const std::filesystem::path& directory, bool onlyRecent) {
+	std::error_code ec;
+	for (std::filesystem::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		std::error_code statError;
+		if (!it->is_regular_file(statError)) continue;
+		if (onlyRecent && it->last_write_time(statError) < m_lastDrain) continue;
+		Touch(it->path());
+	}
+}
+
+// 最後のイベントから debounce 経ったファイルを取り出す
+bool FolderWatcher::TakeReady(std::vector<std::filesystem::path>& ready) {
+	auto now = Clock::now();
+	for (auto it = m_pending.begin(); it != m_pending.end();) {
+		if (now - it->second >= m_debounce) {
+			std::error_code ec;
+			if (std::filesystem::is_regular_file(it->first, ec)) ready.push_back(it->first);
+			it = m_pending.erase(it);
+		} else {
+			++it;
+		}
+	}
+	if (!ready.empty()) m_lastDrain = std::filesystem::file_time_type::clock::now() - m_debounce;
+	return !ready.empty();
+}
+
+// 次に落ち着くファイルまでの待ち時間（ミリ秒、無ければ -1）
+int FolderWatcher::WaitTimeout() const {
+	if (m_pending.empty()) return -1;
+	auto earliest = std::min_element(m_pending.begin(), m_pending.end(),
+		[](const auto& a, const auto& b) { return a.second < b.second; })->second;
+	auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(earliest + m_debounce - Clock::now());
+	return static_cast<int>(std::max<int64_t>(remaining.count(), 0)) + 1;
+}
+
+#ifdef _WIN32
+
+bool FolderWatcher::Start() {
+	m_stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	if (!m_stopEvent) return false;
+
+	for (const auto& root : m_roots) {
+		auto directory = std::make_unique<Directory>();
+		directory->root = root;
+		directory->handle = CreateFileW(root.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (directory->handle == INVALID_HANDLE_VALUE) return false;
+		directory->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		directory->buffer.resize(64 * 1024);
+		if (!directory->overlapped.hEvent || !Arm(*directory)) return false;
+		m_directories.push_back(std::move(directory));
+	}
+	return !m_directories.empty();
+}
+
+// 次の変更通知を要求する
+bool FolderWatcher::Arm(Directory& directory) {
+	ResetEvent(directory.overlapped.hEvent);
+	return ReadDirectoryChangesW(directory.handle, directory.buffer.data(), static_cast<DWORD>(directory.buffer.size()), TRUE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+		nullptr, &directory.overlapped, nullptr) != FALSE;
+}
+
+bool FolderWatcher::Wait(std::vector<std::filesystem::path>& ready) {
+	ready.clear();
+	std::vector<HANDLE> handles{m_stopEvent};
+	for (const auto& directory : m_directories) handles.push_back(directory->overlapped.hEvent);
+
+	for (;;) {
+		if (TakeReady(ready)) return true;
+
+		int timeout = WaitTimeout();
+		DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+			timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
+		if (result == WAIT_OBJECT_0) return false;
+		if (result == WAIT_TIMEOUT) continue;
+		if (result < WAIT_OBJECT_0 + 1 || result >= WAIT_OBJECT_0 + handles.size()) return false;
+
+		Directory& directory = *m_directories[result - WAIT_OBJECT_0 - 1];
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE)) return false;
+
+		if (bytes == 0) {
+			// 通知が多すぎてバッファーがあふれた
+			TouchTree(directory.root, true);
+		} else {
+			size_t offset = 0;
+			for (;;) {
+				auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(directory.buffer.data() + offset);
+				if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED ||
+					info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+					std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+					auto path = directory.root / name;
+					std::error_code ec;
+					if (std::filesystem::is_directory(path, ec)) {
+						// 移動してきたディレクトリの中身
+						if (info->Action != FILE_ACTION_MODIFIED) TouchTree(path, false);
+					} else {
+						Touch(path);
+					}
+				}
+				if (!info->NextEntryOffset) break;
+				offset += info->NextEntryOffset;
+			}
+		}
+		if (!Arm(directory)) return false;
+	}
+}
+
+void FolderWatcher::Stop() {
+	if (m_stopEvent) SetEvent(m_stopEvent);
+}
+
+#else
+
+bool FolderWatcher::Start() {
+	m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_inotify < 0 || m_stopFd < 0) return false;
+	for (const auto& root : m_roots) AddWatch(root);
+	return !m_watches.empty();
+}
+
+// ディレクトリとその下の全てのディレクトリを監視する（シンボリックリンクは辿らない）
+void FolderWatcher::AddWatch(const std::filesystem::path& directory) {
+	constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_ONLYDIR;
+	int wd = inotify_add_watch(m_inotify, directory.c_str(), mask);
+	if (wd < 0) return;
+	m_watches[wd] = directory;
+
+	std::error_code ec;
+	for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		std::error_code statError;
+		if (it->is_directory(statError) && !it->is_symlink(statError)) AddWatch(it->path());
+	}
+}
+
+void FolderWatcher::ReadEvents() {
+	alignas(inotify_event) char buffer[64 * 1024];
+	for (;;) {
+		ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length <= 0) return;
+
+		for (ssize_t offset = 0; offset < length;) {
+			auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// イベントを取りこぼしたので、最後に取り出した後に更新されたファイルを拾い直す
+				for (const auto& root : m_roots) TouchTree(root, true);
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				m_watches.erase(event->wd);
+				continue;
+			}
+			auto it = m_watches.find(event->wd);
+			if (it == m_watches.end() || event->len == 0) continue;
+			auto path = it->second / event->name;
+
+			if (event->mask & IN_ISDIR) {
+				// 新しいディレクトリは監視に加え、監視前に書き込まれたファイルも拾う
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					AddWatch(path);
+					TouchTree(path, false);
+				}
+			} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+				Touch(path);
+			}
+		}
+	}
+}
+
+bool FolderWatcher::Wait(std::vector<std::filesystem::path>& ready) {
+	ready.clear();
+	for (;;) {
+		if (TakeReady(ready)) return true;
+
+		pollfd fds[2] = {{m_inotify, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+		int result = poll(fds, 2, WaitTimeout());
+		if (result < 0 && errno != EINTR) return false;
+		if (fds[1].revents & POLLIN) return false;
+		if (fds[0].revents & POLLIN) ReadEvents();
+	}
+}
+
+void FolderWatcher::Stop() {
+	// シグナルハンドラーから呼ばれても安全な書き込みだけを行う
+	if (m_stopFd >= 0) {
+		uint64_t one = 1;
+		[[maybe_unused]] auto written = write(m_stopFd, &one, sizeof(one));
+	}
+}
+
+#endif
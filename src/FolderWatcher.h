@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// フォルダーを監視して、書き込みが終わった新しいファイル・変更されたファイルを通知する
+// Linuxはinotify（IN_CLOSE_WRITE・IN_MOVED_TO）、WindowsはReadDirectoryChangesWを使う
+// 同じファイルへのイベントが続く間は待ち、debounce の間イベントが無くなってから返す
+class FolderWatcher {
+public:
+	FolderWatcher(std::vector<std::filesystem::path> roots, std::chrono::milliseconds debounce);
+	~FolderWatcher();
+	FolderWatcher(const FolderWatcher&) = delete;
+	FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+	// 監視を始める（サブディレクトリも含む）
+	bool Start();
+
+	// 落ち着いたファイルが出るまで待つ（Stop() されたら false）
+	bool Wait(std::vector<std::filesystem::path>& ready);
+
+	// 別のスレッドやシグナルハンドラーから呼べる
+	void Stop();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	void Touch(const std::filesystem::path& path);
+	void TouchTree(const std::filesystem::path& directory, bool onlyRecent);
+	bool TakeReady(std::vector<std::filesystem::path>& ready);
+	int WaitTimeout() const;
+
+	std::vector<std::filesystem::path> m_roots;
+	std::chrono::milliseconds m_debounce;
+	std::map<std::filesystem::path, Clock::time_point> m_pending;	// 最後にイベントがあった時刻
+	std::filesystem::file_time_type m_lastDrain;	// 取りこぼし時はこれより新しいファイルを拾い直す
+
+#ifdef _WIN32
+	struct Directory {
+		std::filesystem::path root;
+		HANDLE handle = INVALID_HANDLE_VALUE;
+		OVERLAPPED overlapped = {};
+		std::vector<uint8_t> buffer;
+	};
+	bool Arm(Directory& directory);
+	std::vector<std::unique_ptr<Directory>> m_directories;	// OVERLAPPEDのアドレスが動かないように個別に確保する
+	HANDLE m_stopEvent = nullptr;
+#else
+	void AddWatch(const std::filesystem::path& directory);
+	void ReadEvents();
+	int m_inotify = -1;
+	int m_stopFd = -1;
+	std::unordered_map<int, std::filesystem::path> m_watches;	// 監視記述子 → ディレクトリ
+#endif
+};
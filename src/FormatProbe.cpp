@@ -0,0 +1,119 @@
+﻿#include "framework.h"
+#include "FormatProbe.h"
+#include "ByteReader.h"
+#include "C2PAStore.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+static bool StartsWith(std::span<const uint8_t> data, size_t offset, std::string_view magic) {
+	return data.size() >= offset + magic.size() && memcmp(data.data() + offset, magic.data(), magic.size()) == 0;
+}
+
+// ftypのブランド（主ブランドと互換ブランド）から形式を決める
+static ImageFormat SniffIsobmff(std::span<const uint8_t> data) {
+	if (!StartsWith(data, 4, "ftyp") || data.size() < 16) return ImageFormat::Unknown;
+	size_t end = std::min<size_t>(data.size(), read_be32(&data[0]));
+	bool heif = false;
+	for (size_t pos = 8; pos + 4 <= end; pos += (pos == 8) ? 8 : 4) {	// 主ブランドの後ろはマイナーバージョン
+		std::string_view brand(reinterpret_cast<const char*>(&data[pos]), 4);
+		if (brand == "avif" || brand == "avis") return ImageFormat::Avif;
+		if (brand == "heic" || brand == "heix" || brand == "hevc" || brand == "heim" || brand == "heis" ||
+			brand == "hevm" || brand == "hevs" || brand == "mif1" || brand == "msf1") {
+			heif = true;
+		}
+	}
+	return heif ? ImageFormat::Heif : ImageFormat::Unknown;
+}
+
+ImageFormat FormatProbe::Sniff(std::span<const uint8_t> data) {
+	if (StartsWith(data, 0, "\x89PNG\r\n\x1a\n")) return ImageFormat::Png;
+	if (StartsWith(data, 0, "\xFF\xD8\xFF")) return ImageFormat::Jpeg;
+	if (StartsWith(data, 0, "RIFF") && StartsWith(data, 8, "WEBP")) return ImageFormat::WebP;
+	if (StartsWith(data, 0, "GIF87a") || StartsWith(data, 0, "GIF89a")) return ImageFormat::Gif;
+	if (StartsWith(data, 0, "II*\0") || StartsWith(data, 0, "MM\0*")) return ImageFormat::Tiff;
+	if (StartsWith(data, 0, "\xFF\x0A") || StartsWith(data, 0, std::string_view("\0\0\0\x0CJXL \r\n\x87\n", 12))) {
+		return ImageFormat::JpegXl;
+	}
+	if (StartsWith(data, 0, "BM") && data.size() >= 30) return ImageFormat::Bmp;
+	return SniffIsobmff(data);
+}
+
+const char* FormatProbe::MimeType(ImageFormat format) {
+	switch (format) {
+	case ImageFormat::Png: return "image/png";
+	case ImageFormat::Jpeg: return "image/jpeg";
+	case ImageFormat::WebP: return "image/webp";
+	case ImageFormat::Gif: return "image/gif";
+	case ImageFormat::Bmp: return "image/bmp";
+	case ImageFormat::Tiff: return "image/tiff";
+	case ImageFormat::Heif: return "image/heif";
+	case ImageFormat::Avif: return "image/avif";
+	case ImageFormat::JpegXl: return "image/jxl";
+	default: return nullptr;
+	}
+}
+
+// PNG：IHDRの色の種類とtRNS（どちらもIDATより前にある）
+static void ProbePng(std::span<const uint8_t> data, FormatProbe& probe) {
+	probe.alpha = false;
+	for (size_t pos = 8; pos + 8 <= data.size();) {
+		uint32_t length = read_be32(&data[pos]);
+		std::string_view type(reinterpret_cast<const char*>(&data[pos + 4]), 4);
+		if (type == "IHDR" && length >= 13 && pos + 8 + 13 <= data.size()) {
+			uint8_t colorType = data[pos + 8 + 9];
+			if (colorType == 4 || colorType == 6) probe.alpha = true;
+		}
+		if (type == "tRNS") probe.alpha = true;
+		if (type == "IDAT" || type == "IEND" || length > data.size() - pos - 8) break;
+		pos += 12 + static_cast<size_t>(length);
+	}
+}
+
+// WebP：VP8X・VP8L・ALPHのアルファ
+static void ProbeWebp(std::span<const uint8_t> data, FormatProbe& probe) {
+	probe.alpha = false;
+	size_t end = std::min<size_t>(data.size(), static_cast<size_t>(read_le32(&data[4])) + 8);
+	for (size_t pos = 12; pos + 8 <= end;) {
+		std::string_view type(reinterpret_cast<const char*>(&data[pos]), 4);
+		uint32_t size = read_le32(&data[pos + 4]);
+		size_t start = pos + 8;
+		if (size > end - start) break;
+		if (type == "VP8X" && size >= 1 && (data[start] & 0x10)) probe.alpha = true;
+		if (type == "VP8L" && size >= 5 && ((read_le32(&data[start + 1]) >> 28) & 1)) probe.alpha = true;
+		if (type == "ALPH") probe.alpha = true;
+		pos = start + size + (size & 1);
+	}
+}
+
+FormatProbe FormatProbe::Probe(std::span<const uint8_t> data) {
+	FormatProbe probe;
+	probe.format = Sniff(data);
+	switch (probe.format) {
+	case ImageFormat::Png:
+		ProbePng(data, probe);
+		break;
+	case ImageFormat::WebP:
+		ProbeWebp(data, probe);
+		break;
+	case ImageFormat::Jpeg:
+	case ImageFormat::Gif:
+		// GIFの透過色は1ビットなのでLSBに埋め込めない
+		probe.alpha = false;
+		break;
+	case ImageFormat::Bmp:
+		// アルファは32ビットの場合だけ
+		probe.alpha = read_le16(&data[28]) == 32;
+		break;
+	default:
+		break;
+	}
+
+	// C2PAはマニフェストストアを自前で探し、探せない形式はC2PAリーダーに任せる（BMPは非対応）
+	if (can_locate_c2pa_store(probe.format)) {
+		probe.c2pa = !locate_c2pa_store(data, probe.format).empty();
+	} else {
+		probe.c2pa = probe.format != ImageFormat::Bmp;
+	}
+	return probe;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// 画像の実際の形式（拡張子ではなく先頭のバイト列で判定する）
+enum class ImageFormat {
+	Unknown,
+	Png,
+	Jpeg,
+	WebP,
+	Gif,
+	Bmp,
+	Tiff,
+	Heif,	// HEIC/HEIF（ISOBMFF）
+	Avif,	// AVIF（ISOBMFF）
+	JpegXl,
+};
+
+// 形式と、各抽出処理が結果を出しうるか
+// ヘッダーとチャンク・セグメント・ボックスの見出しだけを読み、画素や圧縮データには触れない
+struct FormatProbe {
+	ImageFormat format = ImageFormat::Unknown;
+	bool alpha = true;	// アルファチャンネルを持ちうる（判定できない形式は true）
+	bool c2pa = true;	// C2PAのマニフェストストアを持つ（自前で探せない形式は true）
+
+	// C2PAリーダーに渡すMIMEタイプ（不明なら nullptr）
+	static const char* MimeType(ImageFormat format);
+
+	// シグネチャだけで形式を判定する
+	static ImageFormat Sniff(std::span<const uint8_t> data);
+
+	static FormatProbe Probe(std::span<const uint8_t> data);
+};
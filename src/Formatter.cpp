@@ -0,0 +1,221 @@
+﻿#include "framework.h"
+#include "Formatter.h"
+#include "TextUtils.h"
+
+bool Formatter::IsJson(std::string_view text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    size_t end = text.find_last_not_of(" \t\r\n");
+    if (start == std::string_view::npos || end == std::string_view::npos) return false;
+    char first = text[start];
+    char last = text[end];
+    if ((first == '{' && last == '}') || (first == '[' && last == ']')) {
+        // コロンとダブルクォートが複数含まれていればJSONとみなす
+        size_t colon = text.find(':', start);
+        size_t quote1 = text.find('\"', start);
+        size_t quote2 = text.find('\"', quote1 + 1);
+        if (colon != std::string_view::npos && quote1 != std::string_view::npos && quote2 != std::string_view::npos) return true;
+    }
+    return false;
+}
+
+bool Formatter::IsXml(std::string_view text) {
+    // 先頭と末尾の文字だけで簡易判定
+    size_t start = text.find_first_not_of(" \t\r\n");
+    size_t end = text.find_last_not_of(" \t\r\n");
+    if (start == std::string_view::npos || end == std::string_view::npos) return false;
+    char first = text[start];
+    char last = text[end];
+    return (first == '<' && last == '>');
+}
+
+// セクションの出力（ここで初めてワイド文字列にする）
+void Formatter::OutputSection(const std::wstring& title, const MetaList& data) {
+	if (data.empty()) return;
+
+    SetColor(TextStyle::Title);
+    PutText(title + L"\r\n");
+    for (const auto& entry : data) {
+        SetColor(TextStyle::Key);
+        PutText(entry.Key() + L" : ");
+        if (IsJson(entry.value)) {
+            SetColor(TextStyle::Value);
+            PutText(L"\r\n");
+            OutputAsJSON(entry.value);
+            PutText(L"\r\n");
+        } else if (IsXml(entry.value)) {
+            SetColor(TextStyle::Value);
+            PutText(L"\r\n");
+            OutputAsXML(entry.Value());
+            PutText(L"\r\n");
+        } else {
+            SetColor(TextStyle::Value);
+            PutText(entry.Value() + L"\r\n");
+        }
+    }
+}
+
+// JSON整形＆色分け出力（UTF-8のままトークンに分ける）
+void Formatter::OutputAsJSON(std::string_view json) {
+    std::vector<JsonToken> tokens;
+    if (JsonTokenizer::Tokenize(json, tokens)) {
+        OutputJsonTokens(json, tokens, 0);
+    } else {
+        SetColor(TextStyle::Value);
+        PutText(utf8_to_unicode(json));
+    }
+}
+
+// トークン列を整形して出力する（文字列に埋め込まれたJSONは同じ深さで展開する）
+void Formatter::OutputJsonTokens(std::string_view json, const std::vector<JsonToken>& tokens, int indent) {
+    auto newline = [&](int level) {
+        PutText(L"\r\n" + std::wstring(level * INDENT_WIDTH, L' '));
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const auto& token = tokens[i];
+        const JsonTokenType next = i + 1 < tokens.size() ? tokens[i + 1].type : JsonTokenType::Comma;
+        switch (token.type) {
+        case JsonTokenType::BeginObject:
+        case JsonTokenType::BeginArray: {
+            bool object = token.type == JsonTokenType::BeginObject;
+            SetColor(TextStyle::Symbol);
+            // 空配列・空オブジェクト
+            if (next == (object ? JsonTokenType::EndObject : JsonTokenType::EndArray)) {
+                PutText(object ? L"{}" : L"[]");
+                ++i;
+                break;
+            }
+            PutText(object ? L"{" : L"[");
+            newline(++indent);
+            break;
+        }
+        case JsonTokenType::EndObject:
+        case JsonTokenType::EndArray:
+            SetColor(TextStyle::Symbol);
+            newline(--indent);
+            PutText(token.type == JsonTokenType::EndObject ? L"}" : L"]");
+            break;
+        case JsonTokenType::Comma:
+            SetColor(TextStyle::Symbol);
+            PutText(L",");
+            newline(indent);
+            break;
+        case JsonTokenType::Colon:
+            SetColor(TextStyle::Symbol);
+            PutText(L": ");
+            break;
+        case JsonTokenType::String: {
+            std::string_view raw = json.substr(token.offset, token.length);
+            bool isKey = next == JsonTokenType::Colon;
+            if (!isKey && token.embedded) {
+                // 文字列の中身がJSONなら入れ子にして整形する
+                std::string inner = json_unescape(raw);
+                std::vector<JsonToken> innerTokens;
+                if (JsonTokenizer::Tokenize(inner, innerTokens)) {
+                    OutputJsonTokens(inner, innerTokens, indent);
+                    break;
+                }
+            }
+            SetColor(isKey ? TextStyle::Attr : TextStyle::Value);
+            PutText(L"\"" + utf8_to_unicode(raw) + L"\"");
+            break;
+        }
+        case JsonTokenType::Scalar:
+            // 数値やtrue/false/null
+            SetColor(TextStyle::Value);
+            PutText(utf8_to_unicode(json.substr(token.offset, token.length)));
+            break;
+        }
+    }
+    SetColor(TextStyle::Value);
+}
+
+// XML整形＆色分け出力
+void Formatter::OutputAsXML(const std::wstring& xml) {
+    int indent = 0;
+    bool inTag = false;
+    bool inValue = false;
+    std::wstring buffer;
+    bool firstTag = true;
+    for (size_t i = 0; i < xml.size(); ++i) {
+        wchar_t c = xml[i];
+        if (c == L'<') {
+            if (!buffer.empty()) {
+                SetColor(TextStyle::Value);
+                PutText(buffer);
+                buffer.clear();
+            }
+            SetColor(TextStyle::Symbol);
+            if (!firstTag) {
+                PutText(L"\r\n" + std::wstring(indent * INDENT_WIDTH, L' '));
+            }
+            PutText(L"<");
+            inTag = true;
+            inValue = false;
+            firstTag = false;
+            continue;
+        }
+        if (c == L'>') {
+            if (!buffer.empty()) {
+                SetColor(TextStyle::Tag);
+                PutText(buffer);
+                buffer.clear();
+            }
+            SetColor(TextStyle::Symbol);
+            PutText(L">");
+            inTag = false;
+            inValue = true;
+            if (i > 0 && xml[i-1] == L'/') {
+                // 空要素タグ
+                inValue = false;
+            }
+            continue;
+        }
+        if (inTag) {
+            if (c == L' ') {
+                if (!buffer.empty()) {
+                    SetColor(TextStyle::Tag);
+                    PutText(buffer);
+                    buffer.clear();
+                }
+                SetColor(TextStyle::Symbol);
+                PutText(L" ");
+                continue;
+            }
+            if (c == L'=') {
+                if (!buffer.empty()) {
+                    SetColor(TextStyle::Attr);
+                    PutText(buffer);
+                    buffer.clear();
+                }
+                SetColor(TextStyle::Symbol);
+                PutText(L"=");
+                continue;
+            }
+            if (c == L'"') {
+                SetColor(TextStyle::Value);
+                PutText(L"\"");
+                size_t j = i+1;
+                std::wstring val;
+                while (j < xml.size() && xml[j] != L'"') val += xml[j++];
+                PutText(val);
+                PutText(L"\"");
+                i = j;
+                continue;
+            }
+            buffer += c;
+        } else if (inValue) {
+            if (c == L'<') {
+                inValue = false;
+                --i;
+                continue;
+            }
+            buffer += c;
+        }
+    }
+    if (!buffer.empty()) {
+        SetColor(TextStyle::Value);
+        PutText(buffer);
+    }
+    SetColor(TextStyle::Value);
+}
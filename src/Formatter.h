@@ -0,0 +1,25 @@
+﻿#pragma once
+#include "MetaList.h"
+#include "StyledText.h"
+#include "JsonTokenizer.h"
+
+// 抽出結果を色分け・整形して書式付き文書に書き出す
+class Formatter {
+public:
+	explicit Formatter(StyledDocument& doc) : m_doc(doc) {}
+
+	void OutputSection(const std::wstring& title, const MetaList& data);
+	void OutputAsJSON(std::string_view json);
+	void OutputAsXML(const std::wstring& xml);
+	static bool IsJson(std::string_view text);
+	static bool IsXml(std::string_view text);
+
+	static constexpr int INDENT_WIDTH = 4;
+
+private:
+	void OutputJsonTokens(std::string_view json, const std::vector<JsonToken>& tokens, int indent);
+	void SetColor(TextStyle style) { m_doc.SetStyle(style); }
+	void PutText(const std::wstring& text) { m_doc.Append(text); }
+
+	StyledDocument& m_doc;
+};
@@ -0,0 +1,120 @@
+﻿#include "framework.h"
+#include "ImageBuffer.h"
+#include "TextUtils.h"
+#include "Trace.h"
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// マップしたファイル（最後の参照が無くなったら閉じる）
+struct ImageBuffer::Mapping {
+	void* view = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+	Mapping() = default;
+	Mapping(const Mapping&) = delete;
+	Mapping& operator=(const Mapping&) = delete;
+	~Mapping() {
+#ifdef _WIN32
+		if (view) UnmapViewOfFile(view);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (view) munmap(view, size);
+#endif
+	}
+};
+
+// ファイルをメモリマップで開く
+ImageBuffer ImageBuffer::FromFile(const std::filesystem::path& path) {
+	TRACE_SCOPE_DETAIL("FileMap", path_to_utf8(path));
+	ImageBuffer buffer;
+	buffer.m_path = path;
+	auto mapped = std::make_shared<Mapping>();
+
+#ifdef _WIN32
+	// 開いている間も他のプロセスが削除・名前変更・上書きできるようにする
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return buffer;
+	mapped->file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return buffer;
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) return buffer;
+	mapped->mapping = mapping;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) return buffer;
+	mapped->view = view;
+	mapped->size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return buffer;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return buffer;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return buffer;
+	mapped->view = view;
+	mapped->size = static_cast<size_t>(st.st_size);
+#endif
+
+	buffer.m_data = { static_cast<const uint8_t*>(mapped->view), mapped->size };
+	buffer.m_owner = std::move(mapped);
+	return buffer;
+}
+
+// メモリ上のデータを参照する
+ImageBuffer ImageBuffer::FromSpan(std::span<const uint8_t> data) {
+	ImageBuffer buffer;
+	buffer.m_data = data;
+	return buffer;
+}
+
+// ストリームを最後まで読み込む
+ImageBuffer ImageBuffer::FromStream(std::istream& stream) {
+	ImageBuffer buffer;
+	auto owned = std::make_shared<std::vector<uint8_t>>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	buffer.m_data = *owned;
+	buffer.m_owner = std::move(owned);
+	return buffer;
+}
+
+MemoryStreamBuf::MemoryStreamBuf(std::span<const uint8_t> data) {
+	char* begin = const_cast<char*>(reinterpret_cast<const char*>(data.data()));
+	setg(begin, begin, begin + data.size());
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+	if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+	off_type base = 0;
+	if (dir == std::ios_base::cur) base = gptr() - eback();
+	else if (dir == std::ios_base::end) base = egptr() - eback();
+
+	off_type pos = base + off;
+	if (pos < 0 || pos > egptr() - eback()) return pos_type(off_type(-1));
+	setg(eback(), eback() + pos, egptr());
+	return pos_type(pos);
+}
+
+MemoryStreamBuf::pos_type MemoryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+// 画像ファイルのバイト列
+// ファイルは一度だけ開いてメモリマップし、全ての抽出処理でこの領域を共有する
+class ImageBuffer {
+public:
+	ImageBuffer() = default;
+	ImageBuffer(const ImageBuffer&) = delete;
+	ImageBuffer& operator=(const ImageBuffer&) = delete;
+	ImageBuffer(ImageBuffer&& other) noexcept = default;
+	ImageBuffer& operator=(ImageBuffer&& other) noexcept = default;
+
+	// ファイルをメモリマップで開く（失敗時は空）
+	static ImageBuffer FromFile(const std::filesystem::path& path);
+	// メモリ上のデータを参照する（コピーしないので呼び出し側が寿命を管理する）
+	static ImageBuffer FromSpan(std::span<const uint8_t> data);
+	// ストリーム（標準入力など）を最後まで読み込む
+	static ImageBuffer FromStream(std::istream& stream);
+
+	bool empty() const { return m_data.empty(); }
+	const uint8_t* data() const { return m_data.data(); }
+	size_t size() const { return m_data.size(); }
+	std::span<const uint8_t> span() const { return m_data; }
+	const std::filesystem::path& path() const { return m_path; }
+
+	// データの領域（マップ・読み込んだバッファ）を持つもの
+	// 抽出結果がファイル内の値を参照し続けるために共有する（FromSpan の場合は nullptr）
+	const std::shared_ptr<const void>& Owner() const { return m_owner; }
+
+private:
+	struct Mapping;
+
+	std::span<const uint8_t> m_data;
+	std::shared_ptr<const void> m_owner;
+	std::filesystem::path m_path;
+};
+
+// メモリ領域をistreamとして読むためのストリームバッファ（コピーなし）
+class MemoryStreamBuf : public std::streambuf {
+public:
+	explicit MemoryStreamBuf(std::span<const uint8_t> data);
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
@@ -0,0 +1,141 @@
+﻿#include "Inflater.h"
+#include "Trace.h"
+#include "Cancellation.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+#if defined(PHANTOMVIEW_USE_LIBDEFLATE) && __has_include(<libdeflate.h>)
+#include <libdeflate.h>
+#define PV_HAS_LIBDEFLATE 1
+#endif
+
+static std::atomic<size_t> s_defaultLimit = 256 * 1024 * 1024;
+
+// 最初に確保する出力サイズ
+static constexpr size_t INITIAL_OUTPUT = 16 * 1024;
+
+#ifdef PV_HAS_LIBDEFLATE
+// gzipの元サイズを目安にする上限（入力の何倍まで）
+static constexpr size_t MAX_TRUSTED_RATIO = 64;
+#endif
+
+static int WindowBits(InflateFormat format) {
+	switch (format) {
+	case InflateFormat::Zlib: return MAX_WBITS;
+	case InflateFormat::Gzip: return 16 + MAX_WBITS;
+	case InflateFormat::Raw: return -MAX_WBITS;
+	default: return 32 + MAX_WBITS;
+	}
+}
+
+Inflater::Inflater() {
+}
+
+Inflater::~Inflater() {
+	if (m_windowBits != 0) inflateEnd(&m_stream);
+#ifdef PV_HAS_LIBDEFLATE
+	if (m_deflate) libdeflate_free_decompressor(static_cast<libdeflate_decompressor*>(m_deflate));
+#endif
+}
+
+Inflater& Inflater::ForThread() {
+	static thread_local Inflater inflater;
+	return inflater;
+}
+
+size_t Inflater::DefaultLimit() {
+	return s_defaultLimit;
+}
+
+void Inflater::SetDefaultLimit(size_t limit) {
+	s_defaultLimit = limit;
+}
+
+InflateStatus Inflater::InflateZlib(std::span<const uint8_t> input, int windowBits, std::string& output, size_t limit) {
+	// 前回と同じ形式ならリセットだけで済ませる
+	if (m_windowBits == 0) {
+		if (inflateInit2(&m_stream, windowBits) != Z_OK) return InflateStatus::Error;
+	} else if (inflateReset2(&m_stream, windowBits) != Z_OK) {
+		return InflateStatus::Error;
+	}
+	m_windowBits = windowBits;
+
+	m_stream.next_in = const_cast<Bytef*>(input.data());
+	m_stream.avail_in = 0;
+	size_t inputLeft = input.size();
+
+	size_t used = 0;
+	output.resize(std::min(limit, std::max(INITIAL_OUTPUT, input.size() * 4)));
+	for (;;) {
+		// avail_in・avail_out は32ビットなので、4GiB以上は区切って渡す
+		if (m_stream.avail_in == 0) {
+			m_stream.avail_in = static_cast<uInt>(std::min<size_t>(inputLeft, UINT_MAX));
+			inputLeft -= m_stream.avail_in;
+		}
+		size_t space = std::min<size_t>(output.size() - used, UINT_MAX);
+		m_stream.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+		m_stream.avail_out = static_cast<uInt>(space);
+		int ret = inflate(&m_stream, Z_NO_FLUSH);
+		used += space - m_stream.avail_out;
+
+		if (ret == Z_STREAM_END) break;
+		if (ret != Z_OK && ret != Z_BUF_ERROR) return InflateStatus::Error;
+		if (m_stream.avail_out > 0) {
+			if (inputLeft == 0) return InflateStatus::Error; // 入力が途中で終わっている
+			continue;
+		}
+		if (used < output.size()) continue;
+
+		// 出力が足りなければ上限まで倍に伸ばす
+		if (output.size() >= limit) return InflateStatus::TooLarge;
+		if (CancellationToken::Current().ShouldStop()) return InflateStatus::Cancelled;
+		output.resize(output.size() > limit / 2 ? limit : output.size() * 2);
+	}
+	output.resize(used);
+	return InflateStatus::Ok;
+}
+
+InflateStatus Inflater::Inflate(std::span<const uint8_t> input, InflateFormat format, std::string& output, size_t limit) {
+	TRACE_SCOPE("Inflate");
+	output.clear();
+	if (limit == 0) limit = DefaultLimit();
+
+#ifdef PV_HAS_LIBDEFLATE
+	// libdeflateは一括展開なので、gzipは末尾の元サイズを目安に確保する
+	// 元サイズはファイルが決める値なので、入力の一定倍までしか信用せず、足りなければ倍にしてやり直す
+	if (format != InflateFormat::Auto) {
+		if (!m_deflate) m_deflate = libdeflate_alloc_decompressor();
+		auto* decompressor = static_cast<libdeflate_decompressor*>(m_deflate);
+		if (decompressor) {
+			size_t size = std::max(INITIAL_OUTPUT, input.size() * 4);
+			if (format == InflateFormat::Gzip && input.size() >= 18) {
+				const uint8_t* isize = input.data() + input.size() - 4;
+				size_t hint = isize[0] | (isize[1] << 8) | (isize[2] << 16) | (static_cast<uint32_t>(isize[3]) << 24);
+				size = std::max(INITIAL_OUTPUT, std::min(hint, input.size() * MAX_TRUSTED_RATIO));
+			}
+			for (size = std::min(size, limit);; size = size > limit / 2 ? limit : size * 2) {
+				output.resize(size);
+				size_t actual = 0;
+				libdeflate_result ret;
+				if (format == InflateFormat::Gzip) {
+					ret = libdeflate_gzip_decompress(decompressor, input.data(), input.size(), output.data(), size, &actual);
+				} else if (format == InflateFormat::Zlib) {
+					ret = libdeflate_zlib_decompress(decompressor, input.data(), input.size(), output.data(), size, &actual);
+				} else {
+					ret = libdeflate_deflate_decompress(decompressor, input.data(), input.size(), output.data(), size, &actual);
+				}
+				if (ret == LIBDEFLATE_SUCCESS) {
+					output.resize(actual);
+					return InflateStatus::Ok;
+				}
+				if (ret != LIBDEFLATE_INSUFFICIENT_SPACE) return InflateStatus::Error;
+				if (size >= limit) return InflateStatus::TooLarge;
+				if (CancellationToken::Current().ShouldStop()) return InflateStatus::Cancelled;
+			}
+		}
+	}
+#endif
+
+	return InflateZlib(input, WindowBits(format), output, limit);
+}
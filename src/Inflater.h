@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <zlib.h>
+
+// 圧縮データの形式
+enum class InflateFormat {
+	Zlib,	// zlibヘッダー付き（PNGのzTXt/iTXtなど）
+	Gzip,	// gzip（NovelAIの埋め込みなど）
+	Raw,	// ヘッダー無しのdeflate
+	Auto,	// zlib/gzipを自動判別
+};
+
+enum class InflateStatus {
+	Ok,
+	TooLarge,	// 展開後のサイズが上限を超えた
+	Error,		// 壊れたデータ
+	Cancelled,	// 展開中に取り消された・時間切れになった
+};
+
+// 圧縮されたメタデータの展開
+// 出力は上限まで倍々に伸ばし、z_streamはinflateResetで使い回す
+// PHANTOMVIEW_USE_LIBDEFLATE を定義してlibdeflateをリンクすると、そちらで展開する
+class Inflater {
+public:
+	Inflater();
+	~Inflater();
+	Inflater(const Inflater&) = delete;
+	Inflater& operator=(const Inflater&) = delete;
+
+	// limit が 0 の場合は DefaultLimit()
+	InflateStatus Inflate(std::span<const uint8_t> input, InflateFormat format, std::string& output, size_t limit = 0);
+
+	// スレッドごとに使い回すインスタンス
+	static Inflater& ForThread();
+
+	// 展開後のサイズ上限の既定値
+	static size_t DefaultLimit();
+	static void SetDefaultLimit(size_t limit);
+
+private:
+	InflateStatus InflateZlib(std::span<const uint8_t> input, int windowBits, std::string& output, size_t limit);
+
+	z_stream m_stream = {};
+	int m_windowBits = 0;	// 0 の場合は未初期化
+	void* m_deflate = nullptr;
+};
@@ -1,5 +0,0 @@
-#pragma once
-#include <string>
-#include <vector>
-
-typedef std::vector<std::pair<std::wstring, std::wstring>> info_list;
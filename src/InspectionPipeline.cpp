@@ -0,0 +1,125 @@
+﻿#include "framework.h"
+#include "InspectionPipeline.h"
+#include "ThreadPool.h"
+#include "FormatProbe.h"
+#include "TextUtils.h"
+#include "Trace.h"
+
+InspectionJob::InspectionJob(const std::filesystem::path& path, const InspectOptions& options, PipelineCallbacks callbacks)
+	: m_path(path), m_options(options), m_callbacks(std::move(callbacks)) {
+	// Cancel() で止められるよう、取り消せないトークンは差し替える
+	if (!m_options.cancel.CanCancel()) m_options.cancel = CancellationToken::Create();
+	m_result.path = path;
+}
+
+void InspectionJob::Run(ThreadPool& pool, const std::shared_ptr<InspectionJob>& self) {
+	auto deliverAll = [&](StageStatus status) {
+		for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) Deliver({static_cast<ExtractorKind>(i), status});
+	};
+	if (IsCancelled()) {
+		deliverAll(StageStatus::Cancelled);
+		return;
+	}
+
+	// ファイルは一度だけ開いて全ての抽出処理で共有する
+	auto image = std::make_shared<ImageBuffer>(ImageBuffer::FromFile(m_path));
+	if (image->empty()) {
+		// 開けなかったファイルはエラーにする（中身が空のファイルは調べるものが無いだけ）
+		if (const wchar_t* error = Inspector::OpenError(m_path)) {
+			Fail(error);
+		} else {
+			deliverAll(StageStatus::Skipped);
+		}
+		return;
+	}
+
+	// キャッシュに当たれば全ての結果をまとめて渡す
+	auto* cache = m_options.cache;
+	if (cache && cache->MakeKey(*image, m_cacheKey)) {
+		InspectionResult cached;
+		bool found;
+		{
+			TRACE_SCOPE("ResultCache::Lookup");
+			found = cache->Lookup(m_cacheKey, cached);
+		}
+		if (found) {
+			m_cacheable = false;
+			for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) {
+				auto kind = static_cast<ExtractorKind>(i);
+				Deliver({kind, StageStatus::Done, std::move(cached.Section(kind))});
+			}
+			return;
+		}
+		m_cacheable = true;
+	}
+
+	FormatProbe probe;
+	{
+		TRACE_SCOPE("FormatProbe");
+		probe = FormatProbe::Probe(image->span());
+	}
+
+	// キャッシュには全てのキーを入れておき、渡すときに絞り込む
+	auto options = std::make_shared<InspectOptions>(m_options);
+	if (m_cacheable) options->keys.clear();
+	for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) {
+		pool.Submit([self, image, probe, options, kind = static_cast<ExtractorKind>(i)] {
+			auto stage = Inspector::RunStage(kind, *image, probe, *options);
+			// GUIや監視では結果をファイルより長く持つので、ファイルを参照している値はここでコピーしてマップを閉じられるようにする
+			stage.items.Detach(image->Owner(), image->data(), image->size());
+			self->Deliver(std::move(stage));
+		});
+	}
+}
+
+void InspectionJob::Deliver(StageResult stage) {
+	if (m_delivered[static_cast<size_t>(stage.kind)].exchange(true)) return;
+	{
+		std::lock_guard lock(m_mutex);
+		if (stage.status != StageStatus::Done && stage.status != StageStatus::Skipped) m_complete = false;
+		m_result.Section(stage.kind) = stage.items;
+	}
+	if (stage.kind == ExtractorKind::Meta) Inspector::FilterKeys(stage.items, m_options.keys);
+	if (m_callbacks.onStage) m_callbacks.onStage(stage);
+	auto kind = stage.kind;
+	m_stages[static_cast<size_t>(kind)].promise.set_value(std::move(stage));
+	if (--m_remaining > 0) return;
+
+	// 最後の抽出処理が全体の結果をまとめる
+	std::unique_lock lock(m_mutex);
+	if (m_cacheable && m_complete) {
+		TRACE_SCOPE("ResultCache::Store");
+		m_options.cache->Store(m_cacheKey, m_result);
+	}
+	InspectionResult result = std::move(m_result);
+	lock.unlock();
+	Inspector::FilterKeys(result.meta, m_options.keys);
+	if (m_callbacks.onComplete && !IsCancelled()) m_callbacks.onComplete(result);
+	m_done.promise.set_value(std::move(result));
+}
+
+// ファイルを開けない・Run が例外で中断したとき、まだ渡していない抽出処理の結果をエラーにして全体を終わらせる
+// エラーの説明は最初に渡すものにだけ付ける
+void InspectionJob::Fail(const std::wstring& message) {
+	bool reported = false;
+	for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) {
+		if (m_delivered[i]) continue;
+		StageResult stage{static_cast<ExtractorKind>(i), StageStatus::Failed};
+		if (!reported) stage.items.Add(L"error", message, MetaType::Error);
+		reported = true;
+		Deliver(std::move(stage));
+	}
+}
+
+std::shared_ptr<InspectionJob> InspectionPipeline::Start(const std::filesystem::path& path, const InspectOptions& options, PipelineCallbacks callbacks) {
+	std::shared_ptr<InspectionJob> job(new InspectionJob(path, options, std::move(callbacks)));
+	m_pool.Submit([job, pool = &m_pool] {
+		TRACE_SCOPE_DETAIL("Inspect", path_to_utf8(job->Path()));
+		try {
+			job->Run(*pool, job);
+		} catch (const std::exception& e) {
+			job->Fail(L"読み込み失敗（" + utf8_to_unicode(e.what()) + L"）");
+		}
+	});
+	return job;
+}
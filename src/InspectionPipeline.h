@@ -0,0 +1,73 @@
+﻿#pragma once
+#include "Inspector.h"
+#include "ResultCache.h"
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class ThreadPool;
+
+// 非同期の抽出処理で結果を受け取るコールバック（ワーカースレッドから呼ばれる）
+struct PipelineCallbacks {
+	std::function<void(const StageResult& stage)> onStage;			// 抽出処理が1つ終わるごと（終わった順）
+	std::function<void(const InspectionResult& result)> onComplete;	// 全て終わったとき（取り消された場合は呼ばない）
+};
+
+// 実行中の1ファイル分の抽出処理
+// 抽出処理ごとの結果と全体の結果を future で受け取れる
+class InspectionJob {
+public:
+	const std::filesystem::path& Path() const { return m_path; }
+
+	// 実行中の抽出処理を打ち切り、残りは実行しない（結果は StageStatus::Cancelled になる）
+	void Cancel() { m_options.cancel.Cancel(); }
+	bool IsCancelled() const { return m_options.cancel.IsCancelled(); }
+
+	std::shared_future<StageResult> Stage(ExtractorKind kind) const { return m_stages[static_cast<size_t>(kind)].future; }
+	std::shared_future<InspectionResult> Result() const { return m_done.future; }
+
+private:
+	friend class InspectionPipeline;
+
+	template <typename T>
+	struct Slot {
+		std::promise<T> promise;
+		std::shared_future<T> future = promise.get_future().share();
+	};
+
+	InspectionJob(const std::filesystem::path& path, const InspectOptions& options, PipelineCallbacks callbacks);
+	void Run(ThreadPool& pool, const std::shared_ptr<InspectionJob>& self);
+	void Deliver(StageResult stage);
+	void Fail(const std::wstring& message);
+
+	std::filesystem::path m_path;
+	InspectOptions m_options;
+	PipelineCallbacks m_callbacks;
+	std::array<Slot<StageResult>, EXTRACTOR_KINDS> m_stages;
+	std::array<std::atomic<bool>, EXTRACTOR_KINDS> m_delivered = {};	// 結果を渡し済み（2回目以降は無視する）
+	Slot<InspectionResult> m_done;
+
+	std::mutex m_mutex;
+	InspectionResult m_result;				// 終わった抽出処理の結果（キャッシュ用にキーで絞り込まない）
+	std::atomic<size_t> m_remaining = EXTRACTOR_KINDS;
+	bool m_complete = true;					// 打ち切られた抽出処理が無い
+	bool m_cacheable = false;
+	CacheKey m_cacheKey;
+};
+
+// 抽出処理ごとにスレッドプールへ投げ、終わったものから結果を渡す
+// 時間の掛かる抽出処理（大きな画像のNovelAI抽出など）を待たずに、先に終わった結果を表示できる
+class InspectionPipeline {
+public:
+	explicit InspectionPipeline(ThreadPool& pool) : m_pool(pool) {}
+
+	std::shared_ptr<InspectionJob> Start(const std::filesystem::path& path, const InspectOptions& options = {}, PipelineCallbacks callbacks = {});
+
+private:
+	ThreadPool& m_pool;
+};
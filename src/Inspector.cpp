@@ -0,0 +1,187 @@
+﻿#include "framework.h"
+#include "Inspector.h"
+#include "MetaExtractor.h"
+#include "C2PAExtractor.h"
+#include "NAIExtractor.h"
+#include "ResultCache.h"
+#include "FormatProbe.h"
+#include "TextUtils.h"
+#include "Trace.h"
+#include <algorithm>
+
+// 抽出処理の一覧（ExtractorKind の順）
+// 先に形式を調べ、結果を出しうる抽出処理だけを実行する
+struct ExtractorEntry {
+	const wchar_t* title;
+	bool (*accepts)(const FormatProbe& probe);
+	MetaList (*extract)(const ImageBuffer& image, const std::vector<std::wstring>& keys);
+};
+
+static const ExtractorEntry EXTRACTORS[EXTRACTOR_KINDS] = {
+	// メタデータ抽出（PNG・JPEG・WebP・HEIF・AVIF・JPEG XL）
+	{
+		L"[MetaData]",
+		[](const FormatProbe& probe) {
+			switch (probe.format) {
+			case ImageFormat::Png:
+			case ImageFormat::Jpeg:
+			case ImageFormat::WebP:
+			case ImageFormat::Heif:
+			case ImageFormat::Avif:
+			case ImageFormat::JpegXl:
+				return true;
+			default:
+				return false;
+			}
+		},
+		[](const ImageBuffer& image, const std::vector<std::wstring>& keys) {
+			TRACE_SCOPE("ExtractMeta");
+			return MetaExtractor::ExtractMeta(image, keys);
+		},
+	},
+	// C2PA抽出（マニフェストストアが無ければC2PAリーダーを作らない）
+	{
+		L"[C2PA]",
+		[](const FormatProbe& probe) { return probe.c2pa; },
+		[](const ImageBuffer& image, const std::vector<std::wstring>&) {
+			TRACE_SCOPE("ExtractC2PA");
+			return C2PAExtractor::ExtractC2PA(image);
+		},
+	},
+	// NovelAI抽出（アルファまたはRGBのLSB。展開できる形式だけ）
+	// PNG・WebPは行ごとに展開してマジックが合わなければ数行で打ち切るので、アルファが無くてもRGBの埋め込みを調べる
+	// GDI+で全体を展開する形式はアルファがあるときだけ
+	{
+		L"[NovelAI stealth data]",
+		[](const FormatProbe& probe) {
+			if (probe.format == ImageFormat::Png || probe.format == ImageFormat::WebP) return true;
+			return probe.alpha && (probe.format == ImageFormat::Bmp || probe.format == ImageFormat::Tiff ||
+				probe.format == ImageFormat::Unknown);
+		},
+		[](const ImageBuffer& image, const std::vector<std::wstring>&) {
+			TRACE_SCOPE("ExtractNAI");
+			return NAIExtractor::ExtractNAI(image);
+		},
+	},
+};
+
+InspectionResult Inspector::Inspect(const ImageBuffer& image, const InspectOptions& options) {
+	TRACE_SCOPE_DETAIL("Inspect", path_to_utf8(image.path()));
+	InspectionResult result;
+	result.path = image.path();
+	if (image.empty()) return result;
+
+	// キャッシュには全てのキーを入れておき、取り出した後で絞り込む
+	CacheKey key;
+	if (options.cache && options.cache->MakeKey(image, key)) {
+		bool found;
+		{
+			TRACE_SCOPE("ResultCache::Lookup");
+			found = options.cache->Lookup(key, result);
+		}
+		if (!found) {
+			InspectOptions uncached = options;
+			uncached.keys.clear();
+			bool complete;
+			result = Extract(image, uncached, complete);
+			// 打ち切った結果は残さない
+			if (complete) {
+				TRACE_SCOPE("ResultCache::Store");
+				options.cache->Store(key, result);
+			}
+		}
+		FilterKeys(result.meta, options.keys);
+		return result;
+	}
+	bool complete;
+	return Extract(image, options, complete);
+}
+
+InspectionResult Inspector::Extract(const ImageBuffer& image, const InspectOptions& options, bool& complete) {
+	InspectionResult result;
+	result.path = image.path();
+
+	FormatProbe probe;
+	{
+		TRACE_SCOPE("FormatProbe");
+		probe = FormatProbe::Probe(image.span());
+	}
+	complete = true;
+	for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) {
+		auto stage = RunStage(static_cast<ExtractorKind>(i), image, probe, options);
+		if (stage.status != StageStatus::Done && stage.status != StageStatus::Skipped) complete = false;
+		result.Section(stage.kind) = std::move(stage.items);
+	}
+	return result;
+}
+
+StageResult Inspector::RunStage(ExtractorKind kind, const ImageBuffer& image, const FormatProbe& probe, const InspectOptions& options) {
+	StageResult stage;
+	stage.kind = kind;
+	const auto& extractor = EXTRACTORS[static_cast<size_t>(kind)];
+	if (!extractor.accepts(probe)) return stage;
+	if (options.cancel.IsCancelled()) {
+		stage.status = StageStatus::Cancelled;
+		return stage;
+	}
+
+	// 抽出処理は CancellationToken::Current() を見て途中で打ち切る
+	auto token = options.budget.count() > 0
+		? options.cancel.WithDeadline(CancellationToken::Clock::now() + options.budget) : options.cancel;
+	CancellationToken::Scope scope(token);
+	try {
+		stage.items = extractor.extract(image, options.keys);
+	} catch (const std::exception& e) {
+		// 確保の失敗などで1つの抽出処理が落ちても、他の抽出処理やファイルの処理は続ける
+		stage.status = StageStatus::Failed;
+		stage.items.clear();
+		stage.items.Add(L"error", L"抽出失敗（" + utf8_to_unicode(e.what()) + L"）", MetaType::Error);
+		return stage;
+	}
+
+	if (options.cancel.IsCancelled()) {
+		stage.status = StageStatus::Cancelled;
+		stage.items.clear();
+	} else if (token.Expired()) {
+		// 途中で打ち切った結果は不完全なので捨てる
+		stage.status = StageStatus::TimedOut;
+		stage.items.clear();
+		stage.items.Add(L"error", L"制限時間（" + std::to_wstring(options.budget.count()) + L"ms）を超えました", MetaType::Error);
+	} else {
+		stage.status = StageStatus::Done;
+	}
+	return stage;
+}
+
+const wchar_t* Inspector::OpenError(const std::filesystem::path& path) {
+	std::error_code ec;
+	if (!std::filesystem::exists(path, ec)) return L"ファイルが見つかりません";
+	auto size = std::filesystem::file_size(path, ec);
+	if (!ec && size == 0) return nullptr;
+	return L"ファイルを読み込めません";
+}
+
+const wchar_t* Inspector::SectionTitle(ExtractorKind kind) {
+	return EXTRACTORS[static_cast<size_t>(kind)].title;
+}
+
+void Inspector::FilterKeys(MetaList& meta, const std::vector<std::wstring>& keys) {
+	if (keys.empty()) return;
+	std::vector<std::string> wanted;
+	for (const auto& key : keys) wanted.push_back(unicode_to_utf8(key));
+	meta.RemoveIf([&](const MetaEntry& entry) {
+		return std::find(wanted.begin(), wanted.end(), entry.key) == wanted.end();
+	});
+}
+
+InspectionResult Inspector::Inspect(const std::filesystem::path& path, const InspectOptions& options) {
+	auto image = ImageBuffer::FromFile(path);
+	if (image.empty()) {
+		// 消えた・開けないファイルは空の結果と区別できるようにエラーを返す
+		InspectionResult result;
+		result.path = path;
+		if (const wchar_t* error = OpenError(path)) result.meta.Add(L"error", error, MetaType::Error);
+		return result;
+	}
+	return Inspect(image, options);
+}
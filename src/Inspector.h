@@ -0,0 +1,79 @@
+﻿#pragma once
+#include "MetaList.h"
+#include "ImageBuffer.h"
+#include "Cancellation.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// 抽出処理の種類（出力はこの順）
+enum class ExtractorKind {
+	Meta,
+	C2PA,
+	NAI,
+};
+constexpr size_t EXTRACTOR_KINDS = 3;
+
+// 1ファイル分の抽出結果
+struct InspectionResult {
+	std::filesystem::path path;
+	MetaList meta;
+	MetaList c2pa;
+	MetaList nai;
+
+	MetaList& Section(ExtractorKind kind) { return kind == ExtractorKind::Meta ? meta : kind == ExtractorKind::C2PA ? c2pa : nai; }
+	const MetaList& Section(ExtractorKind kind) const { return const_cast<InspectionResult*>(this)->Section(kind); }
+};
+
+// 抽出処理1つ分の結果
+enum class StageStatus {
+	Done,
+	Skipped,	// 形式から結果が出ないと分かっている
+	Cancelled,
+	TimedOut,	// 制限時間を超えた（items はエラーの説明）
+	Failed,		// 抽出処理が例外で中断した（items はエラーの説明）
+};
+struct StageResult {
+	ExtractorKind kind;
+	StageStatus status = StageStatus::Skipped;
+	MetaList items = {};
+};
+
+class ResultCache;
+struct FormatProbe;
+
+// 抽出の条件
+struct InspectOptions {
+	std::vector<std::wstring> keys;	// メタデータのうち取り出すキー（空なら全て）
+	ResultCache* cache = nullptr;	// 結果のキャッシュ（無ければ毎回抽出する）
+	std::chrono::milliseconds budget{0};	// 抽出処理ごとの制限時間（0 なら無制限）
+	CancellationToken cancel;		// 取り消されたら実行中の抽出処理を打ち切り、残りは実行しない
+};
+
+// 全ての抽出処理をまとめて実行する（GUIとバッチで共通）
+class Inspector {
+public:
+	// 抽出結果の内容が変わる修正をしたら上げる（キャッシュが作り直される）
+	static constexpr uint32_t VERSION = 7;
+
+	static InspectionResult Inspect(const ImageBuffer& image, const InspectOptions& options = {});
+	static InspectionResult Inspect(const std::filesystem::path& path, const InspectOptions& options = {});
+
+	// 抽出処理を1つだけ実行する（制限時間と取り消しを適用し、例外はエラーの項目にする）
+	static StageResult RunStage(ExtractorKind kind, const ImageBuffer& image, const FormatProbe& probe, const InspectOptions& options);
+
+	// ImageBuffer::FromFile が空を返したファイルを開けなかった理由（中身が空のファイルなら nullptr）
+	static const wchar_t* OpenError(const std::filesystem::path& path);
+
+	// 出力するときの見出し
+	static const wchar_t* SectionTitle(ExtractorKind kind);
+
+	// keys に含まれないメタデータを取り除く
+	static void FilterKeys(MetaList& meta, const std::vector<std::wstring>& keys);
+
+private:
+	static InspectionResult Extract(const ImageBuffer& image, const InspectOptions& options, bool& complete);
+};
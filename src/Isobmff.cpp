@@ -0,0 +1,204 @@
+﻿#include "framework.h"
+#include "Isobmff.h"
+#include "ByteReader.h"
+#include <cstring>
+
+bool read_box(std::span<const uint8_t> data, size_t pos, IsobmffBox& box) {
+	if (pos > data.size() || data.size() - pos < 8) return false;
+	uint64_t size = read_be32(&data[pos]);
+	size_t header = 8;
+	if (size == 1) {
+		if (data.size() - pos < 16) return false;
+		size = (static_cast<uint64_t>(read_be32(&data[pos + 8])) << 32) | read_be32(&data[pos + 12]);
+		header = 16;
+	} else if (size == 0) {
+		size = data.size() - pos;	// データの終わりまで
+	}
+	if (size < header || size > data.size() - pos) return false;
+	box.type = std::string_view(reinterpret_cast<const char*>(&data[pos + 4]), 4);
+	box.box = data.subspan(pos, static_cast<size_t>(size));
+	box.body = box.box.subspan(header);
+	return true;
+}
+
+void walk_boxes(std::span<const uint8_t> data,
+	const std::function<bool(std::string_view type, std::span<const uint8_t> box, std::span<const uint8_t> body)>& visit) {
+	IsobmffBox box;
+	for (size_t pos = 0; read_box(data, pos, box); pos += box.box.size()) {
+		if (!visit(box.type, box.box, box.body)) return;
+	}
+}
+
+const IsobmffBox* BoxIndex::Find(std::string_view type) {
+	for (const auto& box : m_boxes) {
+		if (box.type == type) return &box;
+	}
+	while (!m_end) {
+		IsobmffBox box;
+		if (!read_box(m_data, m_pos, box)) {
+			m_end = true;
+			break;
+		}
+		m_pos += box.box.size();
+		m_boxes.push_back(box);
+		if (box.type == type) return &m_boxes.back();
+	}
+	return nullptr;
+}
+
+// 境界を確かめながらビッグエンディアンの値を読む（一度でも範囲を超えたら以降は全て失敗）
+struct BoxReader {
+	std::span<const uint8_t> data;
+	size_t pos = 0;
+	bool ok = true;
+
+	uint64_t Read(size_t bytes) {
+		if (!ok || bytes > data.size() - pos) {
+			ok = false;
+			return 0;
+		}
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) value = (value << 8) | data[pos + i];
+		pos += bytes;
+		return value;
+	}
+
+	std::string_view Type() {
+		if (!ok || data.size() - pos < 4) {
+			ok = false;
+			return {};
+		}
+		std::string_view type(reinterpret_cast<const char*>(&data[pos]), 4);
+		pos += 4;
+		return type;
+	}
+
+	// NUL終端の文字列
+	std::string_view String() {
+		auto* begin = data.data() + pos;
+		auto* end = ok ? static_cast<const uint8_t*>(memchr(begin, 0, data.size() - pos)) : nullptr;
+		if (!end) {
+			ok = false;
+			return {};
+		}
+		pos += end - begin + 1;
+		return std::string_view(reinterpret_cast<const char*>(begin), end - begin);
+	}
+};
+
+HeifItems::HeifItems(std::span<const uint8_t> file) : m_file(file) {
+	// meta はフルボックス（バージョン・フラグの4バイトの後に子ボックス）
+	BoxIndex index(file);
+	auto* meta = index.Find("meta");
+	if (!meta || meta->body.size() < 4) return;
+
+	// iloc は iinf より前にあることが多いので、先に子ボックスを集めてから読む
+	std::span<const uint8_t> iinf, iloc;
+	walk_boxes(meta->body.subspan(4), [&](std::string_view type, std::span<const uint8_t>, std::span<const uint8_t> body) {
+		if (type == "iinf") iinf = body;
+		if (type == "iloc") iloc = body;
+		if (type == "idat") m_idat = body;
+		return true;
+	});
+	ReadInfo(iinf);
+	ReadLocations(iloc);
+}
+
+void HeifItems::ReadInfo(std::span<const uint8_t> iinf) {
+	BoxReader reader{iinf};
+	uint8_t version = static_cast<uint8_t>(reader.Read(1));
+	reader.Read(3);
+	reader.Read(version == 0 ? 2 : 4);	// 項目数（子ボックスの数と同じ）
+	if (!reader.ok) return;
+
+	walk_boxes(iinf.subspan(reader.pos), [&](std::string_view type, std::span<const uint8_t>, std::span<const uint8_t> body) {
+		if (type != "infe") return true;
+		BoxReader infe{body};
+		uint8_t infeVersion = static_cast<uint8_t>(infe.Read(1));
+		infe.Read(3);
+		HeifItem item;
+		if (infeVersion >= 2) {
+			item.id = static_cast<uint32_t>(infe.Read(infeVersion == 2 ? 2 : 4));
+			infe.Read(2);	// 保護方式
+			item.type = infe.Type();
+			infe.String();	// 項目名
+			if (item.type == "mime") item.contentType = infe.String();
+		} else {
+			// 古い版は種類を持たず、Content-Type だけを持つ
+			item.id = static_cast<uint32_t>(infe.Read(2));
+			infe.Read(2);
+			infe.String();
+			item.type = "mime";
+			item.contentType = infe.String();
+		}
+		if (infe.ok) m_items.push_back(std::move(item));
+		return true;
+	});
+}
+
+void HeifItems::ReadLocations(std::span<const uint8_t> iloc) {
+	BoxReader reader{iloc};
+	uint8_t version = static_cast<uint8_t>(reader.Read(1));
+	reader.Read(3);
+	uint8_t sizes = static_cast<uint8_t>(reader.Read(1));
+	uint8_t baseSizes = static_cast<uint8_t>(reader.Read(1));
+	size_t offsetSize = sizes >> 4, lengthSize = sizes & 15, baseOffsetSize = baseSizes >> 4;
+	size_t indexSize = (version == 1 || version == 2) ? (baseSizes & 15) : 0;
+	uint32_t count = static_cast<uint32_t>(reader.Read(version < 2 ? 2 : 4));
+
+	for (uint32_t i = 0; i < count && reader.ok; ++i) {
+		uint32_t id = static_cast<uint32_t>(reader.Read(version < 2 ? 2 : 4));
+		uint8_t construction = (version == 1 || version == 2) ? static_cast<uint8_t>(reader.Read(2) & 15) : 0;
+		reader.Read(2);	// データ参照の番号（同じファイルだけを扱う）
+		uint64_t baseOffset = reader.Read(baseOffsetSize);
+		uint16_t extentCount = static_cast<uint16_t>(reader.Read(2));
+		std::vector<HeifExtent> extents;
+		for (uint16_t e = 0; e < extentCount && reader.ok; ++e) {
+			reader.Read(indexSize);
+			uint64_t offset = reader.Read(offsetSize);
+			uint64_t length = reader.Read(lengthSize);
+			extents.push_back({offset, length});
+		}
+		if (!reader.ok) break;
+
+		for (auto& item : m_items) {
+			if (item.id != id) continue;
+			item.construction = construction;
+			item.baseOffset = baseOffset;
+			item.extents = std::move(extents);
+			break;
+		}
+	}
+}
+
+std::span<const uint8_t> HeifItems::Extent(const HeifItem& item, const HeifExtent& extent) const {
+	std::span<const uint8_t> source;
+	if (item.construction == 0) source = m_file;
+	else if (item.construction == 1) source = m_idat;
+	else return {};
+
+	uint64_t offset = item.baseOffset + extent.offset;
+	if (offset < item.baseOffset || offset > source.size()) return {};
+	uint64_t length = extent.length ? extent.length : source.size() - offset;
+	if (length > source.size() - offset) return {};
+	return source.subspan(static_cast<size_t>(offset), static_cast<size_t>(length));
+}
+
+std::span<const uint8_t> HeifItems::Payload(const HeifItem& item, std::vector<uint8_t>& buffer) const {
+	if (item.extents.size() == 1) return Extent(item, item.extents[0]);
+
+	buffer.clear();
+	for (const auto& extent : item.extents) {
+		auto part = Extent(item, extent);
+		if (part.empty()) return {};
+		buffer.insert(buffer.end(), part.begin(), part.end());
+	}
+	return buffer;
+}
+
+uint64_t HeifItems::Offset(const HeifItem& item) const {
+	if (item.extents.empty()) return ~0ull;
+	auto part = Extent(item, item.extents[0]);
+	if (part.empty()) return ~0ull;
+	return static_cast<uint64_t>(part.data() - m_file.data());
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// ISOBMFF（HEIF・AVIF・JPEG XLのコンテナ）のボックス
+struct IsobmffBox {
+	std::string_view type;
+	std::span<const uint8_t> box;	// 見出しを含むボックス全体
+	std::span<const uint8_t> body;	// 中身
+};
+
+// pos の位置のボックスを読む（見出しが壊れている・範囲外なら false）
+bool read_box(std::span<const uint8_t> data, size_t pos, IsobmffBox& box);
+
+// 並んだボックスを順に渡す（visit が false を返したら止める）
+void walk_boxes(std::span<const uint8_t> data,
+	const std::function<bool(std::string_view type, std::span<const uint8_t> box, std::span<const uint8_t> body)>& visit);
+
+// トップレベルのボックスの索引
+// 探しているボックスが見つかるところまでしか見出しを辿らない（mdat などの中身には触れない）
+class BoxIndex {
+public:
+	explicit BoxIndex(std::span<const uint8_t> data) : m_data(data) {}
+
+	// 最初に見つかった type のボックス（無ければ nullptr）
+	const IsobmffBox* Find(std::string_view type);
+
+private:
+	std::span<const uint8_t> m_data;
+	std::vector<IsobmffBox> m_boxes;	// 辿り終えたボックス
+	size_t m_pos = 0;					// 次に読む位置
+	bool m_end = false;
+};
+
+// HEIF・AVIFの項目の範囲
+struct HeifExtent {
+	uint64_t offset;
+	uint64_t length;	// 0 はデータの終わりまで
+};
+
+// HEIF・AVIFの項目（EXIFは 'Exif'、XMPは 'mime' で Content-Type が application/rdf+xml）
+struct HeifItem {
+	uint32_t id = 0;
+	std::string_view type;
+	std::string_view contentType;
+	uint8_t construction = 0;	// 0: ファイル内の位置、1: idatボックス内の位置（それ以外は読まない）
+	uint64_t baseOffset = 0;
+	std::vector<HeifExtent> extents;
+};
+
+// metaボックスの iinf（項目の種類）と iloc（項目の位置）から作る項目の一覧
+// 画像の符号化データは読まず、中身は Payload() で範囲を直接指す
+class HeifItems {
+public:
+	explicit HeifItems(std::span<const uint8_t> file);
+
+	const std::vector<HeifItem>& Items() const { return m_items; }
+
+	// 項目の中身（範囲が1つならファイルを直接指し、複数なら buffer につないで返す。範囲外なら空）
+	std::span<const uint8_t> Payload(const HeifItem& item, std::vector<uint8_t>& buffer) const;
+
+	// 項目の先頭のファイル内の位置（不明なら ~0ull）
+	uint64_t Offset(const HeifItem& item) const;
+
+private:
+	void ReadInfo(std::span<const uint8_t> iinf);
+	void ReadLocations(std::span<const uint8_t> iloc);
+	std::span<const uint8_t> Extent(const HeifItem& item, const HeifExtent& extent) const;
+
+	std::span<const uint8_t> m_file;
+	std::span<const uint8_t> m_idat;
+	std::vector<HeifItem> m_items;
+};
@@ -0,0 +1,313 @@
+﻿#include "JsonTokenizer.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PV_JSON_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// 64バイト分の文字種ごとのビットマスク
+struct BlockMasks {
+	uint64_t backslash;
+	uint64_t quote;
+	uint64_t op;			// { } [ ] : ,
+	uint64_t whitespace;
+};
+
+#ifdef PV_JSON_SSE2
+inline uint64_t MatchMask(const __m128i chunks[4], char c) {
+	const __m128i v = _mm_set1_epi8(c);
+	uint64_t m0 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[0], v)));
+	uint64_t m1 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[1], v)));
+	uint64_t m2 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[2], v)));
+	uint64_t m3 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[3], v)));
+	return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+BlockMasks Classify(const uint8_t* p) {
+	__m128i chunks[4];
+	for (int i = 0; i < 4; ++i) {
+		chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+	}
+	BlockMasks m;
+	m.backslash = MatchMask(chunks, '\\');
+	m.quote = MatchMask(chunks, '"');
+	m.op = MatchMask(chunks, '{') | MatchMask(chunks, '}') | MatchMask(chunks, '[') | MatchMask(chunks, ']') |
+		MatchMask(chunks, ':') | MatchMask(chunks, ',');
+	m.whitespace = MatchMask(chunks, ' ') | MatchMask(chunks, '\t') | MatchMask(chunks, '\n') | MatchMask(chunks, '\r');
+	return m;
+}
+#else
+BlockMasks Classify(const uint8_t* p) {
+	BlockMasks m = {};
+	for (int i = 0; i < 64; ++i) {
+		uint64_t bit = uint64_t(1) << i;
+		switch (p[i]) {
+		case '\\': m.backslash |= bit; break;
+		case '"': m.quote |= bit; break;
+		case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+		case ' ': case '\t': case '\n': case '\r': m.whitespace |= bit; break;
+		}
+	}
+	return m;
+}
+#endif
+
+// ビットごとの累積XOR（引用符の間を1にする）
+inline uint64_t PrefixXor(uint64_t x) {
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+inline bool AddOverflow(uint64_t a, uint64_t b, uint64_t* result) {
+	*result = a + b;
+	return *result < a;
+}
+
+inline int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+// バックスラッシュでエスケープされている文字のマスク（奇数個の連続の直後）
+uint64_t FindEscaped(uint64_t backslash, uint64_t& prevEscaped) {
+	backslash &= ~prevEscaped;
+	uint64_t followsEscape = backslash << 1 | prevEscaped;
+
+	const uint64_t evenBits = 0x5555555555555555ULL;
+	uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+	uint64_t sequencesStartingOnEvenBits;
+	prevEscaped = AddOverflow(oddSequenceStarts, backslash, &sequencesStartingOnEvenBits) ? 1 : 0;
+	uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+
+	return (evenBits ^ invertMask) & followsEscape;
+}
+
+inline bool IsScalarChar(char c) {
+	switch (c) {
+	case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+	case ' ': case '\t': case '\n': case '\r':
+		return false;
+	default:
+		return true;
+	}
+}
+
+void AppendUtf8(std::string& out, uint32_t cp) {
+	if (cp < 0x80) {
+		out += static_cast<char>(cp);
+	} else if (cp < 0x800) {
+		out += static_cast<char>(0xC0 | (cp >> 6));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		out += static_cast<char>(0xE0 | (cp >> 12));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else {
+		out += static_cast<char>(0xF0 | (cp >> 18));
+		out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+// \uXXXX の16進4桁（不正なら -1）
+int ReadHex4(std::string_view s, size_t pos) {
+	if (pos + 4 > s.size()) return -1;
+	int value = 0;
+	for (size_t i = pos; i < pos + 4; ++i) {
+		char c = s[i];
+		int digit;
+		if (c >= '0' && c <= '9') digit = c - '0';
+		else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+		else return -1;
+		value = value * 16 + digit;
+	}
+	return value;
+}
+
+// 前後の空白を除いた先頭と末尾が {} または [] の組か
+bool LooksLikeJson(std::string_view s) {
+	size_t start = s.find_first_not_of(" \t\r\n");
+	if (start == std::string_view::npos) return false;
+	size_t end = s.find_last_not_of(" \t\r\n");
+	char first = s[start];
+	char last = s[end];
+	return end > start && ((first == '{' && last == '}') || (first == '[' && last == ']'));
+}
+
+} // namespace
+
+bool JsonTokenizer::FindStructurals(std::string_view json, std::vector<uint32_t>& positions) {
+	positions.clear();
+	positions.reserve(json.size() / 4);
+
+	uint64_t prevEscaped = 0;
+	uint64_t prevInString = 0;	// 直前のブロックが文字列の途中で終わったら全ビット1
+	uint64_t prevScalar = 0;
+
+	uint8_t tail[64];
+	for (size_t base = 0; base < json.size(); base += 64) {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(json.data()) + base;
+		size_t n = json.size() - base;
+		if (n < 64) {
+			// 末尾は空白で埋めて1ブロックにする
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, p, n);
+			p = tail;
+		}
+
+		BlockMasks m = Classify(p);
+		uint64_t escaped = FindEscaped(m.backslash, prevEscaped);
+		uint64_t quote = m.quote & ~escaped;
+		uint64_t inString = PrefixXor(quote) ^ prevInString;
+		prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+		// 文字列の外のスカラー（数値・リテラル）の先頭
+		uint64_t scalar = ~(m.op | m.whitespace | quote) & ~inString;
+		uint64_t scalarStart = scalar & ~((scalar << 1) | prevScalar);
+		prevScalar = scalar >> 63;
+
+		uint64_t structurals = (m.op & ~inString) | quote | scalarStart;
+		while (structurals) {
+			positions.push_back(static_cast<uint32_t>(base + CountTrailingZeros(structurals)));
+			structurals &= structurals - 1;
+		}
+	}
+
+	return prevInString == 0;
+}
+
+bool JsonTokenizer::Tokenize(std::string_view json, std::vector<JsonToken>& tokens) {
+	tokens.clear();
+	std::vector<uint32_t> positions;
+	if (!FindStructurals(json, positions)) return false;
+	tokens.reserve(positions.size());
+
+	// 開いている括弧と、オブジェクト内で次にキーが来るか
+	std::vector<char> stack;
+	bool expectKey = false;
+
+	for (size_t i = 0; i < positions.size(); ++i) {
+		uint32_t pos = positions[i];
+		char c = json[pos];
+		JsonToken token = { JsonTokenType::Scalar, false, false, pos, 1 };
+
+		switch (c) {
+		case '{':
+		case '[':
+			token.type = c == '{' ? JsonTokenType::BeginObject : JsonTokenType::BeginArray;
+			stack.push_back(c);
+			expectKey = c == '{';
+			break;
+		case '}':
+		case ']':
+			if (stack.empty() || stack.back() != (c == '}' ? '{' : '[')) return false;
+			token.type = c == '}' ? JsonTokenType::EndObject : JsonTokenType::EndArray;
+			stack.pop_back();
+			expectKey = false;
+			break;
+		case ':':
+			token.type = JsonTokenType::Colon;
+			break;
+		case ',':
+			token.type = JsonTokenType::Comma;
+			expectKey = !stack.empty() && stack.back() == '{';
+			break;
+		case '"': {
+			// 次の構造文字が閉じ引用符
+			if (i + 1 >= positions.size() || json[positions[i + 1]] != '"') return false;
+			uint32_t end = positions[++i];
+			token.type = JsonTokenType::String;
+			token.offset = pos + 1;
+			token.length = end - pos - 1;
+			std::string_view content = json.substr(token.offset, token.length);
+			token.escaped = content.find('\\') != std::string_view::npos;
+			token.embedded = !expectKey && LooksLikeJson(content);
+			expectKey = false;
+			break;
+		}
+		default: {
+			size_t end = pos;
+			while (end < json.size() && IsScalarChar(json[end])) ++end;
+			token.length = static_cast<uint32_t>(end - pos);
+			break;
+		}
+		}
+		tokens.push_back(token);
+	}
+	return stack.empty();
+}
+
+bool JsonTokenizer::IsValid(std::string_view json) {
+	if (!LooksLikeJson(json)) return false;
+	std::vector<JsonToken> tokens;
+	return Tokenize(json, tokens) && !tokens.empty();
+}
+
+std::string json_unescape(std::string_view raw) {
+	std::string out;
+	out.reserve(raw.size());
+	for (size_t i = 0; i < raw.size(); ++i) {
+		char c = raw[i];
+		if (c != '\\' || i + 1 >= raw.size()) {
+			out += c;
+			continue;
+		}
+		char e = raw[++i];
+		switch (e) {
+		case '"': out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '/': out += '/'; break;
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u': {
+			int unit = ReadHex4(raw, i + 1);
+			if (unit < 0) {
+				AppendUtf8(out, 0xFFFD);
+				break;
+			}
+			i += 4;
+			uint32_t cp = static_cast<uint32_t>(unit);
+			if (cp >= 0xD800 && cp <= 0xDBFF) {
+				// 上位サロゲートの後に下位サロゲートが続く場合だけ結合する
+				int low = (i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u') ? ReadHex4(raw, i + 3) : -1;
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				} else {
+					cp = 0xFFFD;
+				}
+			} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+				cp = 0xFFFD;
+			}
+			AppendUtf8(out, cp);
+			break;
+		}
+		default:
+			out += e;
+			break;
+		}
+	}
+	return out;
+}
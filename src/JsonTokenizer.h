@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class JsonTokenType : uint8_t {
+	BeginObject,
+	EndObject,
+	BeginArray,
+	EndArray,
+	Colon,
+	Comma,
+	String,		// offset/length は引用符の内側（エスケープはそのまま）
+	Scalar,		// 数値・true・false・null
+};
+
+struct JsonToken {
+	JsonTokenType type;
+	bool escaped;	// 文字列にバックスラッシュを含む
+	bool embedded;	// 文字列の中身がJSONの可能性がある（{...} または [...]）
+	uint32_t offset;
+	uint32_t length;
+};
+
+// JSONのトークナイザー
+// simdjsonのstage 1と同じ要領で64バイトごとにビットマスクを作り、
+// 文字列の外にある構造文字・文字列の引用符・スカラーの先頭の位置を求める
+class JsonTokenizer {
+public:
+	// 構造文字の位置を列挙する（閉じていない文字列があれば false）
+	static bool FindStructurals(std::string_view json, std::vector<uint32_t>& positions);
+
+	// トークン列にする（括弧の対応やキーと値の並びが壊れていれば false）
+	static bool Tokenize(std::string_view json, std::vector<JsonToken>& tokens);
+
+	// 妥当なJSONの配列・オブジェクトか
+	static bool IsValid(std::string_view json);
+};
+
+// 文字列トークンの中身をアンエスケープする（\uXXXXとサロゲートペアに対応、不正な値はU+FFFD）
+std::string json_unescape(std::string_view raw);
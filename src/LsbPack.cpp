@@ -0,0 +1,230 @@
+﻿#include "LsbPack.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PV_LSB_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PV_TARGET_AVX2
+#else
+#define PV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+// 8行ぶんのブロックを処理する関数
+// rows[r] のx列目の画素から1バイト（r=0がMSB）を作り、out[x * colBytes] に書く
+typedef size_t (*BlockFunc)(const uint8_t* const rows[8], size_t width, size_t channel, uint8_t* out, size_t colBytes);
+
+size_t PackBlockScalar(const uint8_t* const rows[8], size_t width, size_t channel, uint8_t* out, size_t colBytes) {
+	for (size_t x = 0; x < width; ++x) {
+		size_t offset = x * 4 + channel;
+		uint8_t b = 0;
+		for (int r = 0; r < 8; ++r) {
+			b |= (rows[r][offset] & 1) << (7 - r);
+		}
+		out[x * colBytes] = b;
+	}
+	return width;
+}
+
+#ifdef PV_LSB_X86
+
+// 16画素ぶんのLSBを 0/1 のバイト列にする
+inline __m128i LoadBits16(const uint8_t* p, __m128i shift, __m128i one) {
+	__m128i a0 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), shift), one);
+	__m128i a1 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), shift), one);
+	__m128i a2 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), shift), one);
+	__m128i a3 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), shift), one);
+	return _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+}
+
+size_t PackBlockSSE2(const uint8_t* const rows[8], size_t width, size_t channel, uint8_t* out, size_t colBytes) {
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(channel * 8));
+	const __m128i one = _mm_set1_epi32(1);
+	alignas(16) uint8_t bytes[16];
+
+	size_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		__m128i acc = _mm_setzero_si128();
+		for (int r = 0; r < 8; ++r) {
+			// 値は0/1なので16ビット単位でずらしても隣のバイトへ溢れない
+			__m128i bits = LoadBits16(rows[r] + x * 4, shift, one);
+			acc = _mm_or_si128(acc, _mm_sll_epi16(bits, _mm_cvtsi32_si128(7 - r)));
+		}
+		_mm_store_si128(reinterpret_cast<__m128i*>(bytes), acc);
+		for (size_t j = 0; j < 16; ++j) {
+			out[(x + j) * colBytes] = bytes[j];
+		}
+	}
+	return x;
+}
+
+PV_TARGET_AVX2
+size_t PackBlockAVX2(const uint8_t* const rows[8], size_t width, size_t channel, uint8_t* out, size_t colBytes) {
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(channel * 8));
+	const __m256i one = _mm256_set1_epi32(1);
+	// packs/packus は128ビットレーン単位なので最後に並べ替える
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	alignas(32) uint8_t bytes[32];
+
+	size_t x = 0;
+	for (; x + 32 <= width; x += 32) {
+		__m256i acc = _mm256_setzero_si256();
+		for (int r = 0; r < 8; ++r) {
+			const uint8_t* p = rows[r] + x * 4;
+			__m256i a0 = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), shift), one);
+			__m256i a1 = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), shift), one);
+			__m256i a2 = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)), shift), one);
+			__m256i a3 = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96)), shift), one);
+			__m256i bits = _mm256_packus_epi16(_mm256_packs_epi32(a0, a1), _mm256_packs_epi32(a2, a3));
+			acc = _mm256_or_si256(acc, _mm256_sll_epi16(bits, _mm_cvtsi32_si128(7 - r)));
+		}
+		acc = _mm256_permutevar8x32_epi32(acc, order);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(bytes), acc);
+		for (size_t j = 0; j < 32; ++j) {
+			out[(x + j) * colBytes] = bytes[j];
+		}
+	}
+	return x;
+}
+
+bool CpuHasAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // PV_LSB_X86
+
+BlockFunc GetBlockFunc(LsbKernel kernel) {
+	switch (kernel) {
+#ifdef PV_LSB_X86
+	case LsbKernel::SSE2: return PackBlockSSE2;
+	case LsbKernel::AVX2: return PackBlockAVX2;
+#endif
+	default: return PackBlockScalar;
+	}
+}
+
+// 列ごとにバイト境界で揃えたビット列を、隙間なく連結し直す
+void ConcatColumns(const std::vector<uint8_t>& padded, size_t width, size_t height, size_t colBytes, uint8_t* out) {
+	size_t bitPos = 0;
+	for (size_t x = 0; x < width; ++x) {
+		const uint8_t* col = padded.data() + x * colBytes;
+		size_t remaining = height;
+		for (size_t i = 0; i < colBytes; ++i) {
+			size_t bits = remaining < 8 ? remaining : 8;
+			uint8_t b = static_cast<uint8_t>(col[i] & (0xFF00 >> bits));
+			size_t index = bitPos >> 3;
+			size_t shift = bitPos & 7;
+			out[index] |= static_cast<uint8_t>(b >> shift);
+			if (shift + bits > 8) out[index + 1] |= static_cast<uint8_t>(b << (8 - shift));
+			bitPos += bits;
+			remaining -= bits;
+		}
+	}
+}
+
+} // namespace
+
+LsbKernel resolve_lsb_kernel(LsbKernel kernel) {
+#ifdef PV_LSB_X86
+	static const bool hasAVX2 = CpuHasAVX2();
+	if (kernel == LsbKernel::Auto) return hasAVX2 ? LsbKernel::AVX2 : LsbKernel::SSE2;
+	if (kernel == LsbKernel::AVX2 && !hasAVX2) return LsbKernel::SSE2;
+	return kernel;
+#else
+	return LsbKernel::Scalar;
+#endif
+}
+
+const char* lsb_kernel_name(LsbKernel kernel) {
+	switch (kernel) {
+	case LsbKernel::Scalar: return "scalar";
+	case LsbKernel::SSE2: return "sse2";
+	case LsbKernel::AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+
+std::vector<uint8_t> pack_lsb_column_major(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height,
+	size_t channel, LsbKernel kernel) {
+	std::vector<uint8_t> result((width * height + 7) / 8);
+	if (width == 0 || height == 0) return result;
+
+	BlockFunc block = GetBlockFunc(resolve_lsb_kernel(kernel));
+
+	// 高さが8の倍数なら列の境界がバイト境界と一致するので直接書き込める
+	size_t colBytes = (height + 7) / 8;
+	bool aligned = (height % 8) == 0;
+	std::vector<uint8_t> padded;
+	if (!aligned) padded.resize(width * colBytes);
+	uint8_t* out = aligned ? result.data() : padded.data();
+
+	size_t y = 0;
+	for (; y + 8 <= height; y += 8) {
+		const uint8_t* rows[8];
+		for (int r = 0; r < 8; ++r) {
+			rows[r] = pixels + static_cast<ptrdiff_t>(y + r) * stride;
+		}
+		uint8_t* dst = out + y / 8;
+		size_t done = block(rows, width, channel, dst, colBytes);
+		if (done < width) {
+			const uint8_t* tail[8];
+			for (int r = 0; r < 8; ++r) tail[r] = rows[r] + done * 4;
+			PackBlockScalar(tail, width - done, channel, dst + done * colBytes, colBytes);
+		}
+	}
+
+	// 8行に満たない残りの行
+	if (y < height) {
+		size_t rest = height - y;
+		uint8_t* dst = out + y / 8;
+		for (size_t x = 0; x < width; ++x) {
+			uint8_t b = 0;
+			for (size_t r = 0; r < rest; ++r) {
+				const uint8_t* row = pixels + static_cast<ptrdiff_t>(y + r) * stride;
+				b |= (row[x * 4 + channel] & 1) << (7 - r);
+			}
+			dst[x * colBytes] = b;
+		}
+	}
+
+	if (!aligned) ConcatColumns(padded, width, height, colBytes, result.data());
+	return result;
+}
+
+void pack_lsb_column_major_rgba(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height, size_t red,
+	std::vector<uint8_t>* alpha, std::vector<uint8_t>* rgb) {
+	if (alpha) *alpha = pack_lsb_column_major(pixels, stride, width, height, 3);
+	if (!rgb) return;
+	rgb->assign((width * height * 3 + 7) / 8, 0);
+
+	// 行の順に読み、列優先のビット位置に書く（出力は入力の1/8〜3/8なのでキャッシュに収まりやすい）
+	const size_t blue = 2 - red;
+	for (size_t y = 0; y < height; ++y) {
+		const uint8_t* row = pixels + static_cast<ptrdiff_t>(y) * stride;
+		for (size_t x = 0; x < width; ++x) {
+			const uint8_t* p = row + x * 4;
+			size_t rgbBit = (x * height + y) * 3;
+			for (size_t channel : {red, size_t(1), blue}) {
+				if (p[channel] & 1) (*rgb)[rgbBit >> 3] |= static_cast<uint8_t>(0x80 >> (rgbBit & 7));
+				++rgbBit;
+			}
+		}
+	}
+}
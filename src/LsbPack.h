@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LSB抽出カーネルの種類（Auto は実行時にCPUを見て選ぶ）
+enum class LsbKernel {
+	Auto,
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+// 4バイト/画素のスキャンラインから指定チャンネルのLSBを取り出し、
+// 列優先（x外側・y内側）のビット列としてMSBから詰めたバイト列を返す
+// channel はBGRA/RGBAどちらでもアルファなら3
+std::vector<uint8_t> pack_lsb_column_major(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height,
+	size_t channel, LsbKernel kernel = LsbKernel::Auto);
+
+// 4バイト/画素のスキャンラインを1回だけ走査し、アルファのLSB（1画素1ビット）と
+// RGBのLSB（1画素3ビット、赤・緑・青の順）を同時に列優先のバイト列にする
+// red は赤のチャンネル（RGBAなら0、BGRAなら2）。要らない方は nullptr にする
+// アルファはカーネルで詰め、RGBは1画素ずつ詰める（RGBは必要な列だけを渡すこと）
+void pack_lsb_column_major_rgba(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height, size_t red,
+	std::vector<uint8_t>* alpha, std::vector<uint8_t>* rgb);
+
+// 実際に使われるカーネル
+LsbKernel resolve_lsb_kernel(LsbKernel kernel);
+const char* lsb_kernel_name(LsbKernel kernel);
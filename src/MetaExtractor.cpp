@@ -1,414 +1,337 @@
 ﻿#include "framework.h"
 #include "MetaExtractor.h"
 #include "TextUtils.h"
-#include <fstream>
+#include "ByteReader.h"
+#include "ExifReader.h"
+#include "XmpParser.h"
+#include "PngChunks.h"
+#include "FormatProbe.h"
+#include "Isobmff.h"
+#include "A1111Parser.h"
+#include "Trace.h"
+#include "Cancellation.h"
+#include <cstring>
+#include <span>
+#include <string_view>
 #include <vector>
 #include <algorithm>
-#include <map>
-
-// EXIFタグの定義
-enum ExifTag {
-	TAG_MAKE = 0x010F,
-	TAG_MODEL = 0x0110,
-	TAG_DATETIME = 0x0132,
-	TAG_EXPOSURETIME = 0x829A,
-	TAG_FNUMBER = 0x829D,
-	TAG_ISOSPEEDRATINGS = 0x8827,
-	TAG_FOCALLENGTH = 0x920A,
-	TAG_ARTIST = 0x013B,
-	TAG_COPYRIGHT = 0x8298,
-	TAG_SOFTWARE = 0x0131,
-	TAG_USERCOMMENT = 0x9286
-};
-
-// EXIFデータ型の定義
-enum ExifDataType {
-	TYPE_BYTE = 1,
-	TYPE_ASCII = 2,
-	TYPE_SHORT = 3,
-	TYPE_LONG = 4,
-	TYPE_RATIONAL = 5,
-	TYPE_UNDEFINED = 7,
-	TYPE_SLONG = 9,
-	TYPE_SRATIONAL = 10
-};
-
-// バイトオーダーを判定する関数
-static bool IsLittleEndian(const std::vector<char>& data, size_t offset) {
-	if (offset + 2 > data.size()) return false;
-	return (data[offset] == 'I' && data[offset + 1] == 'I');
-}
-
-// 16ビット値を読み込む関数
-static uint16_t ReadUInt16(const std::vector<char>& data, size_t offset, bool littleEndian) {
-	if (offset + 2 > data.size()) return 0;
-	uint16_t value;
-	memcpy(&value, &data[offset], 2);
-	return littleEndian ? value : _byteswap_ushort(value);
-}
 
-// 32ビット値を読み込む関数
-static uint32_t ReadUInt32(const std::vector<char>& data, size_t offset, bool littleEndian) {
-	if (offset + 4 > data.size()) return 0;
-	uint32_t value;
-	memcpy(&value, &data[offset], 4);
-	return littleEndian ? value : _byteswap_ulong(value);
-}
-
-// 有理数を読み込む関数
-static std::wstring ReadRational(const std::vector<char>& data, size_t offset, bool littleEndian) {
-	if (offset + 8 > data.size()) return L"";
-	uint32_t numerator = ReadUInt32(data, offset, littleEndian);
-	uint32_t denominator = ReadUInt32(data, offset + 4, littleEndian);
-
-	if (denominator == 0) return L"";
-
-	double value = static_cast<double>(numerator) / denominator;
-	wchar_t buffer[64];
-	swprintf_s(buffer, L"%.2f", value);
-	return std::wstring(buffer);
-}
-
-// ASCII文字列を読み込む関数
-static std::wstring ReadASCII(const std::vector<char>& data, size_t offset, size_t count) {
-	if (offset + count > data.size()) return L"";
-	std::string str(data.begin() + offset, data.begin() + offset + count);
-	// NULL文字を除去
-	if (!str.empty() && str.back() == '\0') {
-		str.pop_back();
+// XMPの項目を追加する（拡張XMPがあれば続けて読む）
+// 値は実体参照を展開したものなので、位置はパケットの先頭にする
+static void AppendXmp(MetaList& list, std::string_view xml, uint64_t offset, const ExtendedXmp* extended = nullptr) {
+	XmpProperties properties;
+	XmpParser::Parse(xml, properties);
+	if (extended && !properties.extendedGuid.empty()) {
+		std::string extendedXml = extended->Assemble(properties.extendedGuid);
+		if (!extendedXml.empty()) XmpParser::Parse(extendedXml, properties);
 	}
-	return utf8_to_unicode(str);
+	properties.fields.SetOffset(0, offset);
+	list.Append(std::move(properties.fields));
 }
 
-// EXIFタグ名を取得する関数
-static std::wstring GetTagName(uint16_t tag) {
-	static const std::map<uint16_t, std::wstring> tagNames = {
-		{TAG_MAKE, L"メーカー"},
-		{TAG_MODEL, L"モデル"},
-		{TAG_DATETIME, L"撮影日時"},
-		{TAG_EXPOSURETIME, L"露出時間"},
-		{TAG_FNUMBER, L"F値"},
-		{TAG_ISOSPEEDRATINGS, L"ISO感度"},
-		{TAG_FOCALLENGTH, L"焦点距離"},
-		{TAG_ARTIST, L"アーティスト"},
-		{TAG_COPYRIGHT, L"著作権"},
-		{TAG_SOFTWARE, L"ソフトウェア"},
-		{TAG_USERCOMMENT, L"ユーザーコメント"}
-	};
-
-	auto it = tagNames.find(tag);
-	return it != tagNames.end() ? it->second : L"タグ" + std::to_wstring(tag);
+// 指定されたキーか（指定が無ければ全て、キーはUTF-8）
+static bool IsWanted(const std::vector<std::string>& keys, std::string_view key) {
+	return keys.empty() || std::find(keys.begin(), keys.end(), key) != keys.end();
 }
 
-// EXIFデータを解析する関数
-static std::wstring ParseExifValue(const std::vector<char>& data, size_t offset, uint16_t dataType, uint32_t count, bool littleEndian) {
-	switch (dataType) {
-		case TYPE_BYTE:
-			if (count == 1 && offset < data.size()) {
-				return std::to_wstring(static_cast<uint8_t>(data[offset]));
-			}
-			break;
-
-		case TYPE_ASCII:
-			return ReadASCII(data, offset, count);
-
-		case TYPE_SHORT:
-			if (count == 1) {
-				return std::to_wstring(ReadUInt16(data, offset, littleEndian));
-			}
-			break;
-
-		case TYPE_LONG:
-			if (count == 1) {
-				return std::to_wstring(ReadUInt32(data, offset, littleEndian));
-			}
-			break;
-
-		case TYPE_RATIONAL:
-			if (count == 1) {
-				return ReadRational(data, offset, littleEndian);
-			}
-			break;
-
-		case TYPE_UNDEFINED:
-			if (count <= 4) {
-				std::wstring result = L"";
-				for (uint32_t i = 0; i < count && offset + i < data.size(); ++i) {
-					if (i > 0) result += L" ";
-					result += std::to_wstring(static_cast<uint8_t>(data[offset + i]));
-				}
-				return result;
-			}
-			break;
-	}
+// A1111の設定の項目のキーの接頭辞（"parameters.Seed" など）
+static constexpr std::string_view A1111_KEY_PREFIX = "parameters.";
 
-	return L"";
+// A1111の設定の項目を求められているか
+static bool WantsA1111(const std::vector<std::string>& keys) {
+	return keys.empty() || std::any_of(keys.begin(), keys.end(), [](const auto& key) { return key.starts_with(A1111_KEY_PREFIX); });
 }
 
-// EXIFチャンクを解析する関数
-static info_list ReadExifChunk(std::ifstream& file, size_t chunk_size) {
-	info_list list;
-
-	// チャンクデータを読み込む
-	std::vector<char> data(chunk_size);
-	file.read(data.data(), chunk_size);
-
-	if (data.size() < 8) return list;
-
-	// バイトオーダーを判定
-	bool littleEndian = IsLittleEndian(data, 0);
-
-	// TIFFマジックナンバーを確認
-	uint16_t magic = ReadUInt16(data, 2, littleEndian);
-	if (magic != 0x2A) return list;
-
-	// 最初のIFDオフセットを読み込む
-	uint32_t ifdOffset = ReadUInt32(data, 4, littleEndian);
-
-	// IFDを解析
-	while (ifdOffset > 0 && ifdOffset + 2 < data.size()) {
-		// IFDエントリ数を読み込む
-		uint16_t entryCount = ReadUInt16(data, ifdOffset, littleEndian);
-
-		if (entryCount > 1000) break; // 異常値の場合は終了
-
-		// 各エントリを解析
-		for (uint16_t i = 0; i < entryCount; ++i) {
-			size_t entryOffset = ifdOffset + 2 + i * 12;
-			if (entryOffset + 12 > data.size()) break;
-
-			// タグ、データ型、カウント、値を読み込む
-			uint16_t tag = ReadUInt16(data, entryOffset, littleEndian);
-			uint16_t dataType = ReadUInt16(data, entryOffset + 2, littleEndian);
-			uint32_t count = ReadUInt32(data, entryOffset + 4, littleEndian);
-			uint32_t value = ReadUInt32(data, entryOffset + 8, littleEndian);
-
-			// データサイズを計算
-			size_t dataSize = 0;
-			switch (dataType) {
-				case TYPE_BYTE: dataSize = 1; break;
-				case TYPE_ASCII: dataSize = 1; break;
-				case TYPE_SHORT: dataSize = 2; break;
-				case TYPE_LONG: dataSize = 4; break;
-				case TYPE_RATIONAL: dataSize = 8; break;
-				case TYPE_UNDEFINED: dataSize = 1; break;
-				default: continue;
-			}
-
-			std::wstring tagValue;
-			if (count * dataSize <= 4) {
-				// 値が4バイト以内の場合は直接値として扱う
-				tagValue = ParseExifValue(data, entryOffset + 8, dataType, count, littleEndian);
-			} else {
-				// 値が4バイトを超える場合はオフセットとして扱う
-				if (value < data.size()) {
-					tagValue = ParseExifValue(data, value, dataType, count, littleEndian);
-				}
-			}
-
-			if (!tagValue.empty()) {
-				list.push_back(std::make_pair(GetTagName(tag), tagValue));
-			}
-		}
-
-		// 次のIFDオフセットを読み込む
-		size_t nextIfdOffset = ifdOffset + 2 + entryCount * 12;
-		if (nextIfdOffset + 4 <= data.size()) {
-			ifdOffset = ReadUInt32(data, nextIfdOffset, littleEndian);
-		} else {
-			break;
-		}
-	}
-
-	return list;
+// ファイル内の位置
+static uint64_t OffsetOf(std::span<const uint8_t> data, std::span<const uint8_t> part) {
+	return static_cast<uint64_t>(part.data() - data.data());
 }
 
-static info_list ExtractFromPNG(const std::wstring& filePath) {
-	info_list list;
-	std::ifstream file(filePath, std::ios::binary);
-
-	if (!file) {
-		return list;
-	}
-
-	// PNGシグネチャの確認
-	uint8_t signature[8];
-	file.read(reinterpret_cast<char*>(signature), 8);
-	if (memcmp(signature, "\x89PNG\r\n\x1a\n", 8) != 0) {
-		return list;
-	}
-
-	// チャンクの読み込み
-	while (file) {
-		// チャンクの長さを読み込む
-		uint32_t chunk_length;
-		file.read(reinterpret_cast<char*>(&chunk_length), 4);
-		chunk_length = _byteswap_ulong(chunk_length);  // ビッグエンディアンから変換
-
-		// チャンクタイプを読み込む
-		char chunk_type[4];
-		file.read(chunk_type, 4);
-
-		// IENDチャンクが見つかったら終了
-		if (memcmp(chunk_type, "IEND", 4) == 0) {
-			break;
+static MetaList ExtractFromPNG(const ImageBuffer& image, const std::vector<std::string>& keys) {
+	TRACE_SCOPE("ExtractFromPNG");
+	MetaList list;
+	auto data = image.span();
+
+	PngChunkIndex index(data);
+	if (!index.Valid()) return list;
+
+	std::string value;
+	for (const auto& text : index.TextChunks()) {
+		if (CancellationToken::Current().ShouldStop()) break;
+		bool xmp = text.keyword == "XML:com.adobe.xmp";
+		if (xmp ? !keys.empty() && std::none_of(keys.begin(), keys.end(), [](const auto& key) { return key.find(':') != std::string::npos; })
+			: !IsWanted(keys, text.keyword) && !(text.keyword == "parameters" && WantsA1111(keys))) continue;
+		uint64_t offset = OffsetOf(data, text.text);
+
+		// 圧縮されていない値はファイルを直接参照する
+		if (!text.compressed && !xmp) {
+			std::string_view raw(reinterpret_cast<const char*>(text.text.data()), text.text.size());
+			list.AddView(text.keyword, raw, image.Owner(), MetaType::Text, offset);
+			continue;
 		}
 
-		if (memcmp(chunk_type, "tEXt", 4) != 0) {
-			// tEXtチャンク以外はスキップ
-			file.seekg(chunk_length + 4, std::ios::cur);
+		// 圧縮されたチャンク（zTXt/iTXt）は必要なものだけここで展開する
+		auto status = text.Value(value);
+		if (status == InflateStatus::TooLarge) {
+			list.Add(utf8_to_unicode(text.keyword), L"展開サイズが上限を超えています", MetaType::Error, offset);
+			continue;
+		}
+		if (status != InflateStatus::Ok) {
+			list.Add(utf8_to_unicode(text.keyword), L"展開失敗", MetaType::Error, offset);
 			continue;
 		}
 
-		// チャンクデータを読み込む
-		std::vector<uint8_t> chunk;
-		chunk.resize(chunk_length);
-		file.read(reinterpret_cast<char*>(chunk.data()), chunk_length);
-
-		// CRCをスキップ
-		file.seekg(4, std::ios::cur);
-
-		std::string data(reinterpret_cast<const char*>(chunk.data()), chunk.size());
-
-		// tEXtチャンクは "keyword\0text" 形式なので、最初のNULL文字で分割
-		auto null_pos = data.find('\0');
-		if (null_pos == std::string::npos) continue;
-		auto keyword = data.substr(0, null_pos);
-		auto text = data.substr(null_pos + 1);
-
-		list.push_back(std::make_pair(utf8_to_unicode(keyword), utf8_to_unicode(text)));
+		if (xmp) {
+			AppendXmp(list, value, offset);
+		} else {
+			list.Add(text.keyword, std::move(value), MetaType::Text, offset);
+		}
 	}
-	file.close();
 	return list;
 }
 
+// JPEGのAPP1でXMPを示す名前空間（NULL終端込み）
+static constexpr std::string_view XMP_SIGNATURE{"http://ns.adobe.com/xap/1.0/\0", 29};
+static constexpr std::string_view XMP_EXTENSION_SIGNATURE{"http://ns.adobe.com/xmp/extension/\0", 35};
 
-
-static info_list ExtractFromJPEG(const std::wstring& filePath) {
-	info_list list;
-
-	std::ifstream file(filePath, std::ios::binary);
-	if (!file) {
-		return list;
-	}
+static MetaList ExtractFromJPEG(std::span<const uint8_t> data) {
+	TRACE_SCOPE("ExtractFromJPEG");
+	MetaList list;
 
 	// JPEGファイルの先頭を確認
-	uint8_t header[2];
-	file.read(reinterpret_cast<char*>(header), 2);
-	if (header[0] != 0xFF || header[1] != 0xD8) {
+	if (data.size() < 2 || data[0] != 0xFF || data[1] != 0xD8) {
 		return list;  // JPEGファイルではない
 	}
 
-	while (file) {
-		uint8_t marker[2];
-		file.read(reinterpret_cast<char*>(marker), 2);
+	std::string_view xmp;
+	ExtendedXmp extended;
 
+	size_t pos = 2;
+	while (pos + 2 <= data.size()) {
 		// マーカーの確認
-		if (marker[0] != 0xFF) {
+		if (data[pos] != 0xFF) {
 			break;
 		}
+		uint8_t marker = data[pos + 1];
+		if (marker == 0xFF) {  // フィルバイト
+			++pos;
+			continue;
+		}
+		if (marker == 0xDA || marker == 0xD9) {  // SOSマーカー（画像データの開始）
+			break;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {  // 長さを持たないマーカー
+			pos += 2;
+			continue;
+		}
+
+		// セグメントサイズを読み込む（ビッグエンディアン）
+		if (pos + 4 > data.size()) break;
+		uint16_t size = read_be16(&data[pos + 2]);
+		if (size < 2 || pos + 2 + size > data.size()) break;
+		auto segment = data.subspan(pos + 4, size - 2);
+		pos += 2 + size;
 
 		// APP1マーカー（Exif）を探す
-		if (marker[1] == 0xE1) {
-			// セグメントサイズを読み込む
-			uint16_t size;
-			file.read(reinterpret_cast<char*>(&size), 2);
-			size = _byteswap_ushort(size);  // ビッグエンディアンから変換
-
-			// Exifヘッダーを確認
-			char exif_header[6];
-			file.read(exif_header, 6);
-			if (memcmp(exif_header, "Exif\0\0", 6) == 0) {
-				auto exifInfo = ReadExifChunk(file, size - 8);
-				list.insert(list.end(), exifInfo.begin(), exifInfo.end());
-			}
+		if (marker == 0xE1 && segment.size() >= 6 && memcmp(segment.data(), "Exif\0\0", 6) == 0) {
+			auto tiff = segment.subspan(6);
+			list.Append(ExifReader::Read(tiff, OffsetOf(data, tiff)));
 		}
-		else if (marker[1] == 0xDA) {  // SOSマーカー（画像データの開始）
-			break;
+
+		// APP1マーカー（XMP・拡張XMP）
+		if (marker == 0xE1 && segment.size() >= XMP_SIGNATURE.size() &&
+			memcmp(segment.data(), XMP_SIGNATURE.data(), XMP_SIGNATURE.size()) == 0) {
+			auto packet = segment.subspan(XMP_SIGNATURE.size());
+			xmp = std::string_view(reinterpret_cast<const char*>(packet.data()), packet.size());
 		}
-		else {
-			// その他のマーカーはスキップ
-			uint16_t size;
-			file.read(reinterpret_cast<char*>(&size), 2);
-			size = _byteswap_ushort(size);
-			file.seekg(size - 2, std::ios::cur);
+		if (marker == 0xE1 && segment.size() >= XMP_EXTENSION_SIGNATURE.size() &&
+			memcmp(segment.data(), XMP_EXTENSION_SIGNATURE.data(), XMP_EXTENSION_SIGNATURE.size()) == 0) {
+			extended.AddSegment(segment.subspan(XMP_EXTENSION_SIGNATURE.size()));
 		}
 	}
 
+	// 拡張XMPは本体の後ろにあることが多いので、全セグメントを見てから読む
+	if (!xmp.empty()) AppendXmp(list, xmp, static_cast<uint64_t>(xmp.data() - reinterpret_cast<const char*>(data.data())), &extended);
+
 	return list;
 }
 
 // Webp画像のプロンプト抽出
-static info_list ExtractFromWEBP(const std::wstring& filePath) {
-	info_list list;
-
-	std::ifstream file(filePath, std::ios::binary);
-	if (!file) {
-		return list;
-	}
+static MetaList ExtractFromWEBP(std::span<const uint8_t> data) {
+	TRACE_SCOPE("ExtractFromWEBP");
+	MetaList list;
 
 	// WebPファイルの先頭を確認
-	char header[4];
-	file.read(header, 4);
-	if (memcmp(header, "RIFF", 4) != 0) {
+	if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0) {
 		return list;  // WebPファイルではない
 	}
 
-	// ファイルサイズを読み込む
-	uint32_t fileSize;
-	file.read(reinterpret_cast<char*>(&fileSize), 4);
-	fileSize = _byteswap_ulong(fileSize);  // リトルエンディアンから変換
-
 	// WebPシグネチャを確認
-	char webp_header[4];
-	file.read(webp_header, 4);
-	if (memcmp(webp_header, "WEBP", 4) != 0) {
+	if (memcmp(&data[8], "WEBP", 4) != 0) {
 		return list;
 	}
 
-	// チャンクを探す
-	while (file) {
-		char chunk_header[5]; chunk_header[4] = '\0';
-		file.read(chunk_header, 4);
-		if (file.eof()) break;
+	// RIFFサイズ（リトルエンディアン）で走査範囲を制限
+	size_t riff_end = std::min<size_t>(data.size(), static_cast<size_t>(read_le32(&data[4])) + 8);
 
-		// チャンクサイズを読み込む
-		uint32_t chunk_size;
-		file.read(reinterpret_cast<char*>(&chunk_size), 4);
+	// チャンクを探す
+	size_t pos = 12;
+	while (pos + 8 <= riff_end) {
+		const uint8_t* chunk_header = &data[pos];
+		uint32_t chunk_size = read_le32(&data[pos + 4]);
+		size_t chunk_start = pos + 8;
+		if (chunk_size > riff_end - chunk_start) break;
+		auto chunk = data.subspan(chunk_start, chunk_size);
+		pos = chunk_start + chunk_size + (chunk_size & 1); // 奇数長はパディングされる
 
 		// EXIFチャンクを探す
 		if (memcmp(chunk_header, "EXIF", 4) == 0) {
-			auto exifInfo = ReadExifChunk(file, chunk_size);
-			list.insert(list.end(), exifInfo.begin(), exifInfo.end());
+			// "Exif\0\0" 付きで書き込むエンコーダーもある
+			if (chunk.size() >= 6 && memcmp(chunk.data(), "Exif\0\0", 6) == 0) {
+				chunk = chunk.subspan(6);
+			}
+			list.Append(ExifReader::Read(chunk, OffsetOf(data, chunk)));
 		}
-		else {
-			// その他のチャンクはスキップ
-			file.seekg(chunk_size, std::ios::cur);
+
+		// XMPチャンク
+		if (memcmp(chunk_header, "XMP ", 4) == 0) {
+			AppendXmp(list, std::string_view(reinterpret_cast<const char*>(chunk.data()), chunk.size()), OffsetOf(data, chunk));
 		}
 	}
 
 	return list;
 }
 
-// ファイル情報の読み込み
-info_list MetaExtractor::ExtractMeta(const std::wstring& filePath) {
-	std::wstring ext = filePath.substr(filePath.find_last_of(L".") + 1);
-	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+// HEIF・AVIF・JPEG XLのEXIF（先頭4バイトはTIFFヘッダーまでの距離で、間に "Exif\0\0" が入る）
+static void AppendExif(MetaList& list, std::span<const uint8_t> payload, uint64_t offset) {
+	if (payload.size() < 4) return;
+	uint32_t skip = read_be32(payload.data());
+	if (skip > payload.size() - 4) return;
+	if (offset != MetaEntry::NO_OFFSET) offset += 4 + skip;
+	list.Append(ExifReader::Read(payload.subspan(4 + skip), offset));
+}
 
-	if (ext == L"png") {
-		auto info = ExtractFromPNG(filePath);
-		return info;
+// HEIF・AVIF画像のプロンプト抽出
+// metaボックスの項目一覧（iinf・iloc）からEXIF・XMPの項目を探し、その範囲だけを読む
+static MetaList ExtractFromHEIF(std::span<const uint8_t> data) {
+	TRACE_SCOPE("ExtractFromHEIF");
+	MetaList list;
+	HeifItems items(data);
+	std::vector<uint8_t> buffer;	// 範囲が複数に分かれた項目をつなぐ
+	for (const auto& item : items.Items()) {
+		bool xmp = item.type == "mime" && item.contentType == "application/rdf+xml";
+		if (item.type != "Exif" && !xmp) continue;
+		auto payload = items.Payload(item, buffer);
+		if (payload.empty()) continue;
+		if (xmp) {
+			AppendXmp(list, std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size()), items.Offset(item));
+		} else {
+			AppendExif(list, payload, items.Offset(item));
+		}
 	}
-	if (ext == L"jpg" || ext == L"jpeg") {
-		auto info = ExtractFromJPEG(filePath);
-		return info;
+	return list;
+}
+
+// JPEG XL画像のプロンプト抽出（Exif・xml ボックス）
+static MetaList ExtractFromJXL(std::span<const uint8_t> data) {
+	TRACE_SCOPE("ExtractFromJXL");
+	MetaList list;
+
+	// コードストリームだけのファイルにはボックスが無い
+	if (data.empty() || data[0] != 0) return list;
+
+	walk_boxes(data, [&](std::string_view type, std::span<const uint8_t>, std::span<const uint8_t> body) {
+		if (type == "Exif") {
+			AppendExif(list, body, OffsetOf(data, body));
+		} else if (type == "xml ") {
+			AppendXmp(list, std::string_view(reinterpret_cast<const char*>(body.data()), body.size()), OffsetOf(data, body));
+		} else if (type == "brob" && body.size() >= 4) {
+			// Brotliで圧縮されたボックス（展開器を持たないので読めないことだけ示す）
+			std::string_view inner(reinterpret_cast<const char*>(body.data()), 4);
+			if (inner == "Exif" || inner == "xml ") {
+				list.Add(inner == "Exif" ? L"Exif" : L"XMP", L"Brotliで圧縮されているため読めません",
+					MetaType::Error, OffsetOf(data, body));
+			}
+		}
+		return true;
+	});
+	return list;
+}
+
+// 数値として出すA1111の項目
+static constexpr std::string_view A1111_NUMERIC_FIELDS[] = {
+	"Steps", "Seed", "CFG scale", "Denoising strength", "Clip skip", "ENSD",
+	"Hires steps", "Hires upscale", "Variation seed", "Variation seed strength",
+};
+
+static bool IsA1111Number(const A1111Field& field) {
+	if (std::find(std::begin(A1111_NUMERIC_FIELDS), std::end(A1111_NUMERIC_FIELDS), field.name) == std::end(A1111_NUMERIC_FIELDS)) return false;
+	return field.Integer() || field.Number();
+}
+
+// A1111の parameters（PNGのテキスト・EXIFのユーザーコメント）の設定行を項目ごとに追加する
+// 値は parameters の値を指すビューで、ファイル内にあればファイルの位置も項目ごとに付ける
+static void AppendA1111Fields(MetaList& list, const ImageBuffer& image) {
+	static const std::string USER_COMMENT = unicode_to_utf8(L"ユーザーコメント");
+	auto data = image.span();
+	auto* fileBegin = reinterpret_cast<const char*>(data.data());
+	auto* fileEnd = fileBegin + data.size();
+
+	A1111Parameters parameters;
+	std::string key;
+	for (size_t i = 0, count = list.size(); i < count; ++i) {
+		MetaEntry source = list[i];	// 追加で一覧が伸びるのでコピーしておく
+		if (source.type != MetaType::Text || (source.key != "parameters" && source.key != USER_COMMENT)) continue;
+		if (!A1111Parser::Parse(source.value, parameters)) continue;
+
+		bool inFile = source.value.data() >= fileBegin && source.value.data() + source.value.size() <= fileEnd;
+		for (const auto& field : parameters.fields) {
+			key.assign(A1111_KEY_PREFIX);
+			key += field.name;
+			uint64_t offset = source.offset;
+			if (inFile && offset != MetaEntry::NO_OFFSET) offset += field.value.data() - source.value.data();
+			list.AddView(key, field.value, inFile ? image.Owner() : nullptr, IsA1111Number(field) ? MetaType::Number : MetaType::Text, offset);
+		}
 	}
-	if (ext == L"webp") {
-		auto info = ExtractFromWEBP(filePath);
-		return info;
+}
+
+// ファイル情報の読み込み
+MetaList MetaExtractor::ExtractMeta(const ImageBuffer& image, const std::vector<std::wstring>& wideKeys) {
+	auto data = image.span();
+	std::vector<std::string> keys;
+	for (const auto& key : wideKeys) keys.push_back(unicode_to_utf8(key));
+
+	// 拡張子ではなくシグネチャで判定する（拡張子が違うファイルも多い）
+	MetaList info;
+	switch (FormatProbe::Sniff(data)) {
+	case ImageFormat::Png:
+		info = ExtractFromPNG(image, keys);
+		break;
+	case ImageFormat::Jpeg:
+		info = ExtractFromJPEG(data);
+		break;
+	case ImageFormat::WebP:
+		info = ExtractFromWEBP(data);
+		break;
+	case ImageFormat::Heif:
+	case ImageFormat::Avif:
+		info = ExtractFromHEIF(data);
+		break;
+	case ImageFormat::JpegXl:
+		info = ExtractFromJXL(data);
+		break;
+	default:
+		break;
 	}
+	if (WantsA1111(keys)) AppendA1111Fields(info, image);
 
-	return {};
+	// キーの指定があれば絞り込む
+	if (!keys.empty()) {
+		info.RemoveIf([&](const MetaEntry& entry) { return !IsWanted(keys, entry.key); });
+	}
+	return info;
 }
 
-
+MetaList MetaExtractor::ExtractMeta(const std::wstring& filePath, const std::vector<std::wstring>& keys) {
+	return ExtractMeta(ImageBuffer::FromFile(filePath), keys);
+}
@@ -1,7 +1,11 @@
 ﻿#pragma once
-#include "InfoList.h"
+#include "MetaList.h"
+#include "ImageBuffer.h"
+#include <vector>
 
 class MetaExtractor {
 public:
-    static info_list ExtractMeta(const std::wstring& filePath);
+    // keys を指定した場合はそのキーだけを返す（PNGの圧縮テキストは該当するチャンクだけ展開する）
+    static MetaList ExtractMeta(const ImageBuffer& image, const std::vector<std::wstring>& keys = {});
+    static MetaList ExtractMeta(const std::wstring& filePath, const std::vector<std::wstring>& keys = {});
 };
\ No newline at end of file
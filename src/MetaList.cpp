@@ -0,0 +1,167 @@
+﻿#include "framework.h"
+#include "MetaList.h"
+#include "TextUtils.h"
+#include "Utf.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+// これより大きな値はブロックに詰めずに文字列ごと持つ
+static constexpr size_t ADOPT_THRESHOLD = 4 * 1024;
+
+// 内部化するキーの上限（PNGのキーワードなどファイルが決めるキーで表が膨らみ続けないように）
+static constexpr size_t MAX_INTERNED_KEYS = 64 * 1024;
+
+char* Arena::Allocate(size_t size) {
+	if (size > m_left) {
+		size_t blockSize = std::max(BLOCK_SIZE, size);
+		m_blocks.push_back(std::make_unique<char[]>(blockSize));
+		m_cursor = m_blocks.back().get();
+		m_left = blockSize;
+		m_capacity += blockSize;
+	}
+	char* p = m_cursor;
+	m_cursor += size;
+	m_left -= size;
+	return p;
+}
+
+std::string_view Arena::Copy(std::string_view text) {
+	if (text.empty()) return {};
+	char* p = Allocate(text.size());
+	memcpy(p, text.data(), text.size());
+	return {p, text.size()};
+}
+
+std::string_view Arena::Adopt(std::string&& text) {
+	if (text.size() < ADOPT_THRESHOLD) return Copy(text);
+	m_capacity += text.capacity();
+	auto& adopted = m_adopted.emplace_back(std::make_unique<std::string>(std::move(text)));
+	return *adopted;
+}
+
+// string_view のまま引けるハッシュ（引くたびに std::string を作らない）
+struct KeyHash {
+	using is_transparent = void;
+	size_t operator()(std::string_view key) const { return std::hash<std::string_view>()(key); }
+};
+
+std::string_view intern_key(std::string_view key) {
+	// ノードは再ハッシュで移動しないので、要素の文字列は消すまで同じ位置にある
+	static std::mutex mutex;
+	static std::unordered_set<std::string, KeyHash, std::equal_to<>> keys;
+	std::lock_guard lock(mutex);
+	auto it = keys.find(key);
+	if (it != keys.end()) return *it;
+	if (keys.size() >= MAX_INTERNED_KEYS) return {};
+	return *keys.emplace(key).first;
+}
+
+std::wstring MetaEntry::Key() const {
+	return utf8_to_unicode(key);
+}
+
+std::wstring MetaEntry::Value() const {
+	return utf8_to_unicode(value);
+}
+
+MetaList& MetaList::operator=(const MetaList& other) {
+	if (this == &other) return *this;
+	m_entries = other.m_entries;
+	m_owners = other.m_owners;
+	// アリーナは共有して読むだけにし、以降の追加は別のアリーナに置く
+	m_arena = nullptr;
+	if (other.m_arena) m_owners.push_back(other.m_arena);
+	return *this;
+}
+
+Arena& MetaList::Storage() {
+	if (!m_arena) m_arena = std::make_shared<Arena>();
+	return *m_arena;
+}
+
+void MetaList::Retain(const std::shared_ptr<const void>& owner) {
+	if (std::find(m_owners.begin(), m_owners.end(), owner) == m_owners.end()) m_owners.push_back(owner);
+}
+
+std::string_view MetaList::Key(std::string_view key) {
+	if (!is_valid_utf8(key)) {
+		std::string sanitized(utf8_max_length_from_utf8(key.size()), '\0');
+		sanitized.resize(sanitize_utf8(key, sanitized.data()));
+		return Key(sanitized);
+	}
+	if (key.empty()) return {};
+	auto interned = intern_key(key);
+	return interned.empty() ? Storage().Copy(key) : interned;
+}
+
+void MetaList::Add(std::string_view key, std::string_view value, MetaType type, uint64_t offset) {
+	auto k = Key(key);
+	std::string_view v;
+	if (is_valid_utf8(value)) {
+		v = Storage().Copy(value);
+	} else {
+		std::string sanitized(utf8_max_length_from_utf8(value.size()), '\0');
+		sanitized.resize(sanitize_utf8(value, sanitized.data()));
+		v = Storage().Adopt(std::move(sanitized));
+	}
+	m_entries.push_back({k, v, offset, type});
+}
+
+void MetaList::Add(std::string_view key, std::string&& value, MetaType type, uint64_t offset) {
+	if (!is_valid_utf8(value)) return Add(key, std::string_view(value), type, offset);
+	auto k = Key(key);
+	m_entries.push_back({k, Storage().Adopt(std::move(value)), offset, type});
+}
+
+void MetaList::Add(std::wstring_view key, std::wstring_view value, MetaType type, uint64_t offset) {
+	std::string utf8(utf8_max_length_from_wide(value.size()), '\0');
+	utf8.resize(wide_to_utf8(value, utf8.data()));
+	std::string utf8Key(utf8_max_length_from_wide(key.size()), '\0');
+	utf8Key.resize(wide_to_utf8(key, utf8Key.data()));
+	Add(utf8Key, std::move(utf8), type, offset);
+}
+
+void MetaList::AddView(std::string_view key, std::string_view value, const std::shared_ptr<const void>& source,
+	MetaType type, uint64_t offset) {
+	if (!source || !is_valid_utf8(value)) return Add(key, value, type, offset);
+	Retain(source);
+	m_entries.push_back({Key(key), value, offset, type});
+}
+
+void MetaList::Detach(const std::shared_ptr<const void>& source, const void* data, size_t size) {
+	auto owner = std::find(m_owners.begin(), m_owners.end(), source);
+	if (!source || owner == m_owners.end()) return;
+	// 別の領域を指すポインタ同士なので std::less で比べる
+	auto begin = static_cast<const char*>(data);
+	auto end = begin + size;
+	for (auto& entry : m_entries) {
+		const char* value = entry.value.data();
+		if (std::less_equal<>()(begin, value) && std::less<>()(value, end)) entry.value = Storage().Copy(entry.value);
+	}
+	m_owners.erase(owner);
+}
+
+void MetaList::Append(MetaList&& other) {
+	if (other.m_entries.empty()) return;
+	if (m_entries.empty() && m_owners.empty() && !m_arena) {
+		*this = std::move(other);
+		return;
+	}
+	m_entries.insert(m_entries.end(), other.m_entries.begin(), other.m_entries.end());
+	for (const auto& owner : other.m_owners) Retain(owner);
+	if (other.m_arena) m_owners.push_back(std::move(other.m_arena));
+	other.clear();
+}
+
+void MetaList::SetOffset(size_t first, uint64_t offset) {
+	for (size_t i = first; i < m_entries.size(); ++i) m_entries[i].offset = offset;
+}
+
+void MetaList::clear() {
+	m_entries.clear();
+	m_arena = nullptr;
+	m_owners.clear();
+}
@@ -0,0 +1,120 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 値の種類
+enum class MetaType : uint8_t {
+	Text,
+	Json,	// NovelAIの埋め込みやC2PAのマニフェストなど、JSONと分かっている値
+	Error,	// 抽出に失敗した理由
+	Number,	// A1111の Steps・Seed など、JSONの数値として書ける値
+};
+
+// 抽出結果の値を置く領域
+// 小さな値はブロックにまとめて詰め、大きな値は文字列ごと引き取る（まとめて解放する）
+class Arena {
+public:
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	std::string_view Copy(std::string_view text);
+	std::string_view Adopt(std::string&& text);
+
+	// 確保した容量（バイト）
+	size_t Capacity() const { return m_capacity; }
+
+private:
+	static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+	char* Allocate(size_t size);
+
+	std::vector<std::unique_ptr<char[]>> m_blocks;
+	std::vector<std::unique_ptr<std::string>> m_adopted;
+	char* m_cursor = nullptr;
+	size_t m_left = 0;
+	size_t m_capacity = 0;
+};
+
+// キーの内部化（同じキーは同じ領域を指し、プロセスの終了まで有効）
+// 表が一杯になったら空を返す（呼び出し側で値と同じ領域にコピーする）
+std::string_view intern_key(std::string_view key);
+
+// 抽出結果の1項目（文字列は全てUTF-8で、不正なバイト列は U+FFFD に置き換え済み）
+struct MetaEntry {
+	static constexpr uint64_t NO_OFFSET = ~0ull;
+
+	std::string_view key;			// 内部化したキー
+	std::string_view value;			// マップしたファイルの中か、一覧のアリーナを指す
+	uint64_t offset = NO_OFFSET;	// 元データのファイル内の位置（展開・整形した値は元の位置）
+	MetaType type = MetaType::Text;
+
+	// 表示用（ワイド文字列への変換はGUIと文書の整形だけで行う）
+	std::wstring Key() const;
+	std::wstring Value() const;
+
+	bool operator==(const MetaEntry& other) const {
+		return key == other.key && value == other.value && offset == other.offset && type == other.type;
+	}
+};
+
+// 抽出結果の一覧
+// 値はコピーせずにファイルのマップを参照するか、一覧ごとのアリーナに置く
+// 参照している領域（マップ・アリーナ）は一覧が持ち続けるので、元の ImageBuffer より長く使える
+class MetaList {
+public:
+	typedef std::vector<MetaEntry>::const_iterator const_iterator;
+
+	MetaList() = default;
+	MetaList(const MetaList& other) { *this = other; }
+	MetaList& operator=(const MetaList& other);
+	MetaList(MetaList&&) noexcept = default;
+	MetaList& operator=(MetaList&&) noexcept = default;
+
+	// 値をアリーナにコピーして追加する
+	void Add(std::string_view key, std::string_view value, MetaType type = MetaType::Text, uint64_t offset = MetaEntry::NO_OFFSET);
+	// 展開した値などを文字列ごと引き取って追加する
+	void Add(std::string_view key, std::string&& value, MetaType type = MetaType::Text, uint64_t offset = MetaEntry::NO_OFFSET);
+	// ワイド文字列の値（EXIFの整形結果やエラーの説明）
+	void Add(std::wstring_view key, std::wstring_view value, MetaType type = MetaType::Text, uint64_t offset = MetaEntry::NO_OFFSET);
+
+	// 値をコピーせずに参照する（source は値の領域を持つもの。無ければコピーする）
+	void AddView(std::string_view key, std::string_view value, const std::shared_ptr<const void>& source,
+		MetaType type = MetaType::Text, uint64_t offset = MetaEntry::NO_OFFSET);
+
+	// source の領域（data から size バイト）を参照している値をアリーナにコピーし、source を手放す
+	// 結果をファイルより長く持つとき（GUI・監視）に、ファイルのマップを開いたままにしない
+	void Detach(const std::shared_ptr<const void>& source, const void* data, size_t size);
+
+	// 別の一覧の項目を末尾に移す（値はコピーしない）
+	void Append(MetaList&& other);
+
+	// 条件に合う項目を取り除く
+	template <class Pred>
+	void RemoveIf(Pred pred) { std::erase_if(m_entries, pred); }
+
+	// 値の元データの位置をまとめて設定する（first 番目以降）
+	void SetOffset(size_t first, uint64_t offset);
+
+	const_iterator begin() const { return m_entries.begin(); }
+	const_iterator end() const { return m_entries.end(); }
+	const MetaEntry& operator[](size_t index) const { return m_entries[index]; }
+	size_t size() const { return m_entries.size(); }
+	bool empty() const { return m_entries.empty(); }
+	void clear();
+
+	bool operator==(const MetaList& other) const { return m_entries == other.m_entries; }
+
+private:
+	Arena& Storage();
+	std::string_view Key(std::string_view key);
+	void Retain(const std::shared_ptr<const void>& owner);
+
+	std::vector<MetaEntry> m_entries;
+	std::shared_ptr<Arena> m_arena;						// この一覧に追加した値
+	std::vector<std::shared_ptr<const void>> m_owners;	// 参照している他の領域（マップしたファイル・移した一覧のアリーナ）
+};
@@ -1,29 +1,238 @@
 ﻿#include "framework.h"
-#include <zlib.h>
+#ifdef _WIN32
+#include <shlwapi.h>
+#pragma comment(lib, "shlwapi.lib")
+#endif
 
 #include "NAIExtractor.h"
 #include "TextUtils.h"
+#include "LsbPack.h"
+#include "ByteReader.h"
+#include "PngRowDecoder.h"
+#include "WebpAlphaDecoder.h"
+#include "FormatProbe.h"
+#include "Inflater.h"
+#include "Trace.h"
+#include "Cancellation.h"
 #include <vector>
 #include <string>
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
+#include <mutex>
+#include <string_view>
 
-info_list NAIExtractor::ExtractNAI(const std::wstring& imagePath) {
+// 埋め込みの種類（stealth_pnginfo の規約。マジックの後の32ビットは本体のビット数）
+struct StealthVariant {
+    std::string_view magic;
+    bool rgb;           // RGBのLSB（1画素3ビット、赤・緑・青の順）。false ならアルファのLSB
+    bool compressed;    // 本体がgzip
+};
+
+// NovelAIが使うのは stealth_pngcomp（gzipしたJSON）、残りはWebUIの拡張機能などが使う
+static constexpr StealthVariant STEALTH_VARIANTS[] = {
+    { "stealth_pngcomp", false, true },
+    { "stealth_pnginfo", false, false },
+    { "stealth_rgbcomp", true, true },
+    { "stealth_rgbinfo", true, false },
+};
+static constexpr size_t STEALTH_MAGIC_BYTES = 15;                       // どの種類も同じ長さ
+static constexpr size_t STEALTH_HEADER_BYTES = STEALTH_MAGIC_BYTES + 4;  // マジック + ビット数
+
+// 先頭の列のLSBを詰めたバイト列（見出しの照合用）
+struct HeaderBits {
+    std::vector<uint8_t> bytes;
+    uint8_t acc = 0;
+    int count = 0;
+
+    void Push(uint8_t bit) {
+        if (bytes.size() >= STEALTH_HEADER_BYTES) return;
+        acc = static_cast<uint8_t>((acc << 1) | (bit & 1));
+        if (++count == 8) {
+            bytes.push_back(acc);
+            acc = 0;
+            count = 0;
+        }
+    }
+};
+
+#ifdef _WIN32
+// GDI+の初期化（バッチでは複数スレッドから呼ばれるため、プロセスで一度だけ行う）
+static void StartupGdiplus() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        Gdiplus::GdiplusStartupInput gdiplusStartupInput;
+        ULONG_PTR gdiplusToken;
+        Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    });
+}
+#endif
+
+MetaList NAIExtractor::ExtractNAI(const ImageBuffer& image) {
+    MetaList result;
+    if (image.empty()) return result;
+
+    // PNGは必要な行だけを自前で展開する（アルファが無くてもRGBの埋め込みがありうる）
+    PngHeader header;
+    if (ReadPngHeader(image.span(), header)) {
+        PngRowDecoder decoder(image.span());
+        if (decoder.TooLarge()) {
+            // GDI+に回しても同じ大きさを確保しようとするので、ここで打ち切る
+            result.Add(L"error", L"画像サイズが上限を超えています", MetaType::Error);
+            return result;
+        }
+        if (decoder.Valid()) {
+            TRACE_SCOPE("NAI.PngRows");
+            ExtractFromRows(decoder, decoder.Header().width, decoder.Header().height, 0, result);
+            return result;
+        }
+
+        // アルファの無いインターレースPNGはRGBの埋め込みのためだけに全体を展開しない
+        if (!header.HasAlpha()) return result;
+    }
+
+    // WebPはGDI+で展開できないので自前で展開する（非可逆の色の面は展開しない）
+    if (FormatProbe::Sniff(image.span()) == ImageFormat::WebP) {
+        WebpAlphaDecoder decoder(image.span());
+        if (decoder.Valid()) {
+            TRACE_SCOPE("NAI.WebpAlpha");
+            ExtractFromRows(decoder, decoder.Width(), decoder.Height(), 2, result);
+        }
+        return result;
+    }
+
+#ifdef _WIN32
+    // PNG以外やインターレースPNGはGDI+で展開する
+    ExtractFromBitmap(image, result);
+#endif
+    return result;
+}
+
+template <class RowDecoder>
+void NAIExtractor::ExtractFromRows(RowDecoder& decoder, size_t width, size_t height, size_t red, MetaList& result) {
+    const size_t rowBytes = width * 4;
+    const size_t blue = 2 - red;
+    const size_t headerBits = STEALTH_HEADER_BYTES * 8;
+
+    // 先頭列だけでアルファの見出し（マジック + ビット数）が読める高さなら、行ごとに照合して早めに打ち切る
+    // RGBは1画素3ビットなので、その3分の1の行数で読める。それより低い画像は全行を展開してから判定する
+    bool streaming = height > headerBits;
+    size_t headerRows = streaming ? headerBits : height;
+
+    // ヘッダーを読み終えるまでは行全体を保持する（必要な列数がまだ分からないため）
+    // アルファとRGBの見出しは同じ行から同時に読み、全ての種類を一度に照合する
+    std::vector<uint8_t> pixels;
+    pixels.reserve(headerRows * rowBytes);
+    HeaderBits alphaHead, rgbHead;
+    bool alive[std::size(STEALTH_VARIANTS)];
+    std::fill(std::begin(alive), std::end(alive), true);
+    for (size_t y = 0; y < headerRows; ++y) {
+        if ((y & 63) == 0 && CancellationToken::Current().ShouldStop()) return;
+        const uint8_t* row = decoder.NextRow();
+        if (!row) return;
+        pixels.insert(pixels.end(), row, row + rowBytes);
+        if (!streaming) continue;
+
+        alphaHead.Push(row[3]);
+        rgbHead.Push(row[red]);
+        rgbHead.Push(row[1]);
+        rgbHead.Push(row[blue]);
+
+        // 読めたところまでマジックが一致する種類が無くなったら打ち切る
+        bool any = false;
+        for (size_t v = 0; v < std::size(STEALTH_VARIANTS); ++v) {
+            const auto& variant = STEALTH_VARIANTS[v];
+            const auto& head = variant.rgb ? rgbHead.bytes : alphaHead.bytes;
+            size_t n = std::min(head.size(), STEALTH_MAGIC_BYTES);
+            if (alive[v] && n && memcmp(head.data(), variant.magic.data(), n) != 0) alive[v] = false;
+            any |= alive[v];
+        }
+        if (!any) return;
+    }
+
+    if (!streaming) {
+        std::vector<uint8_t> alpha_bytes, rgb_bytes;
+        PackLsb(pixels.data(), rowBytes, width, height, red, &alpha_bytes, &rgb_bytes);
+        ExtractNovelAIData(alpha_bytes, rgb_bytes, result);
+        return;
+    }
+
+    // 残った種類のビット数から必要な列数を求め、以降はその列だけを保持する
+    bool needAlpha = false, needRgb = false;
+    size_t columns = 0;
+    for (size_t v = 0; v < std::size(STEALTH_VARIANTS); ++v) {
+        if (!alive[v]) continue;
+        bool rgb = STEALTH_VARIANTS[v].rgb;
+        const uint8_t* len_data = (rgb ? rgbHead.bytes : alphaHead.bytes).data() + STEALTH_MAGIC_BYTES;
+        uint64_t totalBits = headerBits + read_be32(len_data);
+        uint64_t bitsPerColumn = static_cast<uint64_t>(height) * (rgb ? 3 : 1);
+        columns = std::max(columns, static_cast<size_t>(std::min<uint64_t>(width, (totalBits + bitsPerColumn - 1) / bitsPerColumn)));
+        (rgb ? needRgb : needAlpha) = true;
+    }
+    size_t keepBytes = columns * 4;
+
+    std::vector<uint8_t> kept(height * keepBytes);
+    for (size_t y = 0; y < headerRows; ++y) {
+        memcpy(&kept[y * keepBytes], &pixels[y * rowBytes], keepBytes);
+    }
+    pixels = {};
+
+    for (size_t y = headerRows; y < height; ++y) {
+        // 取り消し・時間切れは数十行ごとに確かめる
+        if ((y & 63) == 0 && CancellationToken::Current().ShouldStop()) return;
+        const uint8_t* row = decoder.NextRow();
+        if (!row) return;
+        memcpy(&kept[y * keepBytes], row, keepBytes);
+    }
+
+    std::vector<uint8_t> alpha_bytes, rgb_bytes;
+    PackLsb(kept.data(), keepBytes, columns, height, red, needAlpha ? &alpha_bytes : nullptr, needRgb ? &rgb_bytes : nullptr);
+    ExtractNovelAIData(alpha_bytes, rgb_bytes, result);
+}
+
+void NAIExtractor::PackLsb(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height, size_t red,
+    std::vector<uint8_t>* alpha, std::vector<uint8_t>* rgb) {
+    pack_lsb_column_major_rgba(pixels, stride, width, height, red, alpha, nullptr);
+    if (!rgb || width == 0 || height == 0) return;
+
+    // RGBは1画素ずつ詰めるので、まず見出しの入る列だけを詰めてマジックを照合する
+    const size_t headerBits = STEALTH_HEADER_BYTES * 8;
+    const size_t bitsPerColumn = height * 3;
+    size_t headerColumns = std::min(width, (headerBits + bitsPerColumn - 1) / bitsPerColumn);
+    pack_lsb_column_major_rgba(pixels, stride, headerColumns, height, red, nullptr, rgb);
+    bool match = rgb->size() >= STEALTH_HEADER_BYTES && std::any_of(std::begin(STEALTH_VARIANTS), std::end(STEALTH_VARIANTS),
+        [&](const StealthVariant& variant) {
+            return variant.rgb && memcmp(rgb->data(), variant.magic.data(), STEALTH_MAGIC_BYTES) == 0;
+        });
+    if (!match) {
+        rgb->clear();
+        return;
+    }
+
+    // 見出しのビット数から本体の入る列までを詰め直す
+    uint64_t totalBits = headerBits + read_be32(rgb->data() + STEALTH_MAGIC_BYTES);
+    size_t columns = static_cast<size_t>(std::min<uint64_t>(width, (totalBits + bitsPerColumn - 1) / bitsPerColumn));
+    if (columns > headerColumns) pack_lsb_column_major_rgba(pixels, stride, columns, height, red, nullptr, rgb);
+}
+
+#ifdef _WIN32
+void NAIExtractor::ExtractFromBitmap(const ImageBuffer& image, MetaList& result) {
     using namespace Gdiplus;
-    info_list result;
+    TRACE_SCOPE("NAI.Gdiplus");
+
+    // マップ済みのデータからストリームを作る（ファイルは開き直さない）
+    IStream* stream = SHCreateMemStream(image.data(), static_cast<UINT>(image.size()));
+    if (!stream) return;
 
     // GDI+を使用
-    GdiplusStartupInput gdiplusStartupInput;
-    ULONG_PTR gdiplusToken;
-    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    StartupGdiplus();
     Gdiplus::Bitmap* bitmap = nullptr;
 
     try {
-        bitmap = Gdiplus::Bitmap::FromFile(imagePath.c_str());
+        bitmap = Gdiplus::Bitmap::FromStream(stream);
         if (!bitmap) {
-            Gdiplus::GdiplusShutdown(gdiplusToken);
-            return result;
+            stream->Release();
+            return;
         }
 
 		// ピクセルデータを取得
@@ -34,99 +243,73 @@ info_list NAIExtractor::ExtractNAI(const std::wstring& imagePath) {
             throw std::runtime_error("LockBits失敗");
 		}
 
-        // アルファチャンネル抽出
-        std::vector<unsigned char> alpha;
-        alpha.reserve(rect.Width * rect.Height);
-        unsigned char* p = static_cast<unsigned char*>(bitmapData.Scan0);
-		for (int x = 0; x < rect.Width; ++x) {
-            for (int y = 0; y < rect.Height; ++y) {
-				unsigned char* row = p + y * bitmapData.Stride;
-                unsigned char a = row[x * 4 + 3]; // BGRA順
-                alpha.push_back(a);
-            }
-        }
+        // アルファとRGBのLSBを列優先のバイト列にする（BGRA順なので赤は+2）
+        std::vector<uint8_t> alpha_bytes, rgb_bytes;
+        PackLsb(static_cast<const uint8_t*>(bitmapData.Scan0), bitmapData.Stride,
+            rect.Width, rect.Height, 2, &alpha_bytes, &rgb_bytes);
         bitmap->UnlockBits(&bitmapData);
 
-        // LSBビットストリームを作成
-        std::vector<uint8_t> lsb_bits;
-        lsb_bits.reserve(alpha.size());
-        for (unsigned char a : alpha) {
-            lsb_bits.push_back(a & 0x01);
-        }
-        // 8ビットごとにまとめてバイト列化
-        std::vector<uint8_t> lsb_bytes;
-        uint8_t acc = 0;
-        int bit_count = 0;
-        for (size_t i = 0; i < lsb_bits.size(); ++i) {
-            acc = (acc << 1) | lsb_bits[i];
-            bit_count++;
-            if (bit_count == 8) {
-                lsb_bytes.push_back(acc);
-                acc = 0;
-                bit_count = 0;
-            }
-        }
-        if (bit_count > 0) {
-            acc <<= (8 - bit_count);
-            lsb_bytes.push_back(acc);
-        }
-
-        // lsb_bytesからNovelAI仕様でJSONを抽出
-        ExtractNovelAIData(lsb_bytes, result);
+        // 埋め込みの種類を調べて抽出する
+        ExtractNovelAIData(alpha_bytes, rgb_bytes, result);
 
 	} catch (const std::exception& e) {
         OutputDebugStringA(e.what());
     }
 
 	if (bitmap) delete bitmap;
-    GdiplusShutdown(gdiplusToken);
-    return result;
+    stream->Release();
+}
+#endif
+
+MetaList NAIExtractor::ExtractNAI(const std::wstring& imagePath) {
+    return ExtractNAI(ImageBuffer::FromFile(imagePath));
 }
 
-void NAIExtractor::ExtractNovelAIData(const std::vector<uint8_t>& lsb_bytes, info_list& result) {
-    std::string nai_magic = "stealth_pngcomp";
+void NAIExtractor::ExtractNovelAIData(const std::vector<uint8_t>& alpha_bytes, const std::vector<uint8_t>& rgb_bytes, MetaList& result) {
+    for (const auto& variant : STEALTH_VARIANTS) {
+        const auto& lsb_bytes = variant.rgb ? rgb_bytes : alpha_bytes;
 
-	// 最小データ長チェック
-    if (lsb_bytes.size() <= nai_magic.size() + 4) return;
+        // 最小データ長・マジックナンバーチェック
+        if (lsb_bytes.size() < STEALTH_HEADER_BYTES) continue;
+        if (memcmp(lsb_bytes.data(), variant.magic.data(), STEALTH_MAGIC_BYTES) != 0) continue;
 
-    // マジックナンバーチェック
-    if (memcmp(lsb_bytes.data(), nai_magic.c_str(), nai_magic.size()) != 0) return;
+        // データ長取得（ビット数）
+        size_t length = read_be32(lsb_bytes.data() + STEALTH_MAGIC_BYTES) / 8;
+        if (lsb_bytes.size() < STEALTH_HEADER_BYTES + length) {
+            result.Add(L"error", L"データ長不足", MetaType::Error);
+            return;
+        }
 
-    // データ長取得
-	auto len_data = lsb_bytes.data() + nai_magic.size();
-	uint32_t length = (len_data[0] << 24) | (len_data[1] << 16) | (len_data[2] << 8) | len_data[3];
-    if (lsb_bytes.size() < nai_magic.size() + 4 + length) {
-		result.push_back({L"error", L"データ長不足"});
+        const uint8_t* data = lsb_bytes.data() + STEALTH_HEADER_BYTES;
+        if (variant.compressed) {
+            DecompressGzipData(data, static_cast<uint32_t>(length), result);
+        } else {
+            AddPayload(std::string(reinterpret_cast<const char*>(data), length), result);
+        }
         return;
     }
-
-    // gzip展開処理
-    const uint8_t* comp_data = lsb_bytes.data() + nai_magic.size() + 4;
-    auto [key, value] = DecompressGzipData(comp_data, length);
-    result.push_back({key, value});
 }
 
-std::pair<std::wstring, std::wstring> NAIExtractor::DecompressGzipData(const uint8_t* comp_data, uint32_t length) {
-    z_stream strm = {};
-    strm.next_in = (Bytef*)comp_data;
-    strm.avail_in = length;
-    std::vector<uint8_t> jsonbuf(length * 8);
-    strm.next_out = jsonbuf.data();
-    strm.avail_out = static_cast<uInt>(jsonbuf.size());
-
-    int ret = inflateInit2(&strm, 16 + MAX_WBITS); // gzip対応
-    if (ret != Z_OK) {
-        inflateEnd(&strm);
-        return {L"error", L"inflateInit2失敗"};
+void NAIExtractor::DecompressGzipData(const uint8_t* comp_data, uint32_t length, MetaList& result) {
+    TRACE_SCOPE("DecompressGzipData");
+    std::string json_str;
+    auto status = Inflater::ForThread().Inflate({comp_data, length}, InflateFormat::Gzip, json_str);
+    if (status == InflateStatus::TooLarge) {
+        result.Add(L"error", L"展開サイズが上限を超えています", MetaType::Error);
+        return;
     }
-
-    ret = inflate(&strm, Z_FINISH);
-    inflateEnd(&strm);
-
-    if (ret != Z_STREAM_END) {
-        return {L"error", L"gzip展開失敗"};
+    if (status != InflateStatus::Ok) {
+        result.Add(L"error", L"gzip展開失敗", MetaType::Error);
+        return;
     }
 
-    std::string json_str((char*)jsonbuf.data(), strm.total_out);
-    return {L"data", utf8_to_unicode(json_str)};
+    // 展開したJSONはコピーせずに引き取る
+    AddPayload(std::move(json_str), result);
+}
+
+void NAIExtractor::AddPayload(std::string&& text, MetaList& result) {
+    // NovelAIはJSON、WebUIの拡張機能は生成パラメーターの文字列を埋め込む
+    size_t first = text.find_first_not_of(" \t\r\n");
+    MetaType type = first != std::string::npos && text[first] == '{' ? MetaType::Json : MetaType::Text;
+    result.Add("data", std::move(text), type);
 }
@@ -1,13 +1,29 @@
 ﻿#pragma once
-#include "InfoList.h"
+#include "MetaList.h"
+#include "ImageBuffer.h"
 #include <vector>
 #include <cstdint>
 
 class NAIExtractor {
 public:
-    static info_list ExtractNAI(const std::wstring& filePath);
+    static MetaList ExtractNAI(const ImageBuffer& image);
+    static MetaList ExtractNAI(const std::wstring& filePath);
+
+    // 展開済みの画素からアルファとRGBのLSBを列優先のバイト列にする（要らない方は nullptr）
+    // アルファはSIMDのカーネルで全列を詰め、RGBは見出しのマジックが合うときだけ本体の入る列まで詰める
+    static void PackLsb(const uint8_t* pixels, ptrdiff_t stride, size_t width, size_t height, size_t red,
+        std::vector<uint8_t>* alpha, std::vector<uint8_t>* rgb);
 
 private:
-    static void ExtractNovelAIData(const std::vector<uint8_t>& lsb_bytes, info_list& result);
-    static std::pair<std::wstring, std::wstring> DecompressGzipData(const uint8_t* comp_data, uint32_t length);
+    // decoder は1行ずつBGRA/RGBA8の行を返すもの（PngRowDecoder・WebpAlphaDecoder）
+    template <class RowDecoder>
+    // red は行の中の赤のチャンネル（RGBAなら0、BGRAなら2）
+    static void ExtractFromRows(RowDecoder& decoder, size_t width, size_t height, size_t red, MetaList& result);
+#ifdef _WIN32
+    static void ExtractFromBitmap(const ImageBuffer& image, MetaList& result);
+#endif
+    // アルファとRGBのLSBのバイト列から、埋め込みの種類を調べて抽出する（使わない方は空でよい）
+    static void ExtractNovelAIData(const std::vector<uint8_t>& alpha_bytes, const std::vector<uint8_t>& rgb_bytes, MetaList& result);
+    static void DecompressGzipData(const uint8_t* comp_data, uint32_t length, MetaList& result);
+    static void AddPayload(std::string&& text, MetaList& result);
 };
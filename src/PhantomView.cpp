@@ -4,9 +4,12 @@
 #include <sstream>
 
 #include "PhantomView.h"
-#include "MetaExtractor.h"
-#include "C2PAExtractor.h"
-#include "NAIExtractor.h"
+#include "Inspector.h"
+#include "CommandLine.h"
+#include "Formatter.h"
+#include "TextUtils.h"
+#include "Trace.h"
+#include <algorithm>
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
@@ -15,6 +18,15 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // 引数でモードが指定された場合はウィンドウを出さずに処理する
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    std::vector<std::wstring> args;
+    for (int i = 1; argv && i < argc; ++i) args.push_back(argv[i]);
+    if (argv) LocalFree(argv);
+    if (IsCommandLineMode(args)) return RunCommandLine(args);
+
     PhantomView app;
     if (!app.Initialize(hInstance)) return -1;
     return app.Run();
@@ -23,6 +35,16 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 bool PhantomView::Initialize(HINSTANCE hInstance) {
     LoadLibrary(TEXT("Msftedit.dll"));
 
+    // 同じ画像を開き直したときは前回の結果を使う
+    m_cache = ResultCache::Open(ResultCache::DefaultDirectory());
+
+    // 抽出はワーカースレッドで行い、終わった抽出処理から表示する
+    m_pool = std::make_unique<ThreadPool>();
+    m_pipeline = std::make_unique<InspectionPipeline>(*m_pool);
+
+    // 環境変数 PHANTOMVIEW_TRACE があれば段階ごとの所要時間をデバッガーに出力する
+    if (_wgetenv(L"PHANTOMVIEW_TRACE")) Trace::Enable(false);
+
     const auto szWindowClass = L"PhantomViewWindowClass";
     WNDCLASSEXW wcex{
         .cbSize = sizeof(WNDCLASSEXW),
@@ -94,7 +116,11 @@ LRESULT CALLBACK PhantomView::WindowProc(HWND hWnd, UINT message, WPARAM wParam,
     case WM_DROPFILES:
         pThis->OnDropFiles(hWnd, wParam);
         return 0;
+    case WM_STAGE_DONE:
+        pThis->OnStageDone(lParam);
+        return 0;
     case WM_DESTROY:
+        if (pThis->m_job) pThis->m_job->Cancel();
         PostQuitMessage(0);
         return 0;
     default:
@@ -111,6 +137,8 @@ void PhantomView::OnCreate(HWND hwnd) {
         hwnd, NULL, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL);
     // 背景色を黒に設定
     SendMessageW(m_hbox, EM_SETBKGNDCOLOR, 0, RGB(0,0,0));
+    // 大きなマニフェストも流し込めるように文字数の上限を外す
+    SendMessageW(m_hbox, EM_EXLIMITTEXT, 0, 0x7FFFFFFE);
 }
 
 void PhantomView::OnSize(HWND hwnd) {
@@ -133,325 +161,80 @@ void PhantomView::OnDropFiles(HWND hwnd, WPARAM wParam) {
     DragFinish(hDrop);
 }
 
-bool PhantomView::IsJson(const std::wstring& text) {
-    size_t start = text.find_first_not_of(L" \t\r\n");
-    size_t end = text.find_last_not_of(L" \t\r\n");
-    if (start == std::wstring::npos || end == std::wstring::npos) return false;
-    wchar_t first = text[start];
-    wchar_t last = text[end];
-    if ((first == L'{' && last == L'}') || (first == L'[' && last == L']')) {
-        // コロンとダブルクォートが複数含まれていればJSONとみなす
-        size_t colon = text.find(L':', start);
-        size_t quote1 = text.find(L'\"', start);
-        size_t quote2 = text.find(L'\"', quote1 + 1);
-        if (colon != std::wstring::npos && quote1 != std::wstring::npos && quote2 != std::wstring::npos) return true;
-    }
-    return false;
-}
-
-bool PhantomView::IsXml(const std::wstring& text) {
-    // 先頭と末尾の文字だけで簡易判定
-    size_t start = text.find_first_not_of(L" \t\r\n");
-    size_t end = text.find_last_not_of(L" \t\r\n");
-    if (start == std::wstring::npos || end == std::wstring::npos) return false;
-    wchar_t first = text[start];
-    wchar_t last = text[end];
-    return (first == L'<' && last == L'>');
-}
-
-// セクションの出力
-void PhantomView::OutputSection(const std::wstring& title, const info_list& data) {
-	if (data.empty()) return;
-
-    SetColor(COLOR_TITLE);
-    PutText(title + L"\r\n");
-    for (const auto& kv : data) {
-		auto& key = kv.first;
-		auto& val = kv.second;
-        SetColor(COLOR_KEY);
-        PutText(key + L" : ");
-        if (IsJson(val)) {
-            SetColor(COLOR_VALUE);
-            PutText(L"\r\n");
-            OutputAsJSON(val);
-            PutText(L"\r\n");
-        } else if (IsXml(val)) {
-            SetColor(COLOR_VALUE);
-            PutText(L"\r\n");
-            OutputAsXML(val);
-            PutText(L"\r\n");
-        } else {
-            SetColor(COLOR_VALUE);
-            PutText(val + L"\r\n");
-        }
-    }
-}
-
 bool PhantomView::InspectImage(const std::wstring& path) {
-    SendMessageW(m_hbox, WM_SETTEXT, 0, (LPARAM)L"");
-
-	// メタデータ抽出
-    auto meta = MetaExtractor::ExtractMeta(path);
-    OutputSection(L"[MetaData]", meta);
-
-	// C2PA抽出
-    auto c2pa = C2PAExtractor::ExtractC2PA(path);
-    OutputSection(L"[C2PA]", c2pa);
-
-	// NovelAI抽出
-    auto nai = NAIExtractor::ExtractNAI(path);
-    OutputSection(L"[NovelAI stealth data]", nai);
-
+    TRACE_SCOPE_DETAIL("InspectImage", unicode_to_utf8(path));
+
+    // 前のファイルの抽出がまだ終わっていなければ打ち切る
+    if (m_job) m_job->Cancel();
+    m_stages = {};
+    ShowStages();
+
+    InspectOptions options;
+    options.cache = m_cache.get();
+    PipelineCallbacks callbacks;
+    callbacks.onStage = [hwnd = m_hwnd, jobId = ++m_jobId](const StageResult& stage) {
+        auto* message = new StageMessage{ jobId, stage };
+        if (!PostMessageW(hwnd, WM_STAGE_DONE, 0, (LPARAM)message)) delete message;
+    };
+    m_job = m_pipeline->Start(path, options, std::move(callbacks));
     return true;
 }
 
-// 追加: 色付きテキスト挿入用のヘルパー関数
-void PhantomView::SetColor(COLORREF color) {
-    CHARRANGE cr;
-    SendMessageW(m_hbox, EM_EXGETSEL, 0, (LPARAM)&cr);
-    CHARFORMAT2 cf = {0};
-    cf.cbSize = sizeof(cf);
-    cf.dwMask = CFM_COLOR;
-    cf.crTextColor = color;
-    SendMessageW(m_hbox, EM_SETCHARFORMAT, SCF_SELECTION, (LPARAM)&cf);
-}
-void PhantomView::PutText(const std::wstring& text) {
-    SendMessageW(m_hbox, EM_SETSEL, -1, -1);
-    SendMessageW(m_hbox, EM_REPLACESEL, FALSE, (LPARAM)text.c_str());
-}
+void PhantomView::OnStageDone(LPARAM lParam) {
+    std::unique_ptr<StageMessage> message(reinterpret_cast<StageMessage*>(lParam));
+    if (message->jobId != m_jobId) return;
 
-// 追加: エスケープされたJSON文字列をアンエスケープする関数
-std::wstring UnescapeJsonString(const std::wstring& s) {
-    std::wstring result;
-    for (size_t i = 0; i < s.size(); ++i) {
-        if (s[i] == L'\\' && i + 1 < s.size()) {
-            if (s[i+1] == L'"') {
-                result += L'"';
-                ++i;
-            } else if (s[i+1] == L'\\') {
-                result += L'\\';
-                ++i;
-            } else {
-                result += s[i];
-            }
-        } else {
-            result += s[i];
-        }
-    }
-    return result;
-}
+    m_stages[static_cast<size_t>(message->stage.kind)] = std::move(message->stage);
+    ShowStages();
 
-// JSON整形＆色分け出力
-void PhantomView::OutputAsJSON(const std::wstring& json) {
-    int indent = 0;
-    bool inString = false;
-    bool isKey = true;
-    std::wstring stringValueBuffer;
-    bool capturingStringValue = false;
-    for (size_t i = 0; i < json.size(); ++i) {
-        wchar_t c = json[i];
-        // 空配列・空オブジェクトの特別処理
-        if (!inString && (c == L'{' || c == L'[')) {
-            wchar_t close = (c == L'{') ? L'}' : L']';
-            size_t j = i + 1;
-            while (j < json.size() && iswspace(json[j])) ++j;
-            if (j < json.size() && json[j] == close) {
-                SetColor(COLOR_SYMBOL);
-                PutText(std::wstring(1, c) + std::wstring(1, close));
-                i = j;
-                continue;
-            }
-        }
-        if (c == L'"') {
-            // 直前のバックスラッシュの数を数える
-            size_t backslashCount = 0;
-            size_t k = i;
-            while (k > 0 && json[k-1] == L'\\') {
-                backslashCount++;
-                k--;
-            }
-            if (backslashCount % 2 == 0) { // エスケープされていないクォート
-                inString = !inString;
-                if (inString) {
-                    // 文字列開始
-                    if (isKey) SetColor(COLOR_ATTR);
-                    else SetColor(COLOR_VALUE);
-                    PutText(L"\"");
-                    if (!isKey) {
-                        stringValueBuffer.clear();
-                        capturingStringValue = true;
-                    }
-                } else {
-                    // 文字列終了
-                    if (!isKey && capturingStringValue) {
-                        // 文字列値のバッファをチェック
-                        std::wstring unescaped = UnescapeJsonString(stringValueBuffer);
-                        if (IsJson(unescaped)) {
-                            PutText(L"\""); // 閉じクォート
-                            SetColor(COLOR_SYMBOL);
-                            PutText(L"\r\n" + std::wstring((indent+1) * INDENT_WIDTH, L' '));
-                            // 再帰的に整形出力
-                            OutputAsJSON(unescaped);
-                            PutText(L"\r\n" + std::wstring(indent * INDENT_WIDTH, L' '));
-                            SetColor(COLOR_VALUE);
-                        } else {
-                            PutText(stringValueBuffer + L"\"");
-                        }
-                        capturingStringValue = false;
-                    } else {
-                        PutText(L"\"");
-                    }
-                    SetColor(COLOR_SYMBOL);
-                }
-                continue;
-            } else {
-                // エスケープされたクォート
-                if (inString) {
-                    if (!isKey && capturingStringValue) {
-                        stringValueBuffer += c;
-                    } else {
-                        PutText(std::wstring(1, c));
-                    }
-                } else {
-                    PutText(std::wstring(1, c));
-                }
-                continue;
-            }
-        }
-        if (!inString) {
-            if (c == L'{' || c == L'[') {
-                SetColor(COLOR_SYMBOL);
-                PutText(std::wstring(1, c) + L"\r\n");
-                indent++;
-                PutText(std::wstring(indent * INDENT_WIDTH, L' '));
-                continue;
-            }
-            if (c == L'}' || c == L']') {
-                SetColor(COLOR_SYMBOL);
-                PutText(L"\r\n" + std::wstring((indent-1) * INDENT_WIDTH, L' ') + std::wstring(1, c));
-                indent--;
-                continue;
-            }
-            if (c == L',') {
-                SetColor(COLOR_SYMBOL);
-                PutText(L",");
-                PutText(L"\r\n" + std::wstring(indent * INDENT_WIDTH, L' '));
-                isKey = true;
-                continue;
-            }
-            if (c == L':') {
-                SetColor(COLOR_SYMBOL);
-                PutText(L": ");
-                isKey = false;
-                continue;
-            }
-            if (iswspace(c)) continue;
-        }
-        // 文字列本体
-        if (inString) {
-            if (!isKey && capturingStringValue) {
-                stringValueBuffer += c;
-            } else {
-                PutText(std::wstring(1, c));
-            }
-        } else if (!iswspace(c)) {
-            // 数値やtrue/false/null
-            SetColor(COLOR_VALUE);
-            PutText(std::wstring(1, c));
-        }
-    }
-    SetColor(COLOR_VALUE);
+    bool finished = std::all_of(m_stages.begin(), m_stages.end(), [](const auto& stage) { return stage.has_value(); });
+    if (finished && Trace::Enabled()) OutputDebugStringA(Trace::Summary().c_str());
 }
 
-// XML整形＆色分け出力
-void PhantomView::OutputAsXML(const std::wstring& xml) {
-    int indent = 0;
-    bool inTag = false;
-    bool inAttr = false;
-    bool inValue = false;
-    std::wstring buffer;
-    bool firstTag = true;
-    for (size_t i = 0; i < xml.size(); ++i) {
-        wchar_t c = xml[i];
-        if (c == L'<') {
-            if (!buffer.empty()) {
-                SetColor(COLOR_VALUE);
-                PutText(buffer);
-                buffer.clear();
-            }
-            SetColor(COLOR_SYMBOL);
-            if (!firstTag) {
-                PutText(L"\r\n" + std::wstring(indent * INDENT_WIDTH, L' '));
-            }
-            PutText(L"<");
-            inTag = true;
-            inAttr = false;
-            inValue = false;
-            firstTag = false;
-            continue;
-        }
-        if (c == L'>') {
-            if (!buffer.empty()) {
-                SetColor(COLOR_TAG);
-                PutText(buffer);
-                buffer.clear();
-            }
-            SetColor(COLOR_SYMBOL);
-            PutText(L">");
-            inTag = false;
-            inValue = true;
-            if (i > 0 && xml[i-1] == L'/') {
-                // 空要素タグ
-                inValue = false;
-            }
-            continue;
-        }
-        if (inTag) {
-            if (c == L' ') {
-                if (!buffer.empty()) {
-                    SetColor(COLOR_TAG);
-                    PutText(buffer);
-                    buffer.clear();
-                }
-                SetColor(COLOR_SYMBOL);
-                PutText(L" ");
-                inAttr = true;
+// 届いた結果を決まった順に表示する（未着の抽出処理は「抽出中」と出す）
+void PhantomView::ShowStages() {
+    StyledDocument doc;
+    {
+        TRACE_SCOPE("OutputSection");
+        Formatter formatter(doc);
+        for (size_t i = 0; i < EXTRACTOR_KINDS; ++i) {
+            auto kind = static_cast<ExtractorKind>(i);
+            const auto& stage = m_stages[i];
+            if (!stage) {
+                if (!m_job) continue;
+                MetaList pending;
+                pending.Add(L"status", L"抽出中...");
+                formatter.OutputSection(Inspector::SectionTitle(kind), pending);
                 continue;
             }
-            if (c == L'=') {
-                if (!buffer.empty()) {
-                    SetColor(COLOR_ATTR);
-                    PutText(buffer);
-                    buffer.clear();
-                }
-                SetColor(COLOR_SYMBOL);
-                PutText(L"=");
-                continue;
-            }
-            if (c == L'"') {
-                SetColor(COLOR_VALUE);
-                PutText(L"\"");
-                size_t j = i+1;
-                std::wstring val;
-                while (j < xml.size() && xml[j] != L'"') val += xml[j++];
-                PutText(val);
-                PutText(L"\"");
-                i = j;
-                continue;
-            }
-            buffer += c;
-        } else if (inValue) {
-            if (c == L'<') {
-                inValue = false;
-                --i;
-                continue;
-            }
-            buffer += c;
+            formatter.OutputSection(Inspector::SectionTitle(kind), stage->items);
         }
     }
-    if (!buffer.empty()) {
-        SetColor(COLOR_VALUE);
-        PutText(buffer);
-    }
-    SetColor(COLOR_VALUE);
+    ShowDocument(doc);
+}
+
+// EM_STREAMIN用の読み出しコールバック
+struct RtfReader {
+    const std::string* rtf;
+    size_t pos;
+};
+
+static DWORD CALLBACK ReadRtf(DWORD_PTR cookie, LPBYTE buffer, LONG size, LONG* read) {
+    auto* reader = reinterpret_cast<RtfReader*>(cookie);
+    size_t n = std::min<size_t>(size, reader->rtf->size() - reader->pos);
+    memcpy(buffer, reader->rtf->data() + reader->pos, n);
+    reader->pos += n;
+    *read = static_cast<LONG>(n);
+    return 0;
+}
+
+// 文書をRTFにしてまとめて表示する
+void PhantomView::ShowDocument(const StyledDocument& doc) {
+    TRACE_SCOPE("ShowDocument");
+    std::string rtf = to_rtf(doc);
+    RtfReader reader{ &rtf, 0 };
+    EDITSTREAM es = {};
+    es.dwCookie = reinterpret_cast<DWORD_PTR>(&reader);
+    es.pfnCallback = ReadRtf;
+    SendMessageW(m_hbox, EM_STREAMIN, SF_RTF, (LPARAM)&es);
 }
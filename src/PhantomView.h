@@ -3,7 +3,15 @@
 
 
 #include "resource.h"
-#include "InfoList.h"
+#include "MetaList.h"
+#include "StyledText.h"
+#include "ResultCache.h"
+#include "InspectionPipeline.h"
+#include "ThreadPool.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
 
 class PhantomView {
 public:
@@ -14,24 +22,24 @@ public:
 	void OnSize(HWND hwnd);
 	void OnDropFiles(HWND hwnd, WPARAM wParam);
 	bool InspectImage(const std::wstring& path);
-	void SetColor(COLORREF color);
-	void PutText(const std::wstring& text);
-	bool IsJson(const std::wstring& text);
-	void OutputAsJSON(const std::wstring& json);
-	bool IsXml(const std::wstring& text);
-	void OutputAsXML(const std::wstring& xml);
-	void OutputSection(const std::wstring& title, const info_list& data);
+	void OnStageDone(LPARAM lParam);
+	void ShowStages();
+	void ShowDocument(const StyledDocument& doc);
 
-	static constexpr COLORREF COLOR_KEY    = RGB(0,255,255); // シアン
-	static constexpr COLORREF COLOR_VALUE  = RGB(255,255,255); // 白
-	static constexpr COLORREF COLOR_TAG    = RGB(0,255,255); // シアン
-	static constexpr COLORREF COLOR_ATTR   = RGB(255,255,0); // 黄色
-	static constexpr COLORREF COLOR_SYMBOL = RGB(192,192,192); // グレー
-	static constexpr COLORREF COLOR_TITLE  = RGB(0,255,0); // 緑
-	static constexpr COLORREF COLOR_BG     = RGB(0,0,0); // 黒
-	static constexpr int INDENT_WIDTH = 4;
+	// 抽出処理が1つ終わったことをワーカースレッドから知らせる（lParam は StageMessage*）
+	static constexpr UINT WM_STAGE_DONE = WM_APP + 1;
+	struct StageMessage {
+		uint64_t jobId;
+		StageResult stage;
+	};
 
 private:
 	HWND m_hwnd = nullptr;
 	HWND m_hbox = nullptr;
+	std::unique_ptr<ResultCache> m_cache;	// 開けなかった場合は毎回抽出する
+	std::unique_ptr<ThreadPool> m_pool;
+	std::unique_ptr<InspectionPipeline> m_pipeline;
+	std::shared_ptr<InspectionJob> m_job;	// 表示中のファイルの抽出処理
+	uint64_t m_jobId = 0;					// 古いジョブから届いた結果を捨てるための通し番号
+	std::array<std::optional<StageResult>, EXTRACTOR_KINDS> m_stages;	// 届いた結果（未着は空）
 };
@@ -0,0 +1,92 @@
+﻿#include "framework.h"
+#include "PngChunks.h"
+#include "ByteReader.h"
+#include <cstring>
+
+InflateStatus PngTextChunk::Value(std::string& out) const {
+	if (!compressed) {
+		out.assign(reinterpret_cast<const char*>(text.data()), text.size());
+		return InflateStatus::Ok;
+	}
+	return Inflater::ForThread().Inflate(text, InflateFormat::Zlib, out);
+}
+
+PngChunkIndex::PngChunkIndex(std::span<const uint8_t> data) : m_data(data) {
+	// PNGシグネチャの確認
+	if (data.size() < 8 || memcmp(data.data(), "\x89PNG\r\n\x1a\n", 8) != 0) return;
+	m_valid = true;
+
+	size_t pos = 8;
+	while (pos + 8 <= data.size()) {
+		// チャンクの長さとタイプ（長さはビッグエンディアン）
+		uint32_t length = read_be32(&data[pos]);
+		size_t start = pos + 8;
+		if (length > data.size() - start) break;
+
+		PngChunk& chunk = m_chunks.emplace_back();
+		memcpy(chunk.type, &data[pos + 4], 4);
+		chunk.offset = start;
+		chunk.length = length;
+		pos = start + length + 4; // CRCをスキップ
+
+		// IENDチャンクが見つかったら終了
+		if (chunk.Is("IEND")) break;
+	}
+}
+
+const PngChunk* PngChunkIndex::Find(std::string_view type) const {
+	for (const auto& chunk : m_chunks) {
+		if (chunk.Is(type)) return &chunk;
+	}
+	return nullptr;
+}
+
+bool PngChunkIndex::ReadText(const PngChunk& chunk, PngTextChunk& text) const {
+	auto data = Data(chunk);
+	std::string_view view(reinterpret_cast<const char*>(data.data()), data.size());
+
+	// どの形式も "keyword\0" で始まる
+	auto null_pos = view.find('\0');
+	if (null_pos == std::string_view::npos) return false;
+	text = {};
+	text.keyword = view.substr(0, null_pos);
+	size_t pos = null_pos + 1;
+
+	if (chunk.Is("tEXt")) {
+		// keyword\0 text
+		text.text = data.subspan(pos);
+		return true;
+	}
+	if (chunk.Is("zTXt")) {
+		// keyword\0 圧縮方式 圧縮データ
+		if (pos >= data.size() || data[pos] != 0) return false;
+		text.text = data.subspan(pos + 1);
+		text.compressed = true;
+		return true;
+	}
+	if (chunk.Is("iTXt")) {
+		// keyword\0 圧縮フラグ 圧縮方式 言語タグ\0 翻訳キーワード\0 テキスト
+		if (pos + 2 > data.size()) return false;
+		text.compressed = data[pos] != 0;
+		if (text.compressed && data[pos + 1] != 0) return false;
+		pos += 2;
+		auto lang_end = view.find('\0', pos);
+		if (lang_end == std::string_view::npos) return false;
+		auto translated_end = view.find('\0', lang_end + 1);
+		if (translated_end == std::string_view::npos) return false;
+		text.language = view.substr(pos, lang_end - pos);
+		text.translatedKeyword = view.substr(lang_end + 1, translated_end - lang_end - 1);
+		text.text = data.subspan(translated_end + 1);
+		return true;
+	}
+	return false;
+}
+
+std::vector<PngTextChunk> PngChunkIndex::TextChunks() const {
+	std::vector<PngTextChunk> texts;
+	for (const auto& chunk : m_chunks) {
+		PngTextChunk text;
+		if (ReadText(chunk, text)) texts.push_back(text);
+	}
+	return texts;
+}
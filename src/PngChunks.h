@@ -0,0 +1,52 @@
+﻿#pragma once
+#include "Inflater.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PngChunk {
+	char type[4];
+	size_t offset;		// データの先頭（長さと種類の後ろ）
+	uint32_t length;	// データの長さ（CRCは含まない）
+
+	bool Is(std::string_view name) const { return name.size() == 4 && memcmp(type, name.data(), 4) == 0; }
+};
+
+// tEXt/zTXt/iTXtの中身
+// 値は圧縮されたまま保持し、Value() を呼んだときに初めて展開する
+struct PngTextChunk {
+	std::string_view keyword;
+	std::string_view language;			// iTXtのみ
+	std::string_view translatedKeyword;	// iTXtのみ
+	std::span<const uint8_t> text;		// 圧縮されている場合はzlibのデータ
+	bool compressed = false;
+
+	InflateStatus Value(std::string& out) const;
+};
+
+// PNGのチャンク一覧（種類・位置・長さ）
+// 一度だけ先頭から走査し、以降は必要なチャンクへ直接アクセスする
+class PngChunkIndex {
+public:
+	explicit PngChunkIndex(std::span<const uint8_t> data);
+
+	// PNGのシグネチャがあったか
+	bool Valid() const { return m_valid; }
+
+	const std::vector<PngChunk>& Chunks() const { return m_chunks; }
+	const PngChunk* Find(std::string_view type) const;
+	std::span<const uint8_t> Data(const PngChunk& chunk) const { return m_data.subspan(chunk.offset, chunk.length); }
+
+	// テキストチャンクを解析する（値の展開はしない）
+	bool ReadText(const PngChunk& chunk, PngTextChunk& text) const;
+	std::vector<PngTextChunk> TextChunks() const;
+
+private:
+	std::span<const uint8_t> m_data;
+	std::vector<PngChunk> m_chunks;
+	bool m_valid = false;
+};
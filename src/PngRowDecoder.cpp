@@ -0,0 +1,291 @@
+﻿#include "PngRowDecoder.h"
+#include "ByteReader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+// 寸法だけが大きい壊れたファイルで巨大な確保をしないように制限する（WebpAlphaDecoderと同じ上限）
+static constexpr uint64_t MAX_PIXELS = 64ull * 1024 * 1024;
+// deflateの最大圧縮率（1バイトの符号で最長258バイトを2回まで繰り返す）
+static constexpr uint64_t MAX_DEFLATE_RATIO = 1032;
+
+// 対応しているビット深度と色の組み合わせか
+static bool IsSupportedFormat(uint8_t colorType, uint8_t bitDepth) {
+	switch (colorType) {
+	case 0: return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16;
+	case 3: return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8;
+	case 2:
+	case 4:
+	case 6: return bitDepth == 8 || bitDepth == 16;
+	default: return false;
+	}
+}
+
+static size_t ChannelCount(uint8_t colorType) {
+	switch (colorType) {
+	case 2: return 3;
+	case 4: return 2;
+	case 6: return 4;
+	default: return 1;
+	}
+}
+
+bool ReadPngHeader(std::span<const uint8_t> data, PngHeader& header) {
+	if (data.size() < 33 || memcmp(data.data(), PNG_SIGNATURE, 8) != 0) return false;
+	if (read_be32(&data[8]) != 13 || memcmp(&data[12], "IHDR", 4) != 0) return false;
+
+	header.width = read_be32(&data[16]);
+	header.height = read_be32(&data[20]);
+	header.bitDepth = data[24];
+	header.colorType = data[25];
+	header.interlace = data[28];
+
+	// tRNSはIDATより前にある
+	size_t pos = 33;
+	while (pos + 8 <= data.size()) {
+		uint32_t length = read_be32(&data[pos]);
+		const uint8_t* type = &data[pos + 4];
+		if (memcmp(type, "IDAT", 4) == 0 || memcmp(type, "IEND", 4) == 0) break;
+		if (memcmp(type, "tRNS", 4) == 0) header.hasTransparency = true;
+		if (length > data.size() - pos - 12) break;
+		pos += 12 + length;
+	}
+	return header.width > 0 && header.height > 0;
+}
+
+PngRowDecoder::PngRowDecoder(std::span<const uint8_t> data) : m_data(data) {
+	if (!ReadPngHeader(data, m_header)) return;
+	if (static_cast<uint64_t>(m_header.width) * m_header.height > MAX_PIXELS) {
+		m_tooLarge = true;
+		return;
+	}
+	if (m_header.interlace != 0 || !IsSupportedFormat(m_header.colorType, m_header.bitDepth)) return;
+
+	size_t bitsPerPixel = ChannelCount(m_header.colorType) * m_header.bitDepth;
+	m_bpp = (bitsPerPixel + 7) / 8;
+	uint64_t rowBytes = (static_cast<uint64_t>(m_header.width) * bitsPerPixel + 7) / 8;
+	m_rowBytes = static_cast<size_t>(rowBytes);
+
+	m_pos = 33;
+	if (!ParseChunks()) return;
+
+	// 1行目すら展開できない量の圧縮データしか無ければ、行のバッファを確保する前に弾く
+	if (rowBytes + 1 > CompressedSize() * MAX_DEFLATE_RATIO) {
+		m_tooLarge = true;
+		return;
+	}
+
+	if (inflateInit(&m_stream) != Z_OK) return;
+	m_streamInit = true;
+
+	m_cur.resize(m_rowBytes + 1);
+	m_prev.assign(m_rowBytes, 0);
+	m_rgba.resize(static_cast<size_t>(m_header.width) * 4);
+	m_valid = true;
+}
+
+PngRowDecoder::~PngRowDecoder() {
+	if (m_streamInit) inflateEnd(&m_stream);
+}
+
+// 最初のIDATまでのチャンク（PLTE、tRNS）を読む
+bool PngRowDecoder::ParseChunks() {
+	if (m_header.colorType == 3) {
+		m_palette.assign(256 * 4, 0);
+		for (size_t i = 0; i < 256; ++i) m_palette[i * 4 + 3] = 255;
+	}
+
+	while (m_pos + 8 <= m_data.size()) {
+		uint32_t length = read_be32(&m_data[m_pos]);
+		const uint8_t* type = &m_data[m_pos + 4];
+		size_t start = m_pos + 8;
+		if (length > m_data.size() - start) return false;
+		const uint8_t* body = &m_data[start];
+
+		if (memcmp(type, "IDAT", 4) == 0) return true;
+		if (memcmp(type, "IEND", 4) == 0) return false;
+
+		if (memcmp(type, "PLTE", 4) == 0 && m_header.colorType == 3) {
+			for (size_t i = 0; i < length / 3 && i < 256; ++i) {
+				memcpy(&m_palette[i * 4], body + i * 3, 3);
+			}
+		} else if (memcmp(type, "tRNS", 4) == 0) {
+			if (m_header.colorType == 3) {
+				for (size_t i = 0; i < length && i < 256; ++i) m_palette[i * 4 + 3] = body[i];
+			} else if (m_header.colorType == 0 && length >= 2) {
+				m_transparent[0] = read_be16(body);
+			} else if (m_header.colorType == 2 && length >= 6) {
+				for (int c = 0; c < 3; ++c) m_transparent[c] = read_be16(body + c * 2);
+			}
+		}
+		m_pos = start + length + 4;
+	}
+	return false;
+}
+
+// 連続するIDATチャンクの合計サイズ
+uint64_t PngRowDecoder::CompressedSize() const {
+	uint64_t total = 0;
+	size_t pos = m_pos;
+	while (pos + 8 <= m_data.size()) {
+		uint32_t length = read_be32(&m_data[pos]);
+		if (memcmp(&m_data[pos + 4], "IDAT", 4) != 0) break;
+		size_t start = pos + 8;
+		total += std::min<uint64_t>(length, m_data.size() - start);
+		if (length > m_data.size() - start) break;
+		pos = start + length + 4;
+	}
+	return total;
+}
+
+// 次のIDATチャンクを入力に渡す
+bool PngRowDecoder::FeedInput() {
+	while (m_pos + 8 <= m_data.size()) {
+		uint32_t length = read_be32(&m_data[m_pos]);
+		const uint8_t* type = &m_data[m_pos + 4];
+		size_t start = m_pos + 8;
+		if (length > m_data.size() - start) return false;
+		if (memcmp(type, "IDAT", 4) != 0) return false; // IDATは連続している
+		m_pos = start + length + 4;
+		if (length == 0) continue;
+
+		m_stream.next_in = const_cast<Bytef*>(&m_data[start]);
+		m_stream.avail_in = length;
+		return true;
+	}
+	return false;
+}
+
+const uint8_t* PngRowDecoder::NextRow() {
+	if (!m_valid || m_row >= m_header.height) return nullptr;
+
+	m_stream.next_out = m_cur.data();
+	m_stream.avail_out = static_cast<uInt>(m_cur.size());
+	while (m_stream.avail_out > 0) {
+		if (m_stream.avail_in == 0 && !FeedInput()) {
+			m_valid = false;
+			return nullptr;
+		}
+		int ret = inflate(&m_stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END && m_stream.avail_out > 0) ret = Z_DATA_ERROR;
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			m_valid = false;
+			return nullptr;
+		}
+	}
+
+	Unfilter(m_cur[0]);
+	ConvertRow();
+	memcpy(m_prev.data(), m_cur.data() + 1, m_rowBytes);
+	++m_row;
+	return m_rgba.data();
+}
+
+static inline uint8_t Paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+	if (pb <= pc) return static_cast<uint8_t>(b);
+	return static_cast<uint8_t>(c);
+}
+
+void PngRowDecoder::Unfilter(uint8_t filter) {
+	uint8_t* cur = m_cur.data() + 1;
+	const uint8_t* prev = m_prev.data();
+	size_t n = m_rowBytes;
+	size_t bpp = m_bpp;
+
+	switch (filter) {
+	case 1: // Sub
+		for (size_t i = bpp; i < n; ++i) cur[i] = static_cast<uint8_t>(cur[i] + cur[i - bpp]);
+		break;
+	case 2: // Up
+		for (size_t i = 0; i < n; ++i) cur[i] = static_cast<uint8_t>(cur[i] + prev[i]);
+		break;
+	case 3: // Average
+		for (size_t i = 0; i < n; ++i) {
+			int left = i >= bpp ? cur[i - bpp] : 0;
+			cur[i] = static_cast<uint8_t>(cur[i] + ((left + prev[i]) >> 1));
+		}
+		break;
+	case 4: // Paeth
+		for (size_t i = 0; i < n; ++i) {
+			int left = i >= bpp ? cur[i - bpp] : 0;
+			int upLeft = i >= bpp ? prev[i - bpp] : 0;
+			cur[i] = static_cast<uint8_t>(cur[i] + Paeth(left, prev[i], upLeft));
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// 展開した1行をRGBA8にする（16ビットは上位バイトを使う）
+void PngRowDecoder::ConvertRow() {
+	const uint8_t* src = m_cur.data() + 1;
+	uint8_t* dst = m_rgba.data();
+	size_t width = m_header.width;
+	uint8_t depth = m_header.bitDepth;
+
+	switch (m_header.colorType) {
+	case 6:
+		if (depth == 8) {
+			memcpy(dst, src, width * 4);
+		} else {
+			for (size_t x = 0; x < width; ++x) {
+				for (int c = 0; c < 4; ++c) dst[x * 4 + c] = src[x * 8 + c * 2];
+			}
+		}
+		break;
+	case 4:
+		for (size_t x = 0; x < width; ++x) {
+			size_t step = depth / 8 * 2;
+			uint8_t g = src[x * step];
+			uint8_t a = src[x * step + step / 2];
+			dst[x * 4 + 0] = g;
+			dst[x * 4 + 1] = g;
+			dst[x * 4 + 2] = g;
+			dst[x * 4 + 3] = a;
+		}
+		break;
+	case 2:
+		for (size_t x = 0; x < width; ++x) {
+			bool transparent = m_header.hasTransparency;
+			for (int c = 0; c < 3; ++c) {
+				uint16_t v = depth == 8 ? src[x * 3 + c] : read_be16(&src[x * 6 + c * 2]);
+				dst[x * 4 + c] = depth == 8 ? static_cast<uint8_t>(v) : static_cast<uint8_t>(v >> 8);
+				transparent = transparent && v == m_transparent[c];
+			}
+			dst[x * 4 + 3] = transparent ? 0 : 255;
+		}
+		break;
+	case 0:
+	case 3:
+		for (size_t x = 0; x < width; ++x) {
+			// サブバイトの画素は上位ビットから並んでいる
+			uint16_t v;
+			if (depth == 16) {
+				v = read_be16(&src[x * 2]);
+			} else if (depth == 8) {
+				v = src[x];
+			} else {
+				size_t bit = x * depth;
+				v = (src[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1);
+			}
+			if (m_header.colorType == 3) {
+				memcpy(&dst[x * 4], &m_palette[v * 4], 4);
+				continue;
+			}
+			uint8_t g = depth == 16 ? static_cast<uint8_t>(v >> 8) : static_cast<uint8_t>(v * 255 / ((1 << depth) - 1));
+			dst[x * 4 + 0] = g;
+			dst[x * 4 + 1] = g;
+			dst[x * 4 + 2] = g;
+			dst[x * 4 + 3] = (m_header.hasTransparency && v == m_transparent[0]) ? 0 : 255;
+		}
+		break;
+	}
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <zlib.h>
+
+// PNGのIHDRの内容
+struct PngHeader {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint8_t bitDepth = 0;
+	uint8_t colorType = 0;
+	uint8_t interlace = 0;
+	bool hasTransparency = false;	// tRNSチャンクの有無
+
+	// アルファチャンネル（またはtRNSによる透過）を持つか
+	bool HasAlpha() const { return colorType == 4 || colorType == 6 || hasTransparency; }
+};
+
+// IDATより前のチャンクだけを見てヘッダーを読む
+bool ReadPngHeader(std::span<const uint8_t> data, PngHeader& header);
+
+// PNGをIDATから1行ずつ展開し、RGBA8に変換して返す
+// 必要な行数だけ展開して途中でやめられる（インターレースは非対応）
+class PngRowDecoder {
+public:
+	explicit PngRowDecoder(std::span<const uint8_t> data);
+	~PngRowDecoder();
+	PngRowDecoder(const PngRowDecoder&) = delete;
+	PngRowDecoder& operator=(const PngRowDecoder&) = delete;
+
+	bool Valid() const { return m_valid; }
+	// 寸法が上限を超えている、または圧縮データに見合わない（確保せずに諦めた）
+	bool TooLarge() const { return m_tooLarge; }
+	const PngHeader& Header() const { return m_header; }
+	uint32_t RowsDecoded() const { return m_row; }
+
+	// 次の行（RGBA8、幅×4バイト）を返す。終端やエラーの場合は nullptr
+	const uint8_t* NextRow();
+
+private:
+	bool ParseChunks();
+	bool FeedInput();
+	uint64_t CompressedSize() const;
+	void Unfilter(uint8_t filter);
+	void ConvertRow();
+
+	std::span<const uint8_t> m_data;
+	PngHeader m_header;
+	bool m_valid = false;
+	bool m_tooLarge = false;
+	bool m_streamInit = false;
+	z_stream m_stream = {};
+	size_t m_pos = 0;				// 次に探すチャンクの位置
+	size_t m_bpp = 0;				// フィルタ計算用のバイト/画素（最小1）
+	size_t m_rowBytes = 0;
+	uint32_t m_row = 0;
+	std::vector<uint8_t> m_cur;		// フィルタ種別 + 1行分
+	std::vector<uint8_t> m_prev;
+	std::vector<uint8_t> m_rgba;
+	std::vector<uint8_t> m_palette;	// RGBA × 256
+	uint16_t m_transparent[3] = {};	// グレー/RGBの透過色
+};
@@ -0,0 +1,398 @@
+﻿#include "framework.h"
+#include "ResultCache.h"
+#include "TextUtils.h"
+#include "Inflater.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char INDEX_MAGIC[8] = {'P', 'V', 'C', 'A', 'C', 'H', 'E', '2'};
+static constexpr uint64_t INITIAL_CAPACITY = 4096;
+
+struct ResultCache::Header {
+	char magic[8];
+	uint32_t inspectorVersion;
+	uint32_t contentHash;	// 内容のハッシュで引くキャッシュか
+	uint64_t capacity;		// スロット数（2のべき乗）
+	uint64_t count;
+};
+
+struct ResultCache::Slot {
+	uint64_t hash;			// 0 は空きスロット
+	CacheKey key;
+	uint64_t offset;		// data.bin 内の位置
+	uint32_t length;
+	uint32_t checksum;		// 書き込み途中で終わったデータを弾くため
+};
+
+static uint64_t Mix(uint64_t x) {
+	// splitmix64の仕上げ
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t HashKey(const CacheKey& key) {
+	uint64_t h = Mix(key.device + 0x9E3779B97F4A7C15ull);
+	h = Mix(h ^ key.inode);
+	h = Mix(h ^ key.size);
+	h = Mix(h ^ key.mtime);
+	h = Mix(h ^ key.contentHash);
+	h = Mix(h ^ key.inflateLimit);
+	return h ? h : 1;
+}
+
+uint64_t content_hash64(std::span<const uint8_t> data) {
+	// 4レーンで8バイトずつ混ぜる
+	constexpr uint64_t K = 0x9E3779B97F4A7C15ull;
+	uint64_t lanes[4] = {K, K * 3, K * 5, K * 7};
+	size_t pos = 0;
+	for (; pos + 32 <= data.size(); pos += 32) {
+		for (int i = 0; i < 4; ++i) {
+			uint64_t word;
+			memcpy(&word, &data[pos + i * 8], 8);
+			lanes[i] = (lanes[i] ^ word) * 0xFF51AFD7ED558CCDull;
+			lanes[i] ^= lanes[i] >> 32;
+		}
+	}
+	uint64_t h = data.size();
+	for (uint64_t lane : lanes) h = Mix(h ^ lane);
+	for (; pos < data.size(); ++pos) h = (h ^ data[pos]) * 0x100000001B3ull;
+	return Mix(h);
+}
+
+// 結果の直列化（UTF-8、長さ付き。項目ごとにキー・値・種類・位置）
+template <class T>
+static void Put(std::string& out, T value) {
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void PutList(std::string& out, const MetaList& list) {
+	Put(out, static_cast<uint32_t>(list.size()));
+	for (const auto& entry : list) {
+		for (auto text : {entry.key, entry.value}) {
+			Put(out, static_cast<uint32_t>(text.size()));
+			out += text;
+		}
+		Put(out, static_cast<uint8_t>(entry.type));
+		Put(out, entry.offset);
+	}
+}
+
+template <class T>
+static bool Get(std::string_view& in, T& value) {
+	if (in.size() < sizeof(value)) return false;
+	memcpy(&value, in.data(), sizeof(value));
+	in.remove_prefix(sizeof(value));
+	return true;
+}
+
+// 値は読み込んだバッファ（source）を直接参照する
+static bool GetList(std::string_view& in, const std::shared_ptr<const void>& source, MetaList& list) {
+	uint32_t count;
+	if (!Get(in, count)) return false;
+	list.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		std::string_view text[2];
+		for (auto& t : text) {
+			uint32_t length;
+			if (!Get(in, length) || in.size() < length) return false;
+			t = in.substr(0, length);
+			in.remove_prefix(length);
+		}
+		uint8_t type;
+		uint64_t offset;
+		if (!Get(in, type) || !Get(in, offset) || type > static_cast<uint8_t>(MetaType::Number)) return false;
+		list.AddView(text[0], text[1], source, static_cast<MetaType>(type), offset);
+	}
+	return true;
+}
+
+static FILE* OpenDataFile(const std::filesystem::path& path, bool truncate) {
+#ifdef _WIN32
+	FILE* file = truncate ? nullptr : _wfopen(path.c_str(), L"r+b");
+	return file ? file : _wfopen(path.c_str(), L"w+b");
+#else
+	FILE* file = truncate ? nullptr : fopen(path.c_str(), "r+b");
+	return file ? file : fopen(path.c_str(), "w+b");
+#endif
+}
+
+static bool SeekData(FILE* file, uint64_t offset, int origin) {
+#ifdef _WIN32
+	return _fseeki64(file, static_cast<__int64>(offset), origin) == 0;
+#else
+	return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+static uint64_t TellData(FILE* file) {
+#ifdef _WIN32
+	return static_cast<uint64_t>(_ftelli64(file));
+#else
+	return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+ResultCache::~ResultCache() {
+	UnmapIndex();
+	if (m_dataFile) fclose(m_dataFile);
+}
+
+std::filesystem::path ResultCache::DefaultDirectory() {
+#ifdef _WIN32
+	if (const wchar_t* local = _wgetenv(L"LOCALAPPDATA")) {
+		return std::filesystem::path(local) / L"PhantomView" / L"cache";
+	}
+	return std::filesystem::temp_directory_path() / L"PhantomView" / L"cache";
+#else
+	if (const char* cache = getenv("XDG_CACHE_HOME"); cache && *cache) {
+		return std::filesystem::path(cache) / "phantomview";
+	}
+	if (const char* home = getenv("HOME")) {
+		return std::filesystem::path(home) / ".cache" / "phantomview";
+	}
+	return std::filesystem::temp_directory_path() / "phantomview";
+#endif
+}
+
+std::unique_ptr<ResultCache> ResultCache::Open(const std::filesystem::path& directory, bool contentHash) {
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	std::unique_ptr<ResultCache> cache(new ResultCache());
+	cache->m_directory = directory;
+	cache->m_contentHash = contentHash;
+
+	// 既存の索引を開いて、版が違えば作り直す
+	if (!cache->MapIndex(0)) return nullptr;
+	Header* header = cache->IndexHeader();
+	bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+		header->inspectorVersion == Inspector::VERSION &&
+		header->contentHash == static_cast<uint32_t>(contentHash) &&
+		header->capacity > 0 && sizeof(Header) + header->capacity * sizeof(Slot) <= cache->m_indexSize;
+	if (valid) {
+		cache->m_dataFile = OpenDataFile(directory / "data.bin", false);
+		if (!cache->m_dataFile) return nullptr;
+		return cache;
+	}
+	if (!cache->Reset()) return nullptr;
+	return cache;
+}
+
+// 索引をマップする（capacity が 0 ならファイルの今の大きさで開く）
+bool ResultCache::MapIndex(uint64_t capacity) {
+	UnmapIndex();
+	auto path = m_directory / "index.bin";
+	size_t size = capacity ? sizeof(Header) + capacity * sizeof(Slot) : 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	m_indexFile = file;
+	if (!size) {
+		LARGE_INTEGER current;
+		if (!GetFileSizeEx(file, &current)) return false;
+		size = static_cast<size_t>(current.QuadPart);
+	}
+	if (size < sizeof(Header)) size = sizeof(Header) + INITIAL_CAPACITY * sizeof(Slot);
+
+	// 指定した大きさでマップするとファイルも伸びる
+	LARGE_INTEGER mapSize;
+	mapSize.QuadPart = static_cast<LONGLONG>(size);
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, mapSize.HighPart, mapSize.LowPart, nullptr);
+	if (!mapping) return false;
+	m_indexMapping = mapping;
+	void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!view) return false;
+#else
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return false;
+	m_indexFd = fd;
+	// Windowsの共有モード（読み取りのみ共有）と同じく、書き込むプロセスを1つに限る
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0) return false;
+	if (!size) {
+		struct stat st;
+		if (fstat(fd, &st) != 0) return false;
+		size = static_cast<size_t>(st.st_size);
+	}
+	if (size < sizeof(Header)) size = sizeof(Header) + INITIAL_CAPACITY * sizeof(Slot);
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0) return false;
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED) return false;
+#endif
+	m_index = view;
+	m_indexSize = size;
+	return true;
+}
+
+void ResultCache::UnmapIndex() {
+#ifdef _WIN32
+	if (m_index) UnmapViewOfFile(m_index);
+	if (m_indexMapping) CloseHandle(m_indexMapping);
+	if (m_indexFile && m_indexFile != INVALID_HANDLE_VALUE) CloseHandle(m_indexFile);
+	m_indexMapping = nullptr;
+	m_indexFile = nullptr;
+#else
+	if (m_index) munmap(m_index, m_indexSize);
+	if (m_indexFd >= 0) close(m_indexFd);
+	m_indexFd = -1;
+#endif
+	m_index = nullptr;
+	m_indexSize = 0;
+}
+
+ResultCache::Header* ResultCache::IndexHeader() const {
+	return static_cast<Header*>(m_index);
+}
+
+ResultCache::Slot* ResultCache::Slots() const {
+	return reinterpret_cast<Slot*>(static_cast<uint8_t*>(m_index) + sizeof(Header));
+}
+
+// 空にして作り直す
+bool ResultCache::Reset() {
+	if (!MapIndex(INITIAL_CAPACITY)) return false;
+	memset(m_index, 0, m_indexSize);
+	Header* header = IndexHeader();
+	memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header->inspectorVersion = Inspector::VERSION;
+	header->contentHash = m_contentHash;
+	header->capacity = INITIAL_CAPACITY;
+	header->count = 0;
+
+	if (m_dataFile) fclose(m_dataFile);
+	m_dataFile = OpenDataFile(m_directory / "data.bin", true);
+	return m_dataFile != nullptr;
+}
+
+// スロットを倍に増やして入れ直す
+bool ResultCache::Grow() {
+	const Header* header = IndexHeader();
+	uint64_t capacity = header->capacity * 2;
+	std::vector<Slot> slots(Slots(), Slots() + header->capacity);
+	uint64_t count = header->count;
+
+	if (!MapIndex(capacity)) return false;
+	std::fill_n(Slots(), capacity, Slot{});
+	IndexHeader()->capacity = capacity;
+	IndexHeader()->count = count;
+	for (const auto& slot : slots) {
+		if (!slot.hash) continue;
+		*FindSlot(slot.key, slot.hash) = slot;
+	}
+	return true;
+}
+
+// キーのスロット（無ければ入れるべき空きスロット）を線形探査で探す
+ResultCache::Slot* ResultCache::FindSlot(const CacheKey& key, uint64_t hash) const {
+	uint64_t mask = IndexHeader()->capacity - 1;
+	Slot* slots = Slots();
+	for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+		Slot& slot = slots[i];
+		if (!slot.hash || (slot.hash == hash && slot.key == key)) return &slot;
+	}
+}
+
+bool ResultCache::MakeKey(const ImageBuffer& image, CacheKey& key) const {
+	key = {};
+	key.size = image.size();
+	key.inflateLimit = Inflater::DefaultLimit();
+	if (m_contentHash) {
+		key.contentHash = content_hash64(image.span());
+		return true;
+	}
+	if (image.path().empty()) return false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(image.path().c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	BY_HANDLE_FILE_INFORMATION info;
+	BOOL ok = GetFileInformationByHandle(file, &info);
+	CloseHandle(file);
+	if (!ok) return false;
+	key.device = info.dwVolumeSerialNumber;
+	key.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+	key.mtime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(image.path().c_str(), &st) != 0) return false;
+	key.device = static_cast<uint64_t>(st.st_dev);
+	key.inode = static_cast<uint64_t>(st.st_ino);
+	key.mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+#endif
+	return true;
+}
+
+bool ResultCache::Lookup(const CacheKey& key, InspectionResult& result) {
+	std::lock_guard lock(m_mutex);
+	if (!m_index || !m_dataFile) return false;
+
+	uint64_t hash = HashKey(key);
+	const Slot* slot = FindSlot(key, hash);
+	if (!slot->hash) return false;
+
+	auto data = std::make_shared<std::string>(slot->length, '\0');
+	if (!SeekData(m_dataFile, slot->offset, SEEK_SET)) return false;
+	if (fread(data->data(), 1, data->size(), m_dataFile) != data->size()) return false;
+	if (static_cast<uint32_t>(content_hash64({reinterpret_cast<const uint8_t*>(data->data()), data->size()})) != slot->checksum) return false;
+
+	std::string_view in = *data;
+	InspectionResult cached;
+	if (!GetList(in, data, cached.meta) || !GetList(in, data, cached.c2pa) || !GetList(in, data, cached.nai)) return false;
+	cached.path = std::move(result.path);
+	result = std::move(cached);
+	return true;
+}
+
+void ResultCache::Store(const CacheKey& key, const InspectionResult& result) {
+	std::string data;
+	PutList(data, result.meta);
+	PutList(data, result.c2pa);
+	PutList(data, result.nai);
+
+	std::lock_guard lock(m_mutex);
+	if (!m_index || !m_dataFile) return;
+
+	// 使用率が7割を超えたら広げる
+	Header* header = IndexHeader();
+	if ((header->count + 1) * 10 > header->capacity * 7) {
+		if (!Grow()) return;
+		header = IndexHeader();
+	}
+
+	// データを書き終えてから索引を更新する
+	if (!SeekData(m_dataFile, 0, SEEK_END)) return;
+	uint64_t offset = TellData(m_dataFile);
+	if (fwrite(data.data(), 1, data.size(), m_dataFile) != data.size()) return;
+	fflush(m_dataFile);
+
+	uint64_t hash = HashKey(key);
+	Slot* slot = FindSlot(key, hash);
+	if (!slot->hash) ++header->count;
+	slot->hash = hash;
+	slot->key = key;
+	slot->offset = offset;
+	slot->length = static_cast<uint32_t>(data.size());
+	slot->checksum = static_cast<uint32_t>(content_hash64({reinterpret_cast<const uint8_t*>(data.data()), data.size()}));
+}
+
+void ResultCache::Clear() {
+	std::lock_guard lock(m_mutex);
+	Reset();
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+#include "Inspector.h"
+#include "ImageBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+
+// キャッシュのキー
+// 通常はファイルの識別情報（デバイス・iノード・サイズ・更新日時）で引く
+// 内容のハッシュを使う場合はサイズとハッシュだけで引く（コピーや移動したファイルも当たる）
+// 展開サイズの上限で結果（上限超えのエラー）が変わるので、上限もキーに含める
+struct CacheKey {
+	uint64_t device = 0;
+	uint64_t inode = 0;
+	uint64_t size = 0;
+	uint64_t mtime = 0;
+	uint64_t contentHash = 0;
+	uint64_t inflateLimit = 0;
+
+	bool operator==(const CacheKey&) const = default;
+};
+
+// 抽出結果のディスクキャッシュ
+// index.bin はメモリマップしたオープンアドレス法のハッシュ表（キー → data.bin の位置）で、
+// 引くときに全体を読み込む必要は無い。data.bin は結果を追記していくログ
+// ヘッダーの Inspector::VERSION が今の値と違えば作り直す
+// 書き込むのは1プロセスだけ（index.bin を排他で開き、他のプロセスが使っている間は開けない）
+class ResultCache {
+public:
+	~ResultCache();
+	ResultCache(const ResultCache&) = delete;
+	ResultCache& operator=(const ResultCache&) = delete;
+
+	// 開けなければ nullptr
+	static std::unique_ptr<ResultCache> Open(const std::filesystem::path& directory, bool contentHash = false);
+	static std::filesystem::path DefaultDirectory();
+
+	bool MakeKey(const ImageBuffer& image, CacheKey& key) const;
+
+	bool Lookup(const CacheKey& key, InspectionResult& result);
+	void Store(const CacheKey& key, const InspectionResult& result);
+	void Clear();
+
+private:
+	struct Header;
+	struct Slot;
+
+	ResultCache() = default;
+	bool MapIndex(uint64_t capacity);
+	void UnmapIndex();
+	bool Reset();
+	bool Grow();
+	Header* IndexHeader() const;
+	Slot* Slots() const;
+	Slot* FindSlot(const CacheKey& key, uint64_t hash) const;
+
+	std::filesystem::path m_directory;
+	bool m_contentHash = false;
+	std::mutex m_mutex;
+	FILE* m_dataFile = nullptr;
+	void* m_index = nullptr;
+	size_t m_indexSize = 0;
+#ifdef _WIN32
+	void* m_indexFile = nullptr;
+	void* m_indexMapping = nullptr;
+#else
+	int m_indexFd = -1;
+#endif
+};
+
+// 高速な64ビットハッシュ（暗号用ではない）
+uint64_t content_hash64(std::span<const uint8_t> data);
@@ -0,0 +1,278 @@
+﻿#include "framework.h"
+#include "ResultWriter.h"
+#include "ArrowWriter.h"
+#include "Formatter.h"
+#include "TextUtils.h"
+#include "Trace.h"
+
+std::unique_ptr<ResultWriter> create_result_writer(FILE* file, OutputFormat format) {
+	switch (format) {
+	case OutputFormat::Ansi: return std::make_unique<TextResultWriter>(file, TextFormat::Ansi);
+	case OutputFormat::Html: return std::make_unique<TextResultWriter>(file, TextFormat::Html);
+	case OutputFormat::JsonLines: return std::make_unique<JsonLinesResultWriter>(file);
+	case OutputFormat::Arrow: return std::make_unique<ArrowResultWriter>(file);
+	default: return std::make_unique<TextResultWriter>(file, TextFormat::Plain);
+	}
+}
+
+const char* section_name(ExtractorKind kind) {
+	switch (kind) {
+	case ExtractorKind::Meta: return "meta";
+	case ExtractorKind::C2PA: return "c2pa";
+	default: return "nai";
+	}
+}
+
+void BufferedOutput::Drain() {
+	if (m_buffer.empty()) return;
+	fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+	m_buffer.clear();
+}
+
+void TextResultWriter::Put(const std::string& text) {
+	fwrite(text.data(), 1, text.size(), m_file);
+}
+
+void TextResultWriter::Write(const InspectionResult& result) {
+	if (!m_started && m_format == TextFormat::Html) Put(html_header());
+	m_started = true;
+
+	TRACE_SCOPE_DETAIL("TextResultWriter::Write", path_to_utf8(result.path));
+	StyledDocument doc;
+	doc.SetStyle(TextStyle::Title);
+	doc.Append(path_to_unicode(result.path) + L"\r\n");
+
+	Formatter formatter(doc);
+	formatter.OutputSection(L"[MetaData]", result.meta);
+	formatter.OutputSection(L"[C2PA]", result.c2pa);
+	formatter.OutputSection(L"[NovelAI stealth data]", result.nai);
+
+	switch (m_format) {
+	case TextFormat::Ansi: Put(to_ansi(doc) + "\n"); break;
+	case TextFormat::Html: Put(to_html(doc)); break;
+	default: Put(to_plain(doc) + "\n"); break;
+	}
+}
+
+void TextResultWriter::Finish() {
+	if (m_format == TextFormat::Html) {
+		if (!m_started) Put(html_header());
+		Put(html_footer());
+	}
+	fflush(m_file);
+}
+
+// JSONの文字列として追記する（値はUTF-8として妥当なもの）
+static void AppendJsonString(std::string& out, std::string_view text) {
+	static const char HEX[] = "0123456789abcdef";
+	out += '"';
+	size_t run = 0;
+	for (size_t i = 0; i < text.size(); ++i) {
+		auto c = static_cast<unsigned char>(text[i]);
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		out.append(text.data() + run, i - run);
+		run = i + 1;
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		case '\b': out += "\\b"; break;
+		case '\f': out += "\\f"; break;
+		default:
+			out += "\\u00";
+			out += HEX[c >> 4];
+			out += HEX[c & 15];
+			break;
+		}
+	}
+	out.append(text.data() + run, text.size() - run);
+	out += '"';
+}
+
+static bool IsHex(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// 文字列トークンの中身が正しいか（制御文字・不正なエスケープが無い）
+static bool IsJsonStringBody(std::string_view raw) {
+	for (size_t i = 0; i < raw.size(); ++i) {
+		auto c = static_cast<unsigned char>(raw[i]);
+		if (c < 0x20) return false;
+		if (c != '\\') continue;
+		if (++i >= raw.size()) return false;
+		switch (raw[i]) {
+		case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't': break;
+		case 'u':
+			if (raw.size() - i < 5 || !IsHex(raw[i + 1]) || !IsHex(raw[i + 2]) || !IsHex(raw[i + 3]) || !IsHex(raw[i + 4])) return false;
+			i += 4;
+			break;
+		default: return false;
+		}
+	}
+	return true;
+}
+
+// JSONの数値として正しいか
+static bool IsJsonNumber(std::string_view text) {
+	size_t i = 0;
+	auto digits = [&] {
+		size_t start = i;
+		while (i < text.size() && text[i] >= '0' && text[i] <= '9') ++i;
+		return i > start;
+	};
+	if (i < text.size() && text[i] == '-') ++i;
+	if (i < text.size() && text[i] == '0') ++i;
+	else if (!digits()) return false;
+	if (i < text.size() && text[i] == '.') {
+		++i;
+		if (!digits()) return false;
+	}
+	if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+		++i;
+		if (i < text.size() && (text[i] == '+' || text[i] == '-')) ++i;
+		if (!digits()) return false;
+	}
+	return i == text.size();
+}
+
+// 数値・true・false・null として正しいか
+static bool IsJsonScalar(std::string_view text) {
+	return text == "true" || text == "false" || text == "null" || IsJsonNumber(text);
+}
+
+// JSONを空白を詰めて追記する
+// トークナイザーは括弧の対応しか見ないので、ここで並び・エスケープ・スカラーまで確かめ、
+// 正しくなければ何も追記せず false を返す（呼び出し側で文字列として出す）
+static bool AppendCompactJson(std::string& out, std::string_view json, std::vector<JsonToken>& tokens, std::vector<char>& stack) {
+	if (!JsonTokenizer::Tokenize(json, tokens) || tokens.empty()) return false;
+
+	enum class Expect { Value, ValueOrEnd, Key, KeyOrEnd, Colon, CommaOrEnd, Done };
+	Expect expect = Expect::Value;
+	size_t start = out.size();
+	stack.clear();
+	auto fail = [&] {
+		out.resize(start);
+		return false;
+	};
+	auto afterValue = [&] { return stack.empty() ? Expect::Done : Expect::CommaOrEnd; };
+
+	for (const auto& token : tokens) {
+		std::string_view text = json.substr(token.offset, token.length);
+		bool value = expect == Expect::Value || expect == Expect::ValueOrEnd;
+		switch (token.type) {
+		case JsonTokenType::BeginObject:
+		case JsonTokenType::BeginArray:
+			if (!value) return fail();
+			stack.push_back(text[0]);
+			expect = text[0] == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+			out += text[0];
+			break;
+		case JsonTokenType::EndObject:
+		case JsonTokenType::EndArray:
+			// 括弧の対応はトークナイザーが確かめている
+			if (expect != Expect::CommaOrEnd && expect != (text[0] == '}' ? Expect::KeyOrEnd : Expect::ValueOrEnd)) return fail();
+			stack.pop_back();
+			expect = afterValue();
+			out += text[0];
+			break;
+		case JsonTokenType::Colon:
+			if (expect != Expect::Colon) return fail();
+			expect = Expect::Value;
+			out += ':';
+			break;
+		case JsonTokenType::Comma:
+			if (expect != Expect::CommaOrEnd) return fail();
+			expect = stack.back() == '{' ? Expect::Key : Expect::Value;
+			out += ',';
+			break;
+		case JsonTokenType::String:
+			if (!IsJsonStringBody(text)) return fail();
+			if (expect == Expect::Key || expect == Expect::KeyOrEnd) expect = Expect::Colon;
+			else if (value) expect = afterValue();
+			else return fail();
+			out += '"';
+			out += text;
+			out += '"';
+			break;
+		case JsonTokenType::Scalar:
+			if (!value || !IsJsonScalar(text)) return fail();
+			expect = afterValue();
+			out += text;
+			break;
+		}
+	}
+	return expect == Expect::Done || fail();
+}
+
+void JsonLinesResultWriter::WriteValue(std::string& out, const MetaEntry& entry) {
+	if (entry.type == MetaType::Json && AppendCompactJson(out, entry.value, m_tokens, m_stack)) return;
+	if (entry.type == MetaType::Number && IsJsonNumber(entry.value)) {
+		out += entry.value;
+		return;
+	}
+	AppendJsonString(out, entry.value);
+}
+
+void JsonLinesResultWriter::WriteSection(std::string& out, const char* name, const MetaList& list) {
+	// キーごとにまとめる（最初に出てきた順）
+	m_groupIndex.clear();
+	size_t groups = 0;
+	for (const auto& entry : list) {
+		if (entry.type == MetaType::Error) continue;
+		auto [it, added] = m_groupIndex.try_emplace(entry.key, groups);
+		if (added) {
+			if (m_groups.size() <= groups) m_groups.emplace_back();
+			m_groups[groups++].clear();
+		}
+		m_groups[it->second].push_back(&entry);
+	}
+	if (!groups) return;
+
+	out += ",\"";
+	out += name;
+	out += "\":{";
+	for (size_t g = 0; g < groups; ++g) {
+		const auto& entries = m_groups[g];
+		if (g) out += ',';
+		AppendJsonString(out, entries[0]->key);
+		out += ':';
+		if (entries.size() > 1) out += '[';
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (i) out += ',';
+			WriteValue(out, *entries[i]);
+		}
+		if (entries.size() > 1) out += ']';
+	}
+	out += '}';
+}
+
+void JsonLinesResultWriter::Write(const InspectionResult& result) {
+	TRACE_SCOPE("JsonLinesResultWriter::Write");
+	auto& out = m_output.Buffer();
+	out += "{\"path\":";
+	AppendJsonString(out, path_to_utf8(result.path));
+
+	static constexpr ExtractorKind KINDS[] = { ExtractorKind::Meta, ExtractorKind::C2PA, ExtractorKind::NAI };
+	for (auto kind : KINDS) WriteSection(out, section_name(kind), result.Section(kind));
+
+	// エラーは値と混ぜずに別に並べる
+	bool hasErrors = false;
+	for (auto kind : KINDS) {
+		for (const auto& entry : result.Section(kind)) {
+			if (entry.type != MetaType::Error) continue;
+			out += hasErrors ? ",{\"section\":\"" : ",\"errors\":[{\"section\":\"";
+			hasErrors = true;
+			out += section_name(kind);
+			out += "\",\"key\":";
+			AppendJsonString(out, entry.key);
+			out += ",\"message\":";
+			AppendJsonString(out, entry.value);
+			out += '}';
+		}
+	}
+	if (hasErrors) out += ']';
+	out += "}\n";
+	m_output.Commit();
+}
@@ -0,0 +1,97 @@
+﻿#pragma once
+#include "Inspector.h"
+#include "JsonTokenizer.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 抽出結果の出力先
+class ResultWriter {
+public:
+	virtual ~ResultWriter() = default;
+	virtual void Write(const InspectionResult& result) = 0;
+	// ここまでの結果を出力先に書き出す（監視モードで1件ごとに呼ぶ）
+	virtual void Flush() {}
+	virtual void Finish() {}
+};
+
+enum class OutputFormat {
+	Text,
+	Ansi,
+	Html,
+	JsonLines,	// 1ファイル1行のJSON
+	Arrow,		// Arrow IPCストリーム
+};
+
+std::unique_ptr<ResultWriter> create_result_writer(FILE* file, OutputFormat format);
+
+// JSON Lines・Arrowでの節の名前（meta・c2pa・nai）
+const char* section_name(ExtractorKind kind);
+
+// 小さな書き込みをまとめて出力する
+class BufferedOutput {
+public:
+	static constexpr size_t CAPACITY = 1024 * 1024;
+
+	explicit BufferedOutput(FILE* file) : m_file(file) { m_buffer.reserve(CAPACITY); }
+
+	// 追記先（追記したら Commit() を呼ぶ）
+	std::string& Buffer() { return m_buffer; }
+	void Commit() { if (m_buffer.size() >= CAPACITY) Drain(); }
+	void Append(std::string_view data) { m_buffer.append(data); Commit(); }
+
+	// 溜まっている分を書き出す
+	void Drain();
+	void Flush() { Drain(); fflush(m_file); }
+
+private:
+	FILE* m_file;
+	std::string m_buffer;
+};
+
+enum class TextFormat {
+	Plain,	// 書式なし
+	Ansi,	// ANSIエスケープシーケンスで色付け
+	Html,	// HTML文書
+};
+
+// GUIと同じ見出し・整形のテキスト形式（UTF-8）
+class TextResultWriter : public ResultWriter {
+public:
+	explicit TextResultWriter(FILE* file, TextFormat format = TextFormat::Plain) : m_file(file), m_format(format) {}
+	void Write(const InspectionResult& result) override;
+	void Flush() override { fflush(m_file); }
+	void Finish() override;
+
+private:
+	void Put(const std::string& text);
+
+	FILE* m_file;
+	TextFormat m_format;
+	bool m_started = false;
+};
+
+// JSON Lines（1ファイル1行）
+//   {"path":"...","meta":{"キー":"値",...},"c2pa":{...},"nai":{...},"errors":[{"section":"meta","key":"...","message":"..."}]}
+// 同じ節に同じキーが複数あれば値の配列にする。JSONと分かっている値・数値は文字列にせずそのまま埋め込む
+class JsonLinesResultWriter : public ResultWriter {
+public:
+	explicit JsonLinesResultWriter(FILE* file) : m_output(file) {}
+	void Write(const InspectionResult& result) override;
+	void Flush() override { m_output.Flush(); }
+	void Finish() override { m_output.Flush(); }
+
+private:
+	void WriteSection(std::string& out, const char* name, const MetaList& list);
+	void WriteValue(std::string& out, const MetaEntry& entry);
+
+	BufferedOutput m_output;
+	// 1件ごとに作り直さないように使い回す
+	std::unordered_map<std::string_view, size_t> m_groupIndex;
+	std::vector<std::vector<const MetaEntry*>> m_groups;
+	std::vector<JsonToken> m_tokens;
+	std::vector<char> m_stack;
+};
@@ -0,0 +1,157 @@
+﻿#include "StyledText.h"
+#include "TextUtils.h"
+#include <cstdio>
+
+uint32_t style_color(TextStyle style) {
+	switch (style) {
+	case TextStyle::Key: return 0x00FFFF;		// シアン
+	case TextStyle::Value: return 0xFFFFFF;		// 白
+	case TextStyle::Tag: return 0x00FFFF;		// シアン
+	case TextStyle::Attr: return 0xFFFF00;		// 黄色
+	case TextStyle::Symbol: return 0xC0C0C0;	// グレー
+	case TextStyle::Title: return 0x00FF00;		// 緑
+	}
+	return 0xFFFFFF;
+}
+
+void StyledDocument::Append(std::wstring_view text) {
+	if (text.empty()) return;
+
+	// 直前と同じ書式なら範囲を伸ばすだけ
+	if (!m_spans.empty() && m_spans.back().style == m_style) {
+		m_spans.back().length += text.size();
+	} else {
+		m_spans.push_back({ m_style, m_text.size(), text.size() });
+	}
+	m_text.append(text);
+}
+
+void StyledDocument::Clear() {
+	m_text.clear();
+	m_spans.clear();
+	m_style = TextStyle::Value;
+}
+
+// 改行はCR+LF/LFのどちらでも受け付け、CRは捨てる
+template <class Func>
+static void ForEachChar(const StyledDocument& doc, const StyledSpan& span, Func func) {
+	const std::wstring& text = doc.Text();
+	for (size_t i = span.offset; i < span.offset + span.length; ++i) {
+		if (text[i] != L'\r') func(text[i]);
+	}
+}
+
+std::string to_rtf(const StyledDocument& doc) {
+	static const TextStyle styles[] = {
+		TextStyle::Key, TextStyle::Value, TextStyle::Tag, TextStyle::Attr, TextStyle::Symbol, TextStyle::Title,
+	};
+
+	std::string rtf = "{\\rtf1\\ansi\\deff0{\\colortbl ;";
+	char buf[64];
+	for (auto style : styles) {
+		uint32_t c = style_color(style);
+		snprintf(buf, sizeof(buf), "\\red%u\\green%u\\blue%u;", (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF);
+		rtf += buf;
+	}
+	rtf += "}\n";
+	rtf.reserve(rtf.size() + doc.Text().size() * 2);
+
+	for (const auto& span : doc.Spans()) {
+		// カラーテーブルは1始まり
+		snprintf(buf, sizeof(buf), "\\cf%d ", static_cast<int>(span.style) + 1);
+		rtf += buf;
+		ForEachChar(doc, span, [&](wchar_t ch) {
+			uint32_t c = static_cast<uint32_t>(ch);
+			if (c == L'\n') {
+				rtf += "\\par\n";
+			} else if (c == L'\\' || c == L'{' || c == L'}') {
+				rtf += '\\';
+				rtf += static_cast<char>(c);
+			} else if (c == L'\t') {
+				rtf += "\\tab ";
+			} else if (c >= 0x20 && c < 0x80) {
+				rtf += static_cast<char>(c);
+			} else if (c < 0x20) {
+				// 制御文字は出力しない
+			} else {
+				// \uN はUTF-16の符号付き16ビット値（wchar_tが32ビットの環境ではサロゲートに分ける）
+				auto put = [&](uint32_t unit) {
+					snprintf(buf, sizeof(buf), "\\u%d?", static_cast<int>(static_cast<int16_t>(unit)));
+					rtf += buf;
+				};
+				if (c >= 0x10000) {
+					c -= 0x10000;
+					put(0xD800 + (c >> 10));
+					put(0xDC00 + (c & 0x3FF));
+				} else {
+					put(c);
+				}
+			}
+		});
+	}
+	rtf += "}";
+	return rtf;
+}
+
+// 書式範囲ごとに本文をUTF-8にする
+static std::string SpanText(const StyledDocument& doc, const StyledSpan& span) {
+	std::wstring text;
+	text.reserve(span.length);
+	ForEachChar(doc, span, [&](wchar_t ch) { text += ch; });
+	return unicode_to_utf8(text);
+}
+
+std::string to_ansi(const StyledDocument& doc) {
+	std::string out;
+	char buf[32];
+	for (const auto& span : doc.Spans()) {
+		uint32_t c = style_color(span.style);
+		snprintf(buf, sizeof(buf), "\x1b[38;2;%u;%u;%um", (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF);
+		out += buf;
+		out += SpanText(doc, span);
+	}
+	if (!doc.Spans().empty()) out += "\x1b[0m";
+	return out;
+}
+
+std::string to_plain(const StyledDocument& doc) {
+	std::string out;
+	for (const auto& span : doc.Spans()) {
+		out += SpanText(doc, span);
+	}
+	return out;
+}
+
+std::string to_html(const StyledDocument& doc) {
+	std::string out = "<pre>";
+	char buf[48];
+	for (const auto& span : doc.Spans()) {
+		snprintf(buf, sizeof(buf), "<span style=\"color:#%06x\">", style_color(span.style));
+		out += buf;
+		for (char ch : SpanText(doc, span)) {
+			switch (ch) {
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += ch; break;
+			}
+		}
+		out += "</span>";
+	}
+	out += "</pre>\n";
+	return out;
+}
+
+std::string html_header() {
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>PhantomView</title>\n"
+		"<style>body { background:#%06x; color:#%06x; }</style>\n</head>\n<body>\n",
+		STYLE_BACKGROUND, style_color(TextStyle::Value));
+	return buf;
+}
+
+std::string html_footer() {
+	return "</body>\n</html>\n";
+}
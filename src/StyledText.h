@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 文字の種類（表示色はバックエンドが決める）
+enum class TextStyle : uint8_t {
+	Key,
+	Value,
+	Tag,
+	Attr,
+	Symbol,
+	Title,
+};
+
+// 表示色（0xRRGGBB）
+uint32_t style_color(TextStyle style);
+static constexpr uint32_t STYLE_BACKGROUND = 0x000000; // 黒
+
+// 同じ書式が続く範囲
+struct StyledSpan {
+	TextStyle style;
+	size_t offset;
+	size_t length;
+};
+
+// 書式付きテキスト（本文と書式範囲の組）
+class StyledDocument {
+public:
+	void SetStyle(TextStyle style) { m_style = style; }
+	void Append(std::wstring_view text);
+	void Clear();
+
+	const std::wstring& Text() const { return m_text; }
+	const std::vector<StyledSpan>& Spans() const { return m_spans; }
+
+private:
+	std::wstring m_text;
+	std::vector<StyledSpan> m_spans;
+	TextStyle m_style = TextStyle::Value;
+};
+
+// RTF（RichEditへEM_STREAMINで一括で流し込む）
+std::string to_rtf(const StyledDocument& doc);
+
+// ANSIエスケープシーケンスで色付けしたUTF-8テキスト
+std::string to_ansi(const StyledDocument& doc);
+
+// 書式なしのUTF-8テキスト
+std::string to_plain(const StyledDocument& doc);
+
+// HTML断片（<pre>要素）と、単体のHTML文書にするための前後
+std::string to_html(const StyledDocument& doc);
+std::string html_header();
+std::string html_footer();
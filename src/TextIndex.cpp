@@ -0,0 +1,554 @@
+﻿#include "framework.h"
+#include "TextIndex.h"
+#include "ImageBuffer.h"
+#include "ResultCache.h"
+#include "TextUtils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+static constexpr char SEGMENT_MAGIC[8] = {'P', 'V', 'I', 'D', 'X', '0', '0', '1'};
+
+// 値と値の間で出現位置を空けて、フレーズが値をまたがないようにする
+static constexpr uint32_t VALUE_GAP = 2;
+
+// セグメントのヘッダー（数値はリトルエンディアン）
+struct SegmentHeader {
+	char magic[8];
+	uint32_t docCount;
+	uint32_t reserved;
+	uint64_t termCount;
+	uint64_t docTableOffset;	// 文書ごとのパスの位置（uint64_t × docCount）
+	uint64_t pathHashOffset;	// パスのハッシュの昇順（uint64_t × docCount）
+	uint64_t termTableOffset;	// 語ごとのレコードの位置（uint64_t × termCount、語の昇順）
+};
+
+// UTF-8を1文字読む（不正なバイトは U+FFFD）
+static uint32_t NextCodePoint(std::string_view text, size_t& pos) {
+	uint8_t c = static_cast<uint8_t>(text[pos++]);
+	if (c < 0x80) return c;
+	int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+	if (extra < 0 || pos + extra > text.size()) return 0xFFFD;
+	uint32_t cp = c & (0x3F >> extra);
+	for (int i = 0; i < extra; ++i) {
+		uint8_t next = static_cast<uint8_t>(text[pos]);
+		if ((next & 0xC0) != 0x80) return 0xFFFD;
+		cp = (cp << 6) | (next & 0x3F);
+		++pos;
+	}
+	return cp;
+}
+
+// 1文字を1語として扱う文字（漢字・かな・ハングル）
+static bool IsIdeographic(uint32_t cp) {
+	return (cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF) ||
+		(cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xAC00 && cp <= 0xD7AF) || (cp >= 0x20000 && cp <= 0x2FFFF);
+}
+
+// 語の区切りになる文字
+static bool IsSeparator(uint32_t cp) {
+	if (cp < 0x80) return !((cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z'));
+	return (cp >= 0x2000 && cp <= 0x206F) || (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFF00 && cp <= 0xFF65) ||
+		(cp >= 0x1F000 && cp <= 0x1FFFF) || cp == 0xFFFD || cp == 0x00A0;
+}
+
+void tokenize_text(std::string_view utf8, const std::function<void(std::string_view token)>& emit) {
+	std::string word;
+	auto flush = [&] {
+		if (!word.empty()) emit(word);
+		word.clear();
+	};
+
+	size_t pos = 0;
+	while (pos < utf8.size()) {
+		size_t start = pos;
+		uint32_t cp = NextCodePoint(utf8, pos);
+
+		// 全角英数字は半角にそろえる
+		if ((cp >= 0xFF10 && cp <= 0xFF19) || (cp >= 0xFF21 && cp <= 0xFF3A) || (cp >= 0xFF41 && cp <= 0xFF5A)) cp -= 0xFEE0;
+
+		if (cp < 0x80 && !IsSeparator(cp)) {
+			word += static_cast<char>(cp >= 'A' && cp <= 'Z' ? cp + 32 : cp);
+		} else if (IsIdeographic(cp)) {
+			flush();
+			emit(utf8.substr(start, pos - start));
+		} else if (IsSeparator(cp)) {
+			flush();
+		} else {
+			// アクセント付きのラテン文字などは単語の一部
+			word.append(utf8.substr(start, pos - start));
+		}
+	}
+	flush();
+}
+
+static void PutVarint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+template <typename T>
+static void PutRaw(std::string& out, T value) {
+	out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static void PatchRaw(std::string& out, size_t offset, T value) {
+	memcpy(&out[offset], &value, sizeof(T));
+}
+
+// 範囲を確かめながら読む
+struct VarintReader {
+	const uint8_t* p;
+	const uint8_t* end;
+	bool ok = true;
+
+	uint64_t Next() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (p >= end) break;
+			uint8_t b = *p++;
+			value |= static_cast<uint64_t>(b & 0x7F) << shift;
+			if (!(b & 0x80)) return value;
+		}
+		ok = false;
+		return 0;
+	}
+};
+
+// 索引し直したときに同じファイルと分かるよう、絶対パスにそろえる
+static std::string PathToUtf8(const std::filesystem::path& path) {
+	std::error_code ec;
+	auto absolute = path == "-" ? path : std::filesystem::absolute(path, ec).lexically_normal();
+	return path_to_utf8(ec ? path : absolute);
+}
+
+static uint64_t PathHash(std::string_view path) {
+	return content_hash64({reinterpret_cast<const uint8_t*>(path.data()), path.size()});
+}
+
+// 索引ディレクトリ内のセグメントを番号順に列挙する
+static std::vector<std::pair<uint32_t, std::filesystem::path>> ListSegments(const std::filesystem::path& directory) {
+	std::vector<std::pair<uint32_t, std::filesystem::path>> segments;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+		auto name = path_to_utf8(entry.path().filename());
+		if (name.size() != 13 || !name.starts_with("seg") || !name.ends_with(".pvi")) continue;
+		uint32_t number = 0;
+		if (sscanf(name.c_str() + 3, "%6u", &number) != 1) continue;
+		segments.push_back({number, entry.path()});
+	}
+	std::sort(segments.begin(), segments.end());
+	return segments;
+}
+
+TextIndexWriter::TextIndexWriter(std::filesystem::path directory) : m_directory(std::move(directory)) {
+}
+
+void TextIndexWriter::Add(const InspectionResult& result) {
+	uint32_t doc = static_cast<uint32_t>(m_paths.size());
+	m_paths.push_back(PathToUtf8(result.path));
+	m_latest[m_paths.back()] = doc;
+
+	uint32_t position = 0;
+	for (const auto* list : {&result.meta, &result.c2pa, &result.nai}) {
+		for (const auto& entry : *list) {
+			tokenize_text(entry.value, [&](std::string_view token) {
+				auto& postings = m_terms[std::string(token)];
+				if (postings.empty() || postings.back().doc != doc) postings.push_back({doc, {}});
+				postings.back().positions.push_back(position++);
+			});
+			position += VALUE_GAP;
+		}
+	}
+
+	if (m_paths.size() >= SEGMENT_DOCUMENTS) Flush();
+}
+
+bool TextIndexWriter::Flush() {
+	if (m_paths.empty()) return true;
+
+	std::error_code ec;
+	std::filesystem::create_directories(m_directory, ec);
+	auto segments = ListSegments(m_directory);
+	uint32_t number = segments.empty() ? 1 : segments.back().first + 1;
+
+	// 同じ実行で索引し直したファイルは最後の文書だけを残し、番号を詰め直す
+	static constexpr uint32_t REMOVED = ~0u;
+	std::vector<uint32_t> renumber(m_paths.size(), REMOVED);
+	std::vector<const std::string*> paths;
+	for (uint32_t doc = 0; doc < m_paths.size(); ++doc) {
+		if (m_latest[m_paths[doc]] != doc) continue;
+		renumber[doc] = static_cast<uint32_t>(paths.size());
+		paths.push_back(&m_paths[doc]);
+	}
+
+	// 辞書とポスティング（残した文書に現れない語は書かない）
+	std::vector<const std::pair<const std::string, std::vector<Posting>>*> terms;
+	terms.reserve(m_terms.size());
+	for (const auto& term : m_terms) {
+		if (std::any_of(term.second.begin(), term.second.end(), [&](const Posting& posting) { return renumber[posting.doc] != REMOVED; })) {
+			terms.push_back(&term);
+		}
+	}
+	std::sort(terms.begin(), terms.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+	std::string out;
+	SegmentHeader header = {};
+	memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+	header.docCount = static_cast<uint32_t>(paths.size());
+	header.termCount = terms.size();
+	PutRaw(out, header);
+
+	// 文書のパス
+	header.docTableOffset = out.size();
+	out.resize(out.size() + paths.size() * sizeof(uint64_t));
+	for (size_t i = 0; i < paths.size(); ++i) {
+		PatchRaw<uint64_t>(out, header.docTableOffset + i * sizeof(uint64_t), out.size());
+		PutVarint(out, paths[i]->size());
+		out += *paths[i];
+	}
+	header.pathHashOffset = out.size();
+	std::vector<uint64_t> hashes;
+	for (const auto* path : paths) hashes.push_back(PathHash(*path));
+	std::sort(hashes.begin(), hashes.end());
+	for (uint64_t hash : hashes) PutRaw(out, hash);
+
+	header.termTableOffset = out.size();
+	out.resize(out.size() + terms.size() * sizeof(uint64_t));
+	std::string postings;
+	for (size_t i = 0; i < terms.size(); ++i) {
+		const auto& [term, list] = *terms[i];
+		postings.clear();
+		uint32_t lastDoc = 0;
+		size_t docFreq = 0;
+		for (const auto& posting : list) {
+			uint32_t doc = renumber[posting.doc];
+			if (doc == REMOVED) continue;
+			++docFreq;
+			PutVarint(postings, doc - lastDoc);
+			lastDoc = doc;
+			PutVarint(postings, posting.positions.size());
+			uint32_t lastPosition = 0;
+			for (uint32_t position : posting.positions) {
+				PutVarint(postings, position - lastPosition);
+				lastPosition = position;
+			}
+		}
+
+		PatchRaw<uint64_t>(out, header.termTableOffset + i * sizeof(uint64_t), out.size());
+		PutVarint(out, term.size());
+		out += term;
+		PutVarint(out, docFreq);
+		PutVarint(out, postings.size());
+		out += postings;
+	}
+	PatchRaw(out, 0, header);
+
+	// 書き終えてから名前を付ける（読み込み中の索引が途中のファイルを見ないように）
+	char name[32];
+	snprintf(name, sizeof(name), "seg%06u", number);
+	auto temp = m_directory / (std::string(name) + ".tmp");
+	auto path = m_directory / (std::string(name) + ".pvi");
+#ifdef _WIN32
+	FILE* file = _wfopen(temp.c_str(), L"wb");
+#else
+	FILE* file = fopen(temp.c_str(), "wb");
+#endif
+	if (!file) return false;
+	bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	std::filesystem::rename(temp, path, ec);
+	if (ec) return false;
+
+	m_paths.clear();
+	m_latest.clear();
+	m_terms.clear();
+	return true;
+}
+
+// 1つのセグメント（メモリマップしたまま引く）
+class TextIndex::Segment {
+public:
+	struct Match {
+		uint32_t doc;
+		std::vector<uint32_t> positions;
+	};
+
+	bool Open(const std::filesystem::path& path) {
+		m_file = ImageBuffer::FromFile(path);
+		auto data = m_file.span();
+		if (data.size() < sizeof(SegmentHeader)) return false;
+		memcpy(&m_header, data.data(), sizeof(m_header));
+		if (memcmp(m_header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0) return false;
+		uint64_t docBytes = static_cast<uint64_t>(m_header.docCount) * sizeof(uint64_t);
+		return m_header.docTableOffset + docBytes <= data.size() &&
+			m_header.pathHashOffset + docBytes <= data.size() &&
+			m_header.termTableOffset + m_header.termCount * sizeof(uint64_t) <= data.size();
+	}
+
+	uint32_t DocumentCount() const { return m_header.docCount; }
+
+	std::string_view Path(uint32_t doc) const {
+		if (doc >= m_header.docCount) return {};
+		VarintReader reader = At(Offset(m_header.docTableOffset, doc));
+		uint64_t length = reader.Next();
+		if (!reader.ok || length > static_cast<uint64_t>(reader.end - reader.p)) return {};
+		return {reinterpret_cast<const char*>(reader.p), static_cast<size_t>(length)};
+	}
+
+	bool ContainsPath(uint64_t hash) const {
+		const uint8_t* begin = m_file.data() + m_header.pathHashOffset;
+		size_t low = 0, high = m_header.docCount;
+		while (low < high) {
+			size_t mid = (low + high) / 2;
+			uint64_t value;
+			memcpy(&value, begin + mid * sizeof(uint64_t), sizeof(value));
+			if (value == hash) return true;
+			if (value < hash) low = mid + 1;
+			else high = mid;
+		}
+		return false;
+	}
+
+	// 語の昇順で term 以上になる最初の番号
+	uint64_t LowerBound(std::string_view term) const {
+		uint64_t low = 0, high = m_header.termCount;
+		while (low < high) {
+			uint64_t mid = (low + high) / 2;
+			if (Term(mid).first < term) low = mid + 1;
+			else high = mid;
+		}
+		return low;
+	}
+
+	uint64_t TermCount() const { return m_header.termCount; }
+
+	// 語とポスティングの読み出し位置
+	std::pair<std::string_view, VarintReader> Term(uint64_t index) const {
+		VarintReader reader = At(Offset(m_header.termTableOffset, index));
+		uint64_t length = reader.Next();
+		if (!reader.ok || length > static_cast<uint64_t>(reader.end - reader.p)) return {{}, {nullptr, nullptr, false}};
+		std::string_view term(reinterpret_cast<const char*>(reader.p), static_cast<size_t>(length));
+		reader.p += length;
+		return {term, reader};
+	}
+
+	// 語を含む文書（withPositions が false なら出現位置は読み飛ばす）
+	std::vector<Match> Postings(uint64_t index, bool withPositions) const {
+		std::vector<Match> matches;
+		auto [term, reader] = Term(index);
+		uint64_t docFreq = reader.Next();
+		uint64_t bytes = reader.Next();
+		if (!reader.ok || bytes > static_cast<uint64_t>(reader.end - reader.p)) return matches;
+		reader.end = reader.p + bytes;
+
+		matches.reserve(static_cast<size_t>(std::min<uint64_t>(docFreq, m_header.docCount)));
+		uint64_t doc = 0;
+		for (uint64_t i = 0; i < docFreq && reader.ok; ++i) {
+			// 文書番号は昇順で、文書数を超えない（壊れたセグメントの範囲外を読まない）
+			uint64_t delta = reader.Next();
+			if (delta >= m_header.docCount - doc || (i > 0 && delta == 0)) {
+				reader.ok = false;
+				break;
+			}
+			doc += delta;
+			uint64_t count = reader.Next();
+			Match& match = matches.emplace_back();
+			match.doc = static_cast<uint32_t>(doc);
+			uint32_t position = 0;
+			for (uint64_t j = 0; j < count && reader.ok; ++j) {
+				position += static_cast<uint32_t>(reader.Next());
+				if (withPositions) match.positions.push_back(position);
+			}
+		}
+		if (!reader.ok) matches.clear();
+		return matches;
+	}
+
+	bool FindTerm(std::string_view term, uint64_t& index) const {
+		index = LowerBound(term);
+		return index < m_header.termCount && Term(index).first == term;
+	}
+
+private:
+	uint64_t Offset(uint64_t table, uint64_t index) const {
+		uint64_t offset;
+		memcpy(&offset, m_file.data() + table + index * sizeof(uint64_t), sizeof(offset));
+		return offset;
+	}
+
+	VarintReader At(uint64_t offset) const {
+		const uint8_t* end = m_file.data() + m_file.size();
+		if (offset >= m_file.size()) return {end, end, false};
+		return {m_file.data() + offset, end};
+	}
+
+	ImageBuffer m_file;
+	SegmentHeader m_header = {};
+};
+
+TextIndex::~TextIndex() = default;
+
+std::unique_ptr<TextIndex> TextIndex::Open(const std::filesystem::path& directory) {
+	std::unique_ptr<TextIndex> index(new TextIndex());
+	for (const auto& [number, path] : ListSegments(directory)) {
+		auto segment = std::make_unique<Segment>();
+		if (segment->Open(path)) index->m_segments.push_back(std::move(segment));
+	}
+	if (index->m_segments.empty()) return nullptr;
+	return index;
+}
+
+size_t TextIndex::DocumentCount() const {
+	size_t count = 0;
+	for (const auto& segment : m_segments) count += segment->DocumentCount();
+	return count;
+}
+
+// 問い合わせの1条件（語の並び、前方一致なら1語）
+struct QueryClause {
+	std::vector<std::string> tokens;
+	bool prefix = false;
+};
+
+static std::vector<QueryClause> ParseQuery(std::string_view query) {
+	std::vector<QueryClause> clauses;
+	size_t pos = 0;
+	while (pos < query.size()) {
+		if (query[pos] == ' ' || query[pos] == '\t') {
+			++pos;
+			continue;
+		}
+		size_t end;
+		std::string_view text;
+		if (query[pos] == '"') {
+			end = query.find('"', pos + 1);
+			if (end == std::string_view::npos) end = query.size();
+			text = query.substr(pos + 1, end - pos - 1);
+			++end;
+		} else {
+			end = query.find_first_of(" \t", pos);
+			if (end == std::string_view::npos) end = query.size();
+			text = query.substr(pos, end - pos);
+		}
+		pos = end;
+
+		QueryClause clause;
+		if (text.size() > 1 && text.back() == '*') {
+			clause.prefix = true;
+			text.remove_suffix(1);
+		}
+		tokenize_text(text, [&](std::string_view token) { clause.tokens.emplace_back(token); });
+		if (clause.tokens.empty()) continue;
+		// 前方一致は最後の語だけに効かせる（それ以外は語順の条件として残す）
+		if (clause.prefix && clause.tokens.size() > 1) {
+			QueryClause last;
+			last.tokens.push_back(std::move(clause.tokens.back()));
+			last.prefix = true;
+			clause.tokens.pop_back();
+			clause.prefix = false;
+			clauses.push_back(std::move(clause));
+			clauses.push_back(std::move(last));
+			continue;
+		}
+		clauses.push_back(std::move(clause));
+	}
+	return clauses;
+}
+
+static std::vector<uint32_t> Intersect(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+	std::vector<uint32_t> out;
+	std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+	return out;
+}
+
+std::vector<std::filesystem::path> TextIndex::Query(std::string_view query) const {
+	std::vector<std::filesystem::path> results;
+	auto clauses = ParseQuery(query);
+	if (clauses.empty()) return results;
+
+	for (size_t s = 0; s < m_segments.size(); ++s) {
+		const Segment& segment = *m_segments[s];
+		std::vector<uint32_t> docs;
+		bool first = true;
+
+		for (const auto& clause : clauses) {
+			std::vector<uint32_t> clauseDocs;
+			if (clause.prefix) {
+				// 前方一致する語の文書を全て合わせる
+				for (uint64_t i = segment.LowerBound(clause.tokens[0]); i < segment.TermCount(); ++i) {
+					if (!segment.Term(i).first.starts_with(clause.tokens[0])) break;
+					for (const auto& match : segment.Postings(i, false)) clauseDocs.push_back(match.doc);
+				}
+				std::sort(clauseDocs.begin(), clauseDocs.end());
+				clauseDocs.erase(std::unique(clauseDocs.begin(), clauseDocs.end()), clauseDocs.end());
+			} else if (clause.tokens.size() == 1) {
+				uint64_t index;
+				if (segment.FindTerm(clause.tokens[0], index)) {
+					for (const auto& match : segment.Postings(index, false)) clauseDocs.push_back(match.doc);
+				}
+			} else {
+				// 語順どおりに並ぶ位置があるか
+				std::vector<std::vector<Segment::Match>> lists;
+				bool missing = false;
+				for (const auto& token : clause.tokens) {
+					uint64_t index;
+					if (!segment.FindTerm(token, index)) {
+						missing = true;
+						break;
+					}
+					lists.push_back(segment.Postings(index, true));
+				}
+				if (!missing) {
+					std::vector<size_t> cursor(lists.size(), 0);
+					for (const auto& head : lists[0]) {
+						bool all = true;
+						std::vector<const std::vector<uint32_t>*> positions{&head.positions};
+						for (size_t k = 1; k < lists.size() && all; ++k) {
+							auto& list = lists[k];
+							while (cursor[k] < list.size() && list[cursor[k]].doc < head.doc) ++cursor[k];
+							all = cursor[k] < list.size() && list[cursor[k]].doc == head.doc;
+							if (all) positions.push_back(&list[cursor[k]].positions);
+						}
+						if (!all) continue;
+						for (uint32_t p : head.positions) {
+							bool found = true;
+							for (size_t k = 1; k < positions.size() && found; ++k) {
+								found = std::binary_search(positions[k]->begin(), positions[k]->end(), p + static_cast<uint32_t>(k));
+							}
+							if (found) {
+								clauseDocs.push_back(head.doc);
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			docs = first ? std::move(clauseDocs) : Intersect(docs, clauseDocs);
+			first = false;
+			if (docs.empty()) break;
+		}
+
+		for (uint32_t doc : docs) {
+			std::string_view path = segment.Path(doc);
+			// 後のセグメントで索引し直されたファイルは古い結果を返さない
+			uint64_t hash = PathHash(path);
+			bool superseded = false;
+			for (size_t later = s + 1; later < m_segments.size() && !superseded; ++later) {
+				superseded = m_segments[later]->ContainsPath(hash);
+			}
+			if (!superseded) results.push_back(utf8_to_path(path));
+		}
+	}
+	return results;
+}
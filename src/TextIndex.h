@@ -0,0 +1,66 @@
+﻿#pragma once
+#include "Inspector.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 抽出結果の値（プロンプト・ソフトウェア名・C2PAの生成元など）の全文索引
+// 索引はディレクトリで、書き込むたびにセグメント（segNNNNNN.pvi）を1つ追加する
+// セグメントは辞書（語の昇順）と、文書番号・出現位置の差分を可変長整数で詰めたポスティングからなる
+// 同じファイルを索引し直した場合は新しいセグメントの内容が優先される
+
+// 語に分ける（ASCIIの英数字は小文字の単語、漢字・かなは1文字ずつ）
+void tokenize_text(std::string_view utf8, const std::function<void(std::string_view token)>& emit);
+
+class TextIndexWriter {
+public:
+	explicit TextIndexWriter(std::filesystem::path directory);
+
+	void Add(const InspectionResult& result);
+
+	// 溜まった文書をセグメントとして書き出す（書き出す文書が無ければ何もしない）
+	bool Flush();
+
+	size_t Pending() const { return m_paths.size(); }
+
+	// この件数を超えたら Add() の中で書き出す
+	static constexpr size_t SEGMENT_DOCUMENTS = 100000;
+
+private:
+	struct Posting {
+		uint32_t doc;
+		std::vector<uint32_t> positions;
+	};
+
+	std::filesystem::path m_directory;
+	std::vector<std::string> m_paths;
+	std::unordered_map<std::string, uint32_t> m_latest;	// パスごとの最後の文書番号（同じ実行で索引し直した場合）
+	std::unordered_map<std::string, std::vector<Posting>> m_terms;
+};
+
+class TextIndex {
+public:
+	~TextIndex();
+
+	// セグメントが1つも無ければ nullptr
+	static std::unique_ptr<TextIndex> Open(const std::filesystem::path& directory);
+
+	// 空白区切りの条件を全て満たすファイル
+	//   cat       語を含む
+	//   "a cat"   語順どおりに並ぶ（複数語に分かれる語も同じ扱い）
+	//   mast*     前方一致
+	std::vector<std::filesystem::path> Query(std::string_view query) const;
+
+	size_t DocumentCount() const;
+
+private:
+	class Segment;
+	TextIndex() = default;
+	std::vector<std::unique_ptr<Segment>> m_segments;
+};
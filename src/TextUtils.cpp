@@ -2,40 +2,47 @@
 #include <sstream>
 
 #include "TextUtils.h"
+#include "Utf.h"
 
 // UTF-8→ユニコード変換
-std::wstring utf8_to_unicode(const std::string& utf8_string) {
-	if (utf8_string.empty()) {
-		return std::wstring();
-	}
+// 上限の長さで確保して1回で変換し、余りを切り詰める（不正なバイト列は U+FFFD になる）
+std::wstring utf8_to_unicode(std::string_view utf8_string) {
+	std::wstring result(wide_max_length_from_utf8(utf8_string.size()), L'\0');
+	result.resize(utf8_to_wide(utf8_string, result.data()));
+	return result;
+}
 
-	int size = MultiByteToWideChar(CP_UTF8, 0, utf8_string.c_str(), -1, nullptr, 0);
-	if (size == 0) {
-		return std::wstring();
-	}
+// ユニコード→UTF-8変換
+std::string unicode_to_utf8(const std::wstring& unicode_string) {
+	std::string result(utf8_max_length_from_wide(unicode_string.size()), '\0');
+	result.resize(wide_to_utf8(unicode_string, result.data()));
+	return result;
+}
 
-	std::vector<wchar_t> buffer(size);
-	int result = MultiByteToWideChar(CP_UTF8, 0, utf8_string.c_str(), -1, buffer.data(), size);
-	if (result == 0) {
-		return std::wstring();
-	}
+// path::wstring() や path::string() は変換できない名前で例外を投げるので、native() から自前で変換する
+std::string path_to_utf8(const std::filesystem::path& path) {
+#ifdef _WIN32
+	return unicode_to_utf8(path.native());
+#else
+	const auto& native = path.native();
+	std::string result(utf8_max_length_from_utf8(native.size()), '\0');
+	result.resize(sanitize_utf8(native, result.data()));
+	return result;
+#endif
+}
 
-	return std::wstring(buffer.begin(), buffer.end() - 1);
+std::wstring path_to_unicode(const std::filesystem::path& path) {
+#ifdef _WIN32
+	return path.native();
+#else
+	return utf8_to_unicode(path.native());
+#endif
 }
 
-// ユニコード→UTF-8変換
-std::string unicode_to_utf8(const std::wstring& unicode_string) {
-	if (unicode_string.empty()) {
-		return std::string();
-	}
-	int size = WideCharToMultiByte(CP_UTF8, 0, unicode_string.c_str(), -1, nullptr, 0, nullptr, nullptr);
-	if (size == 0) {
-		return std::string();
-	}
-	std::vector<char> buffer(size);
-	int result = WideCharToMultiByte(CP_UTF8, 0, unicode_string.c_str(), -1, buffer.data(), size, nullptr, nullptr);
-	if (result == 0) {
-		return std::string();
-	}
-	return std::string(buffer.begin(), buffer.end() - 1);
+std::filesystem::path utf8_to_path(std::string_view utf8_string) {
+#ifdef _WIN32
+	return utf8_to_unicode(utf8_string);
+#else
+	return std::string(utf8_string);
+#endif
 }
@@ -1,10 +1,20 @@
 ﻿#pragma once
 
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // UTF-8→ユニコード変換
-std::wstring utf8_to_unicode(const std::string& utf8_string);
+std::wstring utf8_to_unicode(std::string_view utf8_string);
 
 // ユニコード→UTF-8変換
 std::string unicode_to_utf8(const std::wstring& unicode_string);
+
+// パス→UTF-8・ユニコード変換（表示・出力用。例外を投げない）
+// Windows以外のファイル名はUTF-8とは限らないので、不正なバイト列は U+FFFD に置き換える
+std::string path_to_utf8(const std::filesystem::path& path);
+std::wstring path_to_unicode(const std::filesystem::path& path);
+
+// UTF-8→パス変換（Windows以外ではバイト列をそのまま使う。path(wstring) はロケールによって例外を投げる）
+std::filesystem::path utf8_to_path(std::string_view utf8_string);
@@ -0,0 +1,92 @@
+﻿#include "ThreadPool.h"
+#include <cstdio>
+#include <exception>
+
+// 自分のワーカースレッド番号（プール外のスレッドでは無効値）
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local size_t t_index = 0;
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 1;
+
+	for (size_t i = 0; i < threadCount; ++i) {
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for (size_t i = 0; i < threadCount; ++i) {
+		m_workers.emplace_back([this, i] { WorkerLoop(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(m_waitMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+	// ワーカー内からの投入は自分のキューへ、外部からは順番に振り分ける
+	size_t index = (t_pool == this) ? t_index : m_nextQueue++ % m_queues.size();
+	{
+		std::lock_guard lock(m_waitMutex);
+		++m_pending;
+	}
+	{
+		std::lock_guard lock(m_queues[index]->mutex);
+		m_queues[index]->tasks.push_back(std::move(task));
+	}
+	m_wake.notify_one();
+}
+
+bool ThreadPool::PopLocal(size_t index, std::function<void()>& task) {
+	auto& queue = *m_queues[index];
+	std::lock_guard lock(queue.mutex);
+	if (queue.tasks.empty()) return false;
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::Steal(size_t index, std::function<void()>& task) {
+	for (size_t i = 1; i < m_queues.size(); ++i) {
+		auto& queue = *m_queues[(index + i) % m_queues.size()];
+		std::lock_guard lock(queue.mutex);
+		if (queue.tasks.empty()) continue;
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+	t_pool = this;
+	t_index = index;
+
+	for (;;) {
+		std::function<void()> task;
+		if (PopLocal(index, task) || Steal(index, task)) {
+			--m_pending;
+			// 例外でワーカーが止まるとプロセスごと落ちるので、ここで受け止めて次の仕事に進む
+			// 結果を待っている側へは各タスクがエラーとして渡すので、ここに来るのは想定外のものだけ
+			try {
+				task();
+			} catch (const std::exception& e) {
+				std::fprintf(stderr, "ThreadPool: %s\n", e.what());
+			} catch (...) {
+				std::fputs("ThreadPool: unknown exception\n", stderr);
+			}
+			continue;
+		}
+
+		// 仕事が無ければ投入されるまで待つ
+		std::unique_lock lock(m_waitMutex);
+		m_wake.wait(lock, [this] { return m_stop || m_pending > 0; });
+		if (m_stop && m_pending == 0) return;
+	}
+}
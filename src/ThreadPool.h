@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ワークスティーリング方式のスレッドプール
+// 各ワーカーは自分のキューの末尾から取り出し、空になったら他のワーカーの先頭から盗む
+class ThreadPool {
+public:
+	// threadCount が 0 の場合は論理コア数
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void Submit(std::function<void()> task);
+	size_t ThreadCount() const { return m_workers.size(); }
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void WorkerLoop(size_t index);
+	bool PopLocal(size_t index, std::function<void()>& task);
+	bool Steal(size_t index, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::mutex m_waitMutex;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_pending = 0;
+	std::atomic<size_t> m_nextQueue = 0;
+	bool m_stop = false;
+};
@@ -0,0 +1,193 @@
+﻿#include "framework.h"
+#include "Trace.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+std::atomic<bool> Trace::s_enabled = false;
+std::atomic<bool> Trace::s_events = false;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 全ての計測点（登録だけなので終了時まで残す）
+std::mutex& StagesMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+std::vector<const TraceStage*>& Stages() {
+	static std::vector<const TraceStage*> stages;
+	return stages;
+}
+
+// 1回分の記録（Chrome のトレース用）
+struct TraceEvent {
+	const TraceStage* stage;
+	uint64_t start;
+	uint64_t duration;
+	std::string detail;
+};
+
+// スレッドごとの記録（スレッドが終わった後も書き出すまで残す）
+struct ThreadEvents {
+	std::mutex mutex;	// 書き出しとの競合用（普段は競合しない）
+	uint32_t tid = 0;
+	std::vector<TraceEvent> events;
+};
+
+std::mutex g_threadsMutex;
+std::vector<std::shared_ptr<ThreadEvents>> g_threads;
+Clock::time_point g_origin = Clock::now();
+
+ThreadEvents& EventsForThread() {
+	thread_local std::shared_ptr<ThreadEvents> events;
+	if (!events) {
+		events = std::make_shared<ThreadEvents>();
+		std::lock_guard lock(g_threadsMutex);
+		events->tid = static_cast<uint32_t>(g_threads.size() + 1);
+		g_threads.push_back(events);
+	}
+	return *events;
+}
+
+void PutJsonString(FILE* out, const std::string& text) {
+	fputc('"', out);
+	for (unsigned char c : text) {
+		if (c == '"' || c == '\\') {
+			fputc('\\', out);
+			fputc(c, out);
+		} else if (c < 0x20) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+} // namespace
+
+TraceStage::TraceStage(const char* name) : m_name(name) {
+	std::lock_guard lock(StagesMutex());
+	Stages().push_back(this);
+}
+
+int TraceStage::BucketOf(uint64_t value) {
+	if (value < SUB_BUCKETS) return static_cast<int>(value);
+	int msb = static_cast<int>(std::bit_width(value)) - 1;
+	int sub = static_cast<int>(value >> (msb - 4)) & (SUB_BUCKETS - 1);
+	return (msb - 3) * SUB_BUCKETS + sub;
+}
+
+// バケットに入る値の上限
+uint64_t TraceStage::BucketLimit(int bucket) {
+	if (bucket < SUB_BUCKETS) return static_cast<uint64_t>(bucket);
+	int msb = bucket / SUB_BUCKETS + 3;
+	uint64_t sub = bucket % SUB_BUCKETS;
+	uint64_t low = (SUB_BUCKETS + sub) << (msb - 4);
+	return low + (uint64_t(1) << (msb - 4)) - 1;
+}
+
+void TraceStage::Record(uint64_t start, uint64_t duration, const std::string* detail) {
+	m_buckets[BucketOf(duration)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_total.fetch_add(duration, std::memory_order_relaxed);
+
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (duration > max) {
+		if (m_max.compare_exchange_weak(max, duration, std::memory_order_relaxed)) {
+			std::lock_guard lock(m_slowestMutex);
+			const std::string* target = detail ? detail : Trace::s_context;
+			if (m_max.load(std::memory_order_relaxed) == duration) m_slowest = target ? *target : std::string();
+			break;
+		}
+	}
+
+	if (Trace::EventsEnabled()) {
+		auto& events = EventsForThread();
+		std::lock_guard lock(events.mutex);
+		events.events.push_back({this, start, duration, detail ? *detail : std::string()});
+	}
+}
+
+uint64_t TraceStage::Percentile(double p) const {
+	uint64_t count = Count();
+	if (count == 0) return 0;
+	uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * count + 0.5));
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; ++i) {
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank) return std::min(BucketLimit(i), Max());
+	}
+	return Max();
+}
+
+std::string TraceStage::Slowest() const {
+	std::lock_guard lock(m_slowestMutex);
+	return m_slowest;
+}
+
+void Trace::Enable(bool events) {
+	s_events = events;
+	s_enabled = true;
+}
+
+uint64_t Trace::Now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_origin).count());
+}
+
+bool Trace::WriteChromeTrace(FILE* out) {
+	std::vector<std::shared_ptr<ThreadEvents>> threads;
+	{
+		std::lock_guard lock(g_threadsMutex);
+		threads = g_threads;
+	}
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+	bool first = true;
+	for (const auto& thread : threads) {
+		std::lock_guard lock(thread->mutex);
+		for (const auto& event : thread->events) {
+			if (!first) fputs(",\n", out);
+			first = false;
+			// 時刻はマイクロ秒
+			fputs("{\"name\":", out);
+			PutJsonString(out, event.stage->Name());
+			fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", thread->tid,
+				event.start / 1000.0, event.duration / 1000.0);
+			if (!event.detail.empty()) {
+				fputs(",\"args\":{\"detail\":", out);
+				PutJsonString(out, event.detail);
+				fputc('}', out);
+			}
+			fputc('}', out);
+		}
+	}
+	fputs("\n]}\n", out);
+	return fflush(out) == 0 && !ferror(out);
+}
+
+std::string Trace::Summary() {
+	std::vector<const TraceStage*> stages;
+	{
+		std::lock_guard lock(StagesMutex());
+		stages = Stages();
+	}
+	// 合計時間の長い順
+	std::erase_if(stages, [](const TraceStage* stage) { return stage->Count() == 0; });
+	std::sort(stages.begin(), stages.end(), [](const TraceStage* a, const TraceStage* b) { return a->Total() > b->Total(); });
+
+	char line[256];
+	snprintf(line, sizeof(line), "%-24s %10s %12s %10s %10s %10s  %s\n", "stage", "count", "total ms", "p50 ms", "p99 ms", "max ms", "slowest");
+	std::string summary = line;
+	for (const auto* stage : stages) {
+		snprintf(line, sizeof(line), "%-24s %10llu %12.1f %10.3f %10.3f %10.3f  ", stage->Name(),
+			static_cast<unsigned long long>(stage->Count()), stage->Total() / 1e6, stage->Percentile(0.5) / 1e6,
+			stage->Percentile(0.99) / 1e6, stage->Max() / 1e6);
+		summary += line + stage->Slowest() + "\n";
+	}
+	return summary;
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// 処理段階ごとの時間計測
+// TRACE_SCOPE("名前") を置いたブロックの所要時間を、段階ごとのヒストグラムに記録する
+// Trace::Enable() するまでは時刻も取らない（PHANTOMVIEW_DISABLE_TRACE を定義すると計測点ごと消える）
+
+// 1つの計測点（TRACE_SCOPE が関数内staticとして作る）
+class TraceStage {
+public:
+	explicit TraceStage(const char* name);
+	TraceStage(const TraceStage&) = delete;
+	TraceStage& operator=(const TraceStage&) = delete;
+
+	// detail が無ければ外側の計測点の対象を最も遅かった時の記録に使う
+	void Record(uint64_t start, uint64_t duration, const std::string* detail);
+
+	const char* Name() const { return m_name; }
+	uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+	uint64_t Total() const { return m_total.load(std::memory_order_relaxed); }
+	uint64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+	// 上位 p（0〜1）の所要時間（ナノ秒、誤差は1/16以内）
+	uint64_t Percentile(double p) const;
+	std::string Slowest() const;
+
+private:
+	// 対数・線形の2段のバケット（2のべきごとに16分割）
+	static constexpr int SUB_BUCKETS = 16;
+	static constexpr int BUCKETS = 64 * SUB_BUCKETS;
+	static int BucketOf(uint64_t value);
+	static uint64_t BucketLimit(int bucket);
+
+	const char* m_name;
+	std::array<std::atomic<uint64_t>, BUCKETS> m_buckets = {};
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<uint64_t> m_total = 0;
+	std::atomic<uint64_t> m_max = 0;
+	mutable std::mutex m_slowestMutex;
+	std::string m_slowest;	// 最も遅かった時の対象（ファイル名など）
+};
+
+class Trace {
+public:
+	// 計測を始める（events なら Chrome のトレース用に1回ごとの記録も残す）
+	static void Enable(bool events);
+	static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static bool EventsEnabled() { return s_events.load(std::memory_order_relaxed); }
+
+	// 計測開始からの経過時間（ナノ秒）
+	static uint64_t Now();
+
+	// chrome://tracing や Perfetto で開けるJSON（trace_event 形式）
+	static bool WriteChromeTrace(FILE* out);
+
+	// 段階ごとの回数・合計・p50/p99/最大の表
+	static std::string Summary();
+
+private:
+	friend class TraceStage;
+	friend class TraceScope;
+	static std::atomic<bool> s_enabled;
+	static std::atomic<bool> s_events;
+	static inline thread_local const std::string* s_context = nullptr;	// 実行中の最も内側の対象
+};
+
+// ブロックを抜けるまでの時間を記録する
+class TraceScope {
+public:
+	explicit TraceScope(TraceStage& stage)
+		: m_stage(Trace::Enabled() ? &stage : nullptr), m_start(m_stage ? Trace::Now() : 0) {
+	}
+	~TraceScope() {
+		if (!m_stage) return;
+		if (m_hasDetail) Trace::s_context = m_outer;
+		m_stage->Record(m_start, Trace::Now() - m_start, m_hasDetail ? &m_detail : nullptr);
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	bool Active() const { return m_stage != nullptr; }
+	// 対象（ファイル名など）を付ける（内側の計測点にも引き継がれる）
+	void SetDetail(std::string detail) {
+		m_detail = std::move(detail);
+		m_outer = Trace::s_context;
+		Trace::s_context = &m_detail;
+		m_hasDetail = true;
+	}
+
+private:
+	TraceStage* m_stage;
+	uint64_t m_start;
+	std::string m_detail;
+	const std::string* m_outer = nullptr;
+	bool m_hasDetail = false;
+};
+
+#ifdef PHANTOMVIEW_DISABLE_TRACE
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_DETAIL(name, detail) ((void)0)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+	static TraceStage TRACE_CONCAT(trace_stage_, __LINE__)(name); \
+	TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_CONCAT(trace_stage_, __LINE__))
+// detail は計測中の場合だけ評価する
+#define TRACE_SCOPE_DETAIL(name, detail) \
+	TRACE_SCOPE(name); \
+	if (TRACE_CONCAT(trace_scope_, __LINE__).Active()) TRACE_CONCAT(trace_scope_, __LINE__).SetDetail(detail)
+#endif
@@ -0,0 +1,300 @@
+﻿#include "Utf.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PV_UTF_X86 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr char32_t REPLACEMENT = 0xFFFD;
+constexpr char32_t INVALID = 0xFFFFFFFF;
+
+// UTF-8を1文字読む
+// 不正な場合は INVALID を返し、不正と分かったバイトの手前まで進める（最低1バイト）
+inline char32_t DecodeUtf8(const uint8_t*& p, const uint8_t* end) {
+	uint8_t b0 = *p++;
+	if (b0 < 0x80) return b0;
+
+	size_t need;
+	char32_t cp;
+	uint8_t lo = 0x80, hi = 0xBF;	// 2バイト目の範囲（冗長な表現・サロゲート・範囲外を弾く）
+	if (b0 >= 0xC2 && b0 <= 0xDF) {
+		need = 1;
+		cp = b0 & 0x1F;
+	} else if (b0 >= 0xE0 && b0 <= 0xEF) {
+		need = 2;
+		cp = b0 & 0x0F;
+		if (b0 == 0xE0) lo = 0xA0;
+		else if (b0 == 0xED) hi = 0x9F;
+	} else if (b0 >= 0xF0 && b0 <= 0xF4) {
+		need = 3;
+		cp = b0 & 0x07;
+		if (b0 == 0xF0) lo = 0x90;
+		else if (b0 == 0xF4) hi = 0x8F;
+	} else {
+		return INVALID;
+	}
+	for (size_t k = 0; k < need; ++k) {
+		if (p == end || *p < lo || *p > hi) return INVALID;
+		cp = (cp << 6) | (*p++ & 0x3F);
+		lo = 0x80;
+		hi = 0xBF;
+	}
+	return cp;
+}
+
+// UTF-16/UTF-32を1文字読む（不正な場合は INVALID）
+template <typename Unit>
+inline char32_t DecodeWide(const Unit*& p, const Unit* end) {
+	if constexpr (sizeof(Unit) == 2) {
+		char32_t u = static_cast<uint16_t>(*p++);
+		if (u < 0xD800 || u > 0xDFFF) return u;
+		if (u > 0xDBFF || p == end) return INVALID;
+		char32_t low = static_cast<uint16_t>(*p);
+		if (low < 0xDC00 || low > 0xDFFF) return INVALID;
+		++p;
+		return 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+	} else {
+		char32_t cp = static_cast<uint32_t>(*p++);
+		if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return INVALID;
+		return cp;
+	}
+}
+
+template <typename Unit>
+inline Unit* EncodeWide(Unit* out, char32_t cp) {
+	if constexpr (sizeof(Unit) == 2) {
+		if (cp >= 0x10000) {
+			cp -= 0x10000;
+			*out++ = static_cast<Unit>(0xD800 + (cp >> 10));
+			*out++ = static_cast<Unit>(0xDC00 + (cp & 0x3FF));
+			return out;
+		}
+	}
+	*out++ = static_cast<Unit>(cp);
+	return out;
+}
+
+inline char* EncodeUtf8(char* out, char32_t cp) {
+	if (cp < 0x80) {
+		*out++ = static_cast<char>(cp);
+	} else if (cp < 0x800) {
+		*out++ = static_cast<char>(0xC0 | (cp >> 6));
+		*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		*out++ = static_cast<char>(0xE0 | (cp >> 12));
+		*out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+	} else {
+		*out++ = static_cast<char>(0xF0 | (cp >> 18));
+		*out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		*out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	return out;
+}
+
+#ifdef PV_UTF_X86
+
+// 先頭から16バイト単位でASCIIが続く間を広げて書き込み、処理したバイト数を返す
+template <typename Unit>
+size_t WidenAsciiSSE2(const uint8_t* src, size_t n, Unit* dst) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		if (_mm_movemask_epi8(v) != 0) break;
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		auto* out = reinterpret_cast<__m128i*>(dst + i);
+		if constexpr (sizeof(Unit) == 2) {
+			_mm_storeu_si128(out, lo);
+			_mm_storeu_si128(out + 1, hi);
+		} else {
+			_mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+		}
+	}
+	return i;
+}
+
+// 先頭から16単位ずつASCIIが続く間を詰めて書き込み、処理した単位数を返す
+template <typename Unit>
+size_t NarrowAsciiSSE2(const Unit* src, size_t n, char* dst) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const auto* in = reinterpret_cast<const __m128i*>(src + i);
+		__m128i packed;
+		if constexpr (sizeof(Unit) == 2) {
+			__m128i a = _mm_loadu_si128(in);
+			__m128i b = _mm_loadu_si128(in + 1);
+			__m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(static_cast<short>(0xFF80)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF) break;
+			packed = _mm_packus_epi16(a, b);
+		} else {
+			__m128i a = _mm_loadu_si128(in);
+			__m128i b = _mm_loadu_si128(in + 1);
+			__m128i c = _mm_loadu_si128(in + 2);
+			__m128i d = _mm_loadu_si128(in + 3);
+			__m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+			__m128i high = _mm_and_si128(any, _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xFFFF) break;
+			packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+	}
+	return i;
+}
+
+size_t AsciiPrefixSSE2(const uint8_t* src, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))) != 0) break;
+	}
+	return i;
+}
+
+#endif // PV_UTF_X86
+
+// ASCIIの塊をSIMDで処理し、それ以外は1文字ずつ処理する
+// SIMDで処理できなかったら、その先の一定量を1文字ずつ処理してから次の塊を試す
+// 続けて失敗する（ASCIIの少ない文字列）ほど1文字ずつ処理する量を増やす
+constexpr size_t MIN_RUN = 16;
+constexpr size_t MAX_RUN = 1024;
+
+inline size_t NextRun(size_t run, size_t done) {
+	return done > 0 ? MIN_RUN : (run < MAX_RUN ? run * 2 : MAX_RUN);
+}
+
+template <typename Unit>
+size_t Utf8ToWide(std::string_view src, Unit* dst, UtfKernel kernel) {
+	const auto* p = reinterpret_cast<const uint8_t*>(src.data());
+	const auto* end = p + src.size();
+	Unit* out = dst;
+	[[maybe_unused]] bool simd = resolve_utf_kernel(kernel) == UtfKernel::SSE2;
+	[[maybe_unused]] size_t run = MIN_RUN;
+	while (p < end) {
+		const uint8_t* stop = end;
+#ifdef PV_UTF_X86
+		if (simd) {
+			size_t done = WidenAsciiSSE2(p, end - p, out);
+			p += done;
+			out += done;
+			run = NextRun(run, done);
+			if (end - p > static_cast<ptrdiff_t>(run)) stop = p + run;
+		}
+#endif
+		while (p < stop) {
+			char32_t cp = DecodeUtf8(p, end);
+			out = EncodeWide(out, cp == INVALID ? REPLACEMENT : cp);
+		}
+	}
+	return out - dst;
+}
+
+template <typename Unit>
+size_t WideToUtf8(std::basic_string_view<Unit> src, char* dst, UtfKernel kernel) {
+	const Unit* p = src.data();
+	const Unit* end = p + src.size();
+	char* out = dst;
+	[[maybe_unused]] bool simd = resolve_utf_kernel(kernel) == UtfKernel::SSE2;
+	[[maybe_unused]] size_t run = MIN_RUN;
+	while (p < end) {
+		const Unit* stop = end;
+#ifdef PV_UTF_X86
+		if (simd) {
+			size_t done = NarrowAsciiSSE2(p, end - p, out);
+			p += done;
+			out += done;
+			run = NextRun(run, done);
+			if (end - p > static_cast<ptrdiff_t>(run)) stop = p + run;
+		}
+#endif
+		while (p < stop) {
+			char32_t cp = DecodeWide(p, end);
+			out = EncodeUtf8(out, cp == INVALID ? REPLACEMENT : cp);
+		}
+	}
+	return out - dst;
+}
+
+} // namespace
+
+UtfKernel resolve_utf_kernel(UtfKernel kernel) {
+#ifdef PV_UTF_X86
+	// SSE2はx64なら必ず使える
+	return kernel == UtfKernel::Auto ? UtfKernel::SSE2 : kernel;
+#else
+	return UtfKernel::Scalar;
+#endif
+}
+
+const char* utf_kernel_name(UtfKernel kernel) {
+	switch (kernel) {
+	case UtfKernel::Scalar: return "scalar";
+	case UtfKernel::SSE2: return "sse2";
+	default: return "auto";
+	}
+}
+
+size_t utf8_to_utf16(std::string_view src, char16_t* dst, UtfKernel kernel) {
+	return Utf8ToWide(src, dst, kernel);
+}
+
+size_t utf8_to_utf32(std::string_view src, char32_t* dst, UtfKernel kernel) {
+	return Utf8ToWide(src, dst, kernel);
+}
+
+size_t utf16_to_utf8(std::u16string_view src, char* dst, UtfKernel kernel) {
+	return WideToUtf8(src, dst, kernel);
+}
+
+size_t utf32_to_utf8(std::u32string_view src, char* dst, UtfKernel kernel) {
+	return WideToUtf8(src, dst, kernel);
+}
+
+size_t utf8_to_wide(std::string_view src, wchar_t* dst, UtfKernel kernel) {
+	return Utf8ToWide(src, dst, kernel);
+}
+
+size_t wide_to_utf8(std::wstring_view src, char* dst, UtfKernel kernel) {
+	return WideToUtf8(src, dst, kernel);
+}
+
+bool is_valid_utf8(std::string_view src, UtfKernel kernel) {
+	const auto* p = reinterpret_cast<const uint8_t*>(src.data());
+	const auto* end = p + src.size();
+	[[maybe_unused]] bool simd = resolve_utf_kernel(kernel) == UtfKernel::SSE2;
+	[[maybe_unused]] size_t run = MIN_RUN;
+	while (p < end) {
+		const uint8_t* stop = end;
+#ifdef PV_UTF_X86
+		if (simd) {
+			size_t done = AsciiPrefixSSE2(p, end - p);
+			p += done;
+			run = NextRun(run, done);
+			if (end - p > static_cast<ptrdiff_t>(run)) stop = p + run;
+		}
+#endif
+		while (p < stop) {
+			if (DecodeUtf8(p, end) == INVALID) return false;
+		}
+	}
+	return true;
+}
+
+size_t sanitize_utf8(std::string_view src, char* dst) {
+	const auto* p = reinterpret_cast<const uint8_t*>(src.data());
+	const auto* end = p + src.size();
+	char* out = dst;
+	while (p < end) {
+		char32_t cp = DecodeUtf8(p, end);
+		out = EncodeUtf8(out, cp == INVALID ? REPLACEMENT : cp);
+	}
+	return out - dst;
+}
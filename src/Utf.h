@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <cstddef>
+#include <string_view>
+
+// UTF-8・UTF-16・UTF-32の相互変換
+// 変換先は呼び出し側が上限の長さ（*_max_length）で確保しておき、1回の走査で書き込む
+// 不正な入力（壊れたUTF-8・対になっていないサロゲート・範囲外の値）は U+FFFD に置き換える
+// UTF-8は「不正と分かった部分列ごとに1文字」で置き換える（MultiByteToWideChar と同じ）
+// ASCIIが続く部分はSIMDでまとめて処理する
+
+// 変換カーネルの種類（Auto は使える中で最も速いもの）
+enum class UtfKernel {
+	Auto,
+	Scalar,
+	SSE2,
+};
+
+UtfKernel resolve_utf_kernel(UtfKernel kernel);
+const char* utf_kernel_name(UtfKernel kernel);
+
+// 変換後の長さ（コード単位）の上限
+constexpr size_t utf16_max_length_from_utf8(size_t bytes) { return bytes; }
+constexpr size_t utf32_max_length_from_utf8(size_t bytes) { return bytes; }
+constexpr size_t utf8_max_length_from_utf16(size_t units) { return units * 3; }
+constexpr size_t utf8_max_length_from_utf32(size_t units) { return units * 4; }
+
+// 書き込んだコード単位の数を返す
+size_t utf8_to_utf16(std::string_view src, char16_t* dst, UtfKernel kernel = UtfKernel::Auto);
+size_t utf8_to_utf32(std::string_view src, char32_t* dst, UtfKernel kernel = UtfKernel::Auto);
+size_t utf16_to_utf8(std::u16string_view src, char* dst, UtfKernel kernel = UtfKernel::Auto);
+size_t utf32_to_utf8(std::u32string_view src, char* dst, UtfKernel kernel = UtfKernel::Auto);
+
+// wchar_t（WindowsではUTF-16、それ以外ではUTF-32）との変換
+constexpr size_t wide_max_length_from_utf8(size_t bytes) { return bytes; }
+constexpr size_t utf8_max_length_from_wide(size_t units) { return units * (sizeof(wchar_t) == 2 ? 3 : 4); }
+size_t utf8_to_wide(std::string_view src, wchar_t* dst, UtfKernel kernel = UtfKernel::Auto);
+size_t wide_to_utf8(std::wstring_view src, char* dst, UtfKernel kernel = UtfKernel::Auto);
+
+// 正しいUTF-8か
+bool is_valid_utf8(std::string_view src, UtfKernel kernel = UtfKernel::Auto);
+
+// 不正な部分を U+FFFD に置き換えたUTF-8（書き込んだバイト数を返す）
+constexpr size_t utf8_max_length_from_utf8(size_t bytes) { return bytes * 3; }
+size_t sanitize_utf8(std::string_view src, char* dst);
@@ -0,0 +1,691 @@
+﻿#include "WebpAlphaDecoder.h"
+#include "ByteReader.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+// VP8L（WebPの可逆圧縮）の定数
+static constexpr uint8_t VP8L_SIGNATURE = 0x2F;
+static constexpr int NUM_LITERAL_CODES = 256;
+static constexpr int NUM_LENGTH_CODES = 24;
+static constexpr int NUM_DISTANCE_CODES = 40;
+static constexpr int MAX_CACHE_BITS = 11;
+static constexpr int MAX_CODE_LENGTH = 15;
+static constexpr int CODE_LENGTH_CODES = 19;
+
+// 展開した画素を全て保持するので、寸法だけが大きい壊れたファイルで巨大な確保をしないように制限する
+static constexpr uint64_t MAX_PIXELS = 64ull * 1024 * 1024;
+static constexpr uint8_t CODE_LENGTH_ORDER[CODE_LENGTH_CODES] = {
+	17, 18, 0, 1, 2, 3, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// 距離の符号（1〜120）から近傍の位置（上位4ビットが行、下位4ビットが 8 - 列）
+static constexpr uint8_t CODE_TO_PLANE[120] = {
+	0x18, 0x07, 0x17, 0x19, 0x28, 0x06, 0x27, 0x29, 0x16, 0x1a,
+	0x26, 0x2a, 0x38, 0x05, 0x37, 0x39, 0x15, 0x1b, 0x36, 0x3a,
+	0x25, 0x2b, 0x48, 0x04, 0x47, 0x49, 0x14, 0x1c, 0x35, 0x3b,
+	0x46, 0x4a, 0x24, 0x2c, 0x58, 0x45, 0x4b, 0x34, 0x3c, 0x03,
+	0x57, 0x59, 0x13, 0x1d, 0x56, 0x5a, 0x23, 0x2d, 0x44, 0x4c,
+	0x55, 0x5b, 0x33, 0x3d, 0x68, 0x02, 0x67, 0x69, 0x12, 0x1e,
+	0x66, 0x6a, 0x22, 0x2e, 0x54, 0x5c, 0x43, 0x4d, 0x65, 0x6b,
+	0x32, 0x3e, 0x78, 0x01, 0x77, 0x79, 0x53, 0x5d, 0x11, 0x1f,
+	0x64, 0x6c, 0x42, 0x4e, 0x76, 0x7a, 0x21, 0x2f, 0x75, 0x7b,
+	0x31, 0x3f, 0x63, 0x6d, 0x52, 0x5e, 0x00, 0x74, 0x7c, 0x41,
+	0x4f, 0x10, 0x20, 0x62, 0x6e, 0x30, 0x73, 0x7d, 0x51, 0x5f,
+	0x40, 0x72, 0x7e, 0x61, 0x6f, 0x50, 0x71, 0x7f, 0x60, 0x70,
+};
+
+static uint32_t DivRoundUp(uint32_t value, int bits) {
+	return (value + (1u << bits) - 1) >> bits;
+}
+
+// LSBから順に読むビット列（終端を越えて読んだら Overrun）
+class BitReader {
+public:
+	explicit BitReader(std::span<const uint8_t> data) : m_data(data) {}
+
+	uint32_t Read(int bits) {
+		Fill();
+		uint32_t value = static_cast<uint32_t>(m_value & ((1ull << bits) - 1));
+		Skip(bits);
+		return value;
+	}
+
+	// 先読み（Fill の後なら56ビットまで読める）
+	void Fill() {
+		while (m_bits <= 56) {
+			if (m_pos < m_data.size()) m_value |= static_cast<uint64_t>(m_data[m_pos++]) << m_bits;
+			m_bits += 8;
+		}
+	}
+	uint32_t Peek(int bits) const { return static_cast<uint32_t>(m_value & ((1ull << bits) - 1)); }
+	void Skip(int bits) {
+		m_value >>= bits;
+		m_bits -= bits;
+		m_consumed += bits;
+	}
+
+	bool Overrun() const { return m_consumed > m_data.size() * 8; }
+
+private:
+	std::span<const uint8_t> m_data;
+	size_t m_pos = 0;
+	uint64_t m_value = 0;
+	int m_bits = 0;
+	uint64_t m_consumed = 0;
+};
+
+// 正準ハフマン符号（8ビットまでの符号は表を1回引き、それより長い符号は1ビットずつ辿る）
+class HuffmanCode {
+public:
+	// 符号長から作る（完全な木にならなければ false）
+	bool Build(const uint8_t* lengths, int count) {
+		m_table.fill({});
+		m_sorted.clear();
+		std::fill(std::begin(m_counts), std::end(m_counts), uint16_t(0));
+
+		int used = 0, last = 0;
+		for (int s = 0; s < count; ++s) {
+			if (!lengths[s]) continue;
+			++m_counts[lengths[s]];
+			++used;
+			last = s;
+		}
+		if (used == 0) return false;
+		// 記号が1つだけなら0ビットで読める
+		if (used == 1) {
+			m_single = last;
+			return true;
+		}
+		m_single = -1;
+
+		int left = 1;
+		for (int len = 1; len <= MAX_CODE_LENGTH; ++len) {
+			left = (left << 1) - m_counts[len];
+			if (left < 0) return false;
+		}
+		if (left != 0) return false;
+
+		uint16_t offsets[MAX_CODE_LENGTH + 2] = {};
+		for (int len = 1; len <= MAX_CODE_LENGTH; ++len) offsets[len + 1] = offsets[len] + m_counts[len];
+		m_sorted.resize(used);
+		uint32_t next[MAX_CODE_LENGTH + 1] = {};
+		for (int len = 1, code = 0; len <= MAX_CODE_LENGTH; ++len) {
+			code = (code + m_counts[len - 1]) << 1;
+			next[len] = code;
+		}
+		for (int s = 0; s < count; ++s) {
+			int len = lengths[s];
+			if (!len) continue;
+			m_sorted[offsets[len]++] = static_cast<uint16_t>(s);
+			uint32_t code = next[len]++;
+			if (len > TABLE_BITS) continue;
+			uint32_t reversed = 0;
+			for (int i = 0; i < len; ++i) reversed |= ((code >> i) & 1) << (len - 1 - i);
+			for (uint32_t j = reversed; j < TABLE_SIZE; j += 1u << len) m_table[j] = {static_cast<uint16_t>(s), static_cast<uint8_t>(len)};
+		}
+		return true;
+	}
+
+	int Read(BitReader& reader) const {
+		if (m_single >= 0) return m_single;
+		reader.Fill();
+		const auto& entry = m_table[reader.Peek(TABLE_BITS)];
+		if (entry.length) {
+			reader.Skip(entry.length);
+			return entry.symbol;
+		}
+
+		// 長い符号（最初のビットが符号の上位）
+		uint32_t bits = reader.Peek(MAX_CODE_LENGTH);
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len <= MAX_CODE_LENGTH; ++len) {
+			code |= (bits >> (len - 1)) & 1;
+			int count = m_counts[len];
+			if (code - first < count) {
+				reader.Skip(len);
+				return m_sorted[index + code - first];
+			}
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+private:
+	static constexpr int TABLE_BITS = 8;
+	static constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+	struct Entry {
+		uint16_t symbol = 0;
+		uint8_t length = 0;	// 0 は表に収まらない長い符号
+	};
+
+	std::array<Entry, TABLE_SIZE> m_table{};
+	std::vector<uint16_t> m_sorted;	// 符号長・記号の順
+	uint16_t m_counts[MAX_CODE_LENGTH + 1] = {};
+	int m_single = -1;
+};
+
+// 1組の符号（緑と長さとキャッシュ・赤・青・アルファ・距離）
+struct HuffmanGroup {
+	enum { GREEN, RED, BLUE, ALPHA, DISTANCE, COUNT };
+	HuffmanCode codes[COUNT];
+};
+
+// 画素のチャンネルごとの演算（ARGB、各8ビット）
+static uint32_t AddPixels(uint32_t a, uint32_t b) {
+	return (((a & 0xFF00FF00u) + (b & 0xFF00FF00u)) & 0xFF00FF00u) | (((a & 0x00FF00FFu) + (b & 0x00FF00FFu)) & 0x00FF00FFu);
+}
+
+static uint32_t Average2(uint32_t a, uint32_t b) {
+	return (((a ^ b) & 0xFEFEFEFEu) >> 1) + (a & b);
+}
+
+static int Channel(uint32_t pixel, int shift) {
+	return static_cast<int>((pixel >> shift) & 0xFF);
+}
+
+static uint32_t Clip255(int value) {
+	return static_cast<uint32_t>(std::clamp(value, 0, 255));
+}
+
+static uint32_t Select(uint32_t left, uint32_t top, uint32_t topLeft) {
+	int distanceToLeft = 0, distanceToTop = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		distanceToLeft += abs(Channel(top, shift) - Channel(topLeft, shift));
+		distanceToTop += abs(Channel(left, shift) - Channel(topLeft, shift));
+	}
+	return distanceToLeft < distanceToTop ? left : top;
+}
+
+static uint32_t ClampAddSubtractFull(uint32_t a, uint32_t b, uint32_t c) {
+	uint32_t result = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		result |= Clip255(Channel(a, shift) + Channel(b, shift) - Channel(c, shift)) << shift;
+	}
+	return result;
+}
+
+static uint32_t ClampAddSubtractHalf(uint32_t a, uint32_t b) {
+	uint32_t result = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		int ca = Channel(a, shift);
+		result |= Clip255(ca + (ca - Channel(b, shift)) / 2) << shift;
+	}
+	return result;
+}
+
+static int ColorTransformDelta(uint8_t transform, uint8_t color) {
+	return (static_cast<int8_t>(transform) * static_cast<int8_t>(color)) >> 5;
+}
+
+// VP8Lの画像ストリーム
+// 主画像はエントロピー符号を1行分ずつ展開し、変換を逆に適用して返す
+// （後方参照のため展開済みの画素は全て残す）
+class Vp8lStream {
+public:
+	// 先頭の署名と寸法を読む（VP8Lチャンク）
+	bool InitWithHeader(std::span<const uint8_t> data) {
+		if (data.size() < 5 || data[0] != VP8L_SIGNATURE) return false;
+		m_reader = std::make_unique<BitReader>(data.subspan(1));
+		uint32_t width = m_reader->Read(14) + 1;
+		uint32_t height = m_reader->Read(14) + 1;
+		m_reader->Read(1);	// アルファの有無（目安でしかないので見ない）
+		if (m_reader->Read(3) != 0) return false;	// 版は0だけ
+		return InitImage(width, height);
+	}
+
+	// 寸法を持たないストリーム（ALPHチャンクの中身）
+	bool InitHeaderless(std::span<const uint8_t> data, uint32_t width, uint32_t height) {
+		m_reader = std::make_unique<BitReader>(data);
+		return InitImage(width, height);
+	}
+
+	uint32_t Width() const { return m_width; }
+	uint32_t Height() const { return m_height; }
+
+	// 次の行（ARGB、幅の数だけ）。終端やエラーの場合は nullptr
+	const uint32_t* NextRow() {
+		if (m_row >= m_height) return nullptr;
+		size_t end = static_cast<size_t>(m_row + 1) * m_codedWidth;
+		if (!DecodePixels(m_pixels.data(), m_codedWidth, m_height, end, m_groups, true)) return nullptr;
+
+		// 変換は読んだ順の逆に適用する
+		memcpy(m_work.data(), &m_pixels[static_cast<size_t>(m_row) * m_codedWidth], m_codedWidth * sizeof(uint32_t));
+		for (auto it = m_transforms.rbegin(); it != m_transforms.rend(); ++it) InverseTransform(*it, m_row);
+		++m_row;
+		return m_work.data();
+	}
+
+private:
+	enum TransformType { PREDICTOR, CROSS_COLOR, SUBTRACT_GREEN, COLOR_INDEXING };
+	struct Transform {
+		TransformType type;
+		int bits = 0;					// ブロックの大きさ（色の索引は1画素に詰める数）
+		uint32_t width = 0;				// 変換後の幅
+		std::vector<uint32_t> data;		// 予測方式・色変換の係数・パレット
+		std::vector<uint32_t> prev;		// 予測の前の行（変換後）
+	};
+
+	bool InitImage(uint32_t width, uint32_t height) {
+		if (static_cast<uint64_t>(width) * height > MAX_PIXELS) return false;
+		m_width = width;
+		m_height = height;
+
+		// 変換（種類ごとに1回まで）
+		uint32_t codedWidth = width;
+		unsigned seen = 0;
+		while (m_reader->Read(1)) {
+			Transform transform;
+			transform.type = static_cast<TransformType>(m_reader->Read(2));
+			if (seen & (1u << transform.type)) return false;
+			seen |= 1u << transform.type;
+			transform.width = codedWidth;
+			switch (transform.type) {
+			case PREDICTOR:
+			case CROSS_COLOR:
+				transform.bits = static_cast<int>(m_reader->Read(3)) + 2;
+				if (!DecodeSubImage(DivRoundUp(codedWidth, transform.bits), DivRoundUp(height, transform.bits), transform.data)) return false;
+				if (transform.type == PREDICTOR) transform.prev.resize(codedWidth);
+				break;
+			case SUBTRACT_GREEN:
+				break;
+			case COLOR_INDEXING: {
+				uint32_t colors = m_reader->Read(8) + 1;
+				transform.bits = colors <= 2 ? 3 : colors <= 4 ? 2 : colors <= 16 ? 1 : 0;
+				if (!DecodeSubImage(colors, 1, transform.data)) return false;
+				for (uint32_t i = 1; i < colors; ++i) transform.data[i] = AddPixels(transform.data[i - 1], transform.data[i]);
+				transform.data.resize(256, 0);	// 範囲外の索引は透明な黒
+				codedWidth = DivRoundUp(codedWidth, transform.bits);
+				break;
+			}
+			}
+			m_transforms.push_back(std::move(transform));
+			if (m_reader->Overrun()) return false;
+		}
+		m_codedWidth = codedWidth;
+
+		// 色キャッシュと符号の組（主画像だけ、画素のブロックごとに組を切り替えられる）
+		if (!ReadCacheBits(m_cacheBits)) return false;
+		uint32_t groups = 1;
+		if (m_reader->Read(1)) {
+			m_groupBits = static_cast<int>(m_reader->Read(3)) + 2;
+			m_groupsWidth = DivRoundUp(codedWidth, m_groupBits);
+			if (!DecodeSubImage(m_groupsWidth, DivRoundUp(height, m_groupBits), m_groupImage)) return false;
+			for (auto& value : m_groupImage) {
+				value = (value >> 8) & 0xFFFF;
+				groups = std::max(groups, value + 1);
+			}
+		}
+		m_groups.resize(groups);
+		for (auto& group : m_groups) {
+			if (!ReadGroup(group, m_cacheBits)) return false;
+		}
+
+		m_cache.assign(m_cacheBits ? (1u << m_cacheBits) : 0, 0);
+		m_pixels.resize(static_cast<size_t>(codedWidth) * height);
+		m_work.resize(width);
+		m_scratch.resize(width);
+		return !m_reader->Overrun();
+	}
+
+	bool ReadCacheBits(int& bits) {
+		bits = 0;
+		if (!m_reader->Read(1)) return true;
+		bits = static_cast<int>(m_reader->Read(4));
+		return bits >= 1 && bits <= MAX_CACHE_BITS;
+	}
+
+	// 変換のデータ・符号の組の割り当てなどの副画像（1組の符号で全体を展開する）
+	bool DecodeSubImage(uint32_t width, uint32_t height, std::vector<uint32_t>& pixels) {
+		int cacheBits;
+		if (!ReadCacheBits(cacheBits)) return false;
+		std::vector<HuffmanGroup> groups(1);
+		if (!ReadGroup(groups[0], cacheBits)) return false;
+
+		pixels.assign(static_cast<size_t>(width) * height, 0);
+		int savedBits = m_cacheBits;
+		auto savedCache = std::move(m_cache);
+		m_cacheBits = cacheBits;
+		m_cache.assign(cacheBits ? (1u << cacheBits) : 0, 0);
+		size_t savedDecoded = m_decoded;
+		m_decoded = 0;
+		bool ok = DecodePixels(pixels.data(), width, height, pixels.size(), groups, false);
+		m_decoded = savedDecoded;
+		m_cacheBits = savedBits;
+		m_cache = std::move(savedCache);
+		return ok;
+	}
+
+	bool ReadGroup(HuffmanGroup& group, int cacheBits) {
+		static constexpr int ALPHABET[HuffmanGroup::COUNT] = {
+			NUM_LITERAL_CODES + NUM_LENGTH_CODES, NUM_LITERAL_CODES, NUM_LITERAL_CODES, NUM_LITERAL_CODES, NUM_DISTANCE_CODES,
+		};
+		for (int i = 0; i < HuffmanGroup::COUNT; ++i) {
+			int size = ALPHABET[i] + (i == HuffmanGroup::GREEN && cacheBits ? (1 << cacheBits) : 0);
+			if (!ReadCode(group.codes[i], size)) return false;
+		}
+		return true;
+	}
+
+	bool ReadCode(HuffmanCode& code, int alphabet) {
+		std::vector<uint8_t> lengths(alphabet, 0);
+		if (m_reader->Read(1)) {
+			// 1〜2個の記号だけの符号
+			int symbols = static_cast<int>(m_reader->Read(1)) + 1;
+			int first = static_cast<int>(m_reader->Read(m_reader->Read(1) ? 8 : 1));
+			if (first >= alphabet) return false;
+			lengths[first] = 1;
+			if (symbols == 2) {
+				int second = static_cast<int>(m_reader->Read(8));
+				if (second >= alphabet) return false;
+				lengths[second] = 1;
+			}
+		} else {
+			// 符号長を符号化した符号
+			uint8_t codeLengthLengths[CODE_LENGTH_CODES] = {};
+			int count = static_cast<int>(m_reader->Read(4)) + 4;
+			for (int i = 0; i < count; ++i) codeLengthLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(m_reader->Read(3));
+			HuffmanCode lengthCode;
+			if (!lengthCode.Build(codeLengthLengths, CODE_LENGTH_CODES)) return false;
+
+			int maxSymbol = alphabet;
+			if (m_reader->Read(1)) {
+				int bits = 2 + 2 * static_cast<int>(m_reader->Read(3));
+				maxSymbol = 2 + static_cast<int>(m_reader->Read(bits));
+				if (maxSymbol > alphabet) return false;
+			}
+			uint8_t prev = 8;
+			for (int symbol = 0; symbol < alphabet && maxSymbol-- > 0;) {
+				if (m_reader->Overrun()) return false;
+				int length = lengthCode.Read(*m_reader);
+				if (length < 0) return false;
+				if (length < 16) {
+					lengths[symbol++] = static_cast<uint8_t>(length);
+					if (length) prev = static_cast<uint8_t>(length);
+					continue;
+				}
+				static constexpr int EXTRA_BITS[3] = {2, 3, 7};
+				static constexpr int REPEAT_OFFSET[3] = {3, 3, 11};
+				int slot = length - 16;
+				int repeat = static_cast<int>(m_reader->Read(EXTRA_BITS[slot])) + REPEAT_OFFSET[slot];
+				if (symbol + repeat > alphabet) return false;
+				uint8_t value = length == 16 ? prev : 0;
+				while (repeat-- > 0) lengths[symbol++] = value;
+			}
+		}
+		return !m_reader->Overrun() && code.Build(lengths.data(), alphabet);
+	}
+
+	// 長さ・距離の接頭辞と追加ビット
+	uint32_t ReadCopyValue(int prefix) {
+		if (prefix < 4) return prefix + 1;
+		int extra = (prefix - 2) >> 1;
+		uint32_t offset = (2 + (prefix & 1)) << extra;
+		return offset + m_reader->Read(extra) + 1;
+	}
+
+	uint32_t PlaneToDistance(uint32_t width, uint32_t code) const {
+		if (code > 120) return code - 120;
+		int plane = CODE_TO_PLANE[code - 1];
+		int64_t distance = static_cast<int64_t>(plane >> 4) * width + (8 - (plane & 0xF));
+		return distance >= 1 ? static_cast<uint32_t>(distance) : 1;
+	}
+
+	void CachePixel(uint32_t pixel) {
+		if (m_cacheBits) m_cache[(0x1E35A7BDu * pixel) >> (32 - m_cacheBits)] = pixel;
+	}
+
+	// pixels の m_decoded 番目から end 番目までを展開する（後方参照はそれを越えて書くことがある）
+	bool DecodePixels(uint32_t* pixels, uint32_t width, uint32_t height, size_t end, const std::vector<HuffmanGroup>& groups, bool main) {
+		const size_t total = static_cast<size_t>(width) * height;
+		while (m_decoded < end) {
+			uint32_t x = static_cast<uint32_t>(m_decoded % width), y = static_cast<uint32_t>(m_decoded / width);
+			const HuffmanGroup* group = &groups[0];
+			if (main && m_groupBits) group = &groups[m_groupImage[(y >> m_groupBits) * m_groupsWidth + (x >> m_groupBits)]];
+
+			int green = group->codes[HuffmanGroup::GREEN].Read(*m_reader);
+			if (green < 0) return false;
+			if (green < NUM_LITERAL_CODES) {
+				int red = group->codes[HuffmanGroup::RED].Read(*m_reader);
+				int blue = group->codes[HuffmanGroup::BLUE].Read(*m_reader);
+				int alpha = group->codes[HuffmanGroup::ALPHA].Read(*m_reader);
+				if (red < 0 || blue < 0 || alpha < 0) return false;
+				uint32_t pixel = (static_cast<uint32_t>(alpha) << 24) | (red << 16) | (green << 8) | blue;
+				pixels[m_decoded++] = pixel;
+				CachePixel(pixel);
+			} else if (green < NUM_LITERAL_CODES + NUM_LENGTH_CODES) {
+				uint32_t length = ReadCopyValue(green - NUM_LITERAL_CODES);
+				int distanceSymbol = group->codes[HuffmanGroup::DISTANCE].Read(*m_reader);
+				if (distanceSymbol < 0) return false;
+				uint32_t distance = PlaneToDistance(width, ReadCopyValue(distanceSymbol));
+				if (distance > m_decoded || length > total - m_decoded) return false;
+				for (uint32_t i = 0; i < length; ++i, ++m_decoded) {
+					pixels[m_decoded] = pixels[m_decoded - distance];
+					CachePixel(pixels[m_decoded]);
+				}
+			} else {
+				size_t index = green - NUM_LITERAL_CODES - NUM_LENGTH_CODES;
+				if (index >= m_cache.size()) return false;
+				uint32_t pixel = m_cache[index];
+				pixels[m_decoded++] = pixel;
+				CachePixel(pixel);
+			}
+			if (m_reader->Overrun()) return false;
+		}
+		return true;
+	}
+
+	// m_work の1行に変換の逆を適用する
+	void InverseTransform(Transform& transform, uint32_t y) {
+		uint32_t* row = m_work.data();
+		const uint32_t width = transform.width;
+		switch (transform.type) {
+		case PREDICTOR: {
+			const uint32_t* top = transform.prev.data();
+			uint32_t blocksWidth = DivRoundUp(width, transform.bits);
+			const uint32_t* modes = &transform.data[(y >> transform.bits) * blocksWidth];
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t predicted;
+				if (y == 0) {
+					predicted = x == 0 ? 0xFF000000u : row[x - 1];
+				} else if (x == 0) {
+					predicted = top[0];
+				} else {
+					uint32_t left = row[x - 1], up = top[x], upLeft = top[x - 1];
+					uint32_t upRight = x + 1 < width ? top[x + 1] : row[0];	// 右端は今の行の先頭
+					switch ((modes[x >> transform.bits] >> 8) & 0xF) {
+					case 1: predicted = left; break;
+					case 2: predicted = up; break;
+					case 3: predicted = upRight; break;
+					case 4: predicted = upLeft; break;
+					case 5: predicted = Average2(Average2(left, upRight), up); break;
+					case 6: predicted = Average2(left, upLeft); break;
+					case 7: predicted = Average2(left, up); break;
+					case 8: predicted = Average2(upLeft, up); break;
+					case 9: predicted = Average2(up, upRight); break;
+					case 10: predicted = Average2(Average2(left, upLeft), Average2(up, upRight)); break;
+					case 11: predicted = Select(left, up, upLeft); break;
+					case 12: predicted = ClampAddSubtractFull(left, up, upLeft); break;
+					case 13: predicted = ClampAddSubtractHalf(Average2(left, up), upLeft); break;
+					default: predicted = 0xFF000000u; break;
+					}
+				}
+				row[x] = AddPixels(row[x], predicted);
+			}
+			memcpy(transform.prev.data(), row, width * sizeof(uint32_t));
+			break;
+		}
+		case CROSS_COLOR: {
+			uint32_t blocksWidth = DivRoundUp(width, transform.bits);
+			const uint32_t* elements = &transform.data[(y >> transform.bits) * blocksWidth];
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t element = elements[x >> transform.bits];
+				uint8_t greenToRed = static_cast<uint8_t>(element), greenToBlue = static_cast<uint8_t>(element >> 8);
+				uint8_t redToBlue = static_cast<uint8_t>(element >> 16);
+				uint32_t pixel = row[x];
+				uint8_t green = static_cast<uint8_t>(pixel >> 8);
+				uint8_t red = static_cast<uint8_t>((pixel >> 16) + ColorTransformDelta(greenToRed, green));
+				uint8_t blue = static_cast<uint8_t>(pixel + ColorTransformDelta(greenToBlue, green) + ColorTransformDelta(redToBlue, red));
+				row[x] = (pixel & 0xFF00FF00u) | (static_cast<uint32_t>(red) << 16) | blue;
+			}
+			break;
+		}
+		case SUBTRACT_GREEN:
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t green = (row[x] >> 8) & 0xFF;
+				row[x] = AddPixels(row[x], (green << 16) | green);
+			}
+			break;
+		case COLOR_INDEXING: {
+			// 詰めた索引（緑チャンネル）を広げる
+			int bits = transform.bits;
+			int bitsPerIndex = 8 >> bits;
+			uint32_t mask = (1u << bitsPerIndex) - 1;
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t packed = (row[x >> bits] >> 8) & 0xFF;
+				uint32_t index = (packed >> ((x & ((1u << bits) - 1)) * bitsPerIndex)) & mask;
+				m_scratch[x] = transform.data[index];
+			}
+			std::swap(m_work, m_scratch);
+			break;
+		}
+		}
+	}
+
+	std::unique_ptr<BitReader> m_reader;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_codedWidth = 0;					// 色の索引で詰めた後の幅
+	uint32_t m_row = 0;
+	size_t m_decoded = 0;						// 展開済みの画素数
+	std::vector<Transform> m_transforms;
+	int m_cacheBits = 0;
+	std::vector<uint32_t> m_cache;
+	int m_groupBits = 0;
+	uint32_t m_groupsWidth = 0;
+	std::vector<uint32_t> m_groupImage;			// ブロックごとの符号の組の番号
+	std::vector<HuffmanGroup> m_groups;
+	std::vector<uint32_t> m_pixels;				// 展開した画素（変換前）
+	std::vector<uint32_t> m_work;				// 変換中の行
+	std::vector<uint32_t> m_scratch;
+};
+
+WebpAlphaDecoder::WebpAlphaDecoder(std::span<const uint8_t> data) {
+	m_valid = ParseChunks(data);
+	if (m_valid) {
+		m_bgra.assign(static_cast<size_t>(m_width) * 4, 0);
+		m_alpha.resize(m_width);
+	}
+}
+
+WebpAlphaDecoder::~WebpAlphaDecoder() = default;
+
+bool WebpAlphaDecoder::ParseChunks(std::span<const uint8_t> data) {
+	if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(&data[8], "WEBP", 4) != 0) return false;
+	size_t end = std::min<size_t>(data.size(), static_cast<size_t>(read_le32(&data[4])) + 8);
+
+	bool extended = false;
+	std::span<const uint8_t> alpha;
+	for (size_t pos = 12; pos + 8 <= end;) {
+		std::string_view type(reinterpret_cast<const char*>(&data[pos]), 4);
+		uint32_t size = read_le32(&data[pos + 4]);
+		size_t start = pos + 8;
+		if (size > end - start) return false;
+		auto chunk = data.subspan(start, size);
+		pos = start + size + (size & 1);
+
+		if (type == "VP8X") {
+			// アニメーションは対象外
+			if (size < 10 || (chunk[0] & 0x02)) return false;
+			extended = true;
+			m_width = (chunk[4] | (chunk[5] << 8) | (chunk[6] << 16)) + 1;
+			m_height = (chunk[7] | (chunk[8] << 8) | (chunk[9] << 16)) + 1;
+		} else if (type == "ALPH") {
+			alpha = chunk;
+		} else if (type == "VP8L") {
+			m_stream = std::make_unique<Vp8lStream>();
+			if (!m_stream->InitWithHeader(chunk)) return false;
+			if (extended && (m_stream->Width() != m_width || m_stream->Height() != m_height)) return false;
+			m_width = m_stream->Width();
+			m_height = m_stream->Height();
+			return true;
+		} else if (type == "VP8 ") {
+			// 非可逆の色の面は読まず、その前にあるALPHだけを使う
+			return extended && !alpha.empty() && InitAlphaChunk(alpha);
+		}
+	}
+	return false;
+}
+
+bool WebpAlphaDecoder::InitAlphaChunk(std::span<const uint8_t> chunk) {
+	if (chunk.empty()) return false;
+	uint8_t header = chunk[0];
+	uint8_t compression = header & 3;
+	m_filter = (header >> 2) & 3;
+	m_alphaChunk = true;
+	m_prev.assign(m_width, 0);
+	auto body = chunk.subspan(1);
+	if (compression == 0) {
+		if (body.size() < static_cast<size_t>(m_width) * m_height) return false;
+		m_raw = body;
+		return true;
+	}
+	if (compression != 1) return false;
+	m_stream = std::make_unique<Vp8lStream>();
+	return m_stream->InitHeaderless(body, m_width, m_height);
+}
+
+const uint8_t* WebpAlphaDecoder::NextAlphaRow() {
+	// 符号化された値（フィルタ前）
+	if (m_stream) {
+		const uint32_t* row = m_stream->NextRow();
+		if (!row) return nullptr;
+		for (uint32_t x = 0; x < m_width; ++x) m_alpha[x] = static_cast<uint8_t>(row[x] >> 8);	// 緑チャンネル
+	} else {
+		memcpy(m_alpha.data(), &m_raw[static_cast<size_t>(m_row) * m_width], m_width);
+	}
+
+	// フィルタの逆（先頭行は水平方向、先頭列は上の値で予測する）
+	uint8_t* cur = m_alpha.data();
+	const uint8_t* prev = m_prev.data();
+	if (m_filter != 0 && (m_row == 0 || m_filter == 1)) {
+		uint8_t left = m_row == 0 ? 0 : prev[0];
+		for (uint32_t x = 0; x < m_width; ++x) left = cur[x] = static_cast<uint8_t>(cur[x] + left);
+	} else if (m_filter == 2) {
+		for (uint32_t x = 0; x < m_width; ++x) cur[x] = static_cast<uint8_t>(cur[x] + prev[x]);
+	} else if (m_filter == 3) {
+		uint8_t left = prev[0], topLeft = prev[0];
+		for (uint32_t x = 0; x < m_width; ++x) {
+			uint8_t top = prev[x];
+			left = cur[x] = static_cast<uint8_t>(cur[x] + std::clamp(left + top - topLeft, 0, 255));
+			topLeft = top;
+		}
+	}
+	memcpy(m_prev.data(), cur, m_width);
+	return cur;
+}
+
+const uint8_t* WebpAlphaDecoder::NextRow() {
+	if (!m_valid || m_row >= m_height) return nullptr;
+	if (m_alphaChunk) {
+		const uint8_t* alpha = NextAlphaRow();
+		if (!alpha) return nullptr;
+		for (uint32_t x = 0; x < m_width; ++x) m_bgra[x * 4 + 3] = alpha[x];
+	} else {
+		const uint32_t* row = m_stream->NextRow();
+		if (!row) return nullptr;
+		for (uint32_t x = 0; x < m_width; ++x) {
+			uint32_t argb = row[x];
+			m_bgra[x * 4 + 0] = static_cast<uint8_t>(argb);
+			m_bgra[x * 4 + 1] = static_cast<uint8_t>(argb >> 8);
+			m_bgra[x * 4 + 2] = static_cast<uint8_t>(argb >> 16);
+			m_bgra[x * 4 + 3] = static_cast<uint8_t>(argb >> 24);
+		}
+	}
+	++m_row;
+	return m_bgra.data();
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+class Vp8lStream;
+
+// WebPのアルファを1行ずつ展開する（非可逆の色の面は展開しない）
+//   VP8L（可逆）      ARGBのストリームを展開する（アルファが無くてもRGBをそのまま返す）
+//   VP8X + ALPH      アルファチャンク（非圧縮またはVP8L圧縮、フィルタあり）だけを展開する
+// 必要な行数だけ展開して途中でやめられる（アニメーションは非対応）
+class WebpAlphaDecoder {
+public:
+	explicit WebpAlphaDecoder(std::span<const uint8_t> data);
+	~WebpAlphaDecoder();
+	WebpAlphaDecoder(const WebpAlphaDecoder&) = delete;
+	WebpAlphaDecoder& operator=(const WebpAlphaDecoder&) = delete;
+
+	// 行を返せるか（アルファの無い非可逆の画像や読めない画像は false）
+	bool Valid() const { return m_valid; }
+	uint32_t Width() const { return m_width; }
+	uint32_t Height() const { return m_height; }
+	uint32_t RowsDecoded() const { return m_row; }
+
+	// 次の行（BGRA8、幅×4バイト。ALPHチャンクの場合はアルファ以外は0）を返す。終端やエラーの場合は nullptr
+	const uint8_t* NextRow();
+
+private:
+	bool ParseChunks(std::span<const uint8_t> data);
+	bool InitAlphaChunk(std::span<const uint8_t> chunk);
+	const uint8_t* NextAlphaRow();
+
+	bool m_valid = false;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_row = 0;
+	std::unique_ptr<Vp8lStream> m_stream;	// VP8Lのストリーム（ALPHの非圧縮データでは使わない）
+	bool m_alphaChunk = false;				// ALPHチャンクのアルファ（VP8Lの緑チャンネルに入っている）
+	std::span<const uint8_t> m_raw;			// ALPHの非圧縮データ
+	uint8_t m_filter = 0;					// ALPHのフィルタ（0: なし、1: 水平、2: 垂直、3: 勾配）
+	std::vector<uint8_t> m_alpha;			// 今の行のアルファ
+	std::vector<uint8_t> m_prev;			// 前の行のアルファ（フィルタ用）
+	std::vector<uint8_t> m_bgra;
+};
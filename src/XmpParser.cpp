@@ -0,0 +1,372 @@
+﻿#include "framework.h"
+#include "XmpParser.h"
+#include "ByteReader.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+// 拡張XMPの全長の上限（壊れた全長で巨大なバッファを確保しないため）
+static constexpr uint32_t EXTENDED_XMP_LIMIT = 64 * 1024 * 1024;
+
+// 取り出す名前空間と表示に使う接頭辞
+static constexpr struct {
+	std::string_view uri;
+	std::string_view prefix;
+} XMP_FIELDS[] = {
+	{"http://purl.org/dc/elements/1.1/", "dc"},
+	{"http://ns.adobe.com/photoshop/1.0/", "photoshop"},
+};
+
+static constexpr std::string_view NS_RDF = "http://www.w3.org/1999/02/22-rdf-syntax-ns#";
+static constexpr std::string_view NS_XMP_NOTE = "http://ns.adobe.com/xmp/note/";
+
+static bool IsXmlSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static std::string_view Trim(std::string_view text) {
+	while (!text.empty() && IsXmlSpace(text.front())) text.remove_prefix(1);
+	while (!text.empty() && IsXmlSpace(text.back())) text.remove_suffix(1);
+	return text;
+}
+
+static void AppendUtf8(std::string& out, uint32_t cp) {
+	if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+	if (cp < 0x80) {
+		out += static_cast<char>(cp);
+	} else if (cp < 0x800) {
+		out += static_cast<char>(0xC0 | (cp >> 6));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		out += static_cast<char>(0xE0 | (cp >> 12));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else {
+		out += static_cast<char>(0xF0 | (cp >> 18));
+		out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+// 実体参照の展開（&lt; &gt; &amp; &quot; &apos; と数値文字参照）
+static void DecodeEntities(std::string_view text, std::string& out) {
+	out.clear();
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t amp = text.find('&', pos);
+		if (amp == std::string_view::npos) {
+			out.append(text.substr(pos));
+			break;
+		}
+		out.append(text.substr(pos, amp - pos));
+		size_t semi = text.find(';', amp);
+		if (semi == std::string_view::npos) {
+			out.append(text.substr(amp));
+			break;
+		}
+		std::string_view name = text.substr(amp + 1, semi - amp - 1);
+		if (name == "lt") out += '<';
+		else if (name == "gt") out += '>';
+		else if (name == "amp") out += '&';
+		else if (name == "quot") out += '"';
+		else if (name == "apos") out += '\'';
+		else if (name.size() > 1 && name[0] == '#') {
+			bool hex = name[1] == 'x' || name[1] == 'X';
+			std::string_view digits = name.substr(hex ? 2 : 1);
+			uint32_t cp = 0;
+			auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), cp, hex ? 16 : 10);
+			AppendUtf8(out, ec == std::errc() && end == digits.data() + digits.size() ? cp : 0xFFFD);
+		} else {
+			// 未知の実体参照はそのまま残す
+			out.append(text.substr(amp, semi - amp + 1));
+		}
+		pos = semi + 1;
+	}
+}
+
+bool XmpParser::ParseSax(std::string_view xml, XmlSaxHandler& handler) {
+	std::vector<XmlAttribute> attributes;
+	std::string text;
+	size_t pos = 0;
+
+	// BOMは読み飛ばす
+	if (xml.starts_with("\xEF\xBB\xBF")) pos = 3;
+
+	while (pos < xml.size()) {
+		size_t lt = xml.find('<', pos);
+		if (lt == std::string_view::npos) lt = xml.size();
+		if (lt > pos) {
+			DecodeEntities(xml.substr(pos, lt - pos), text);
+			handler.Characters(text);
+		}
+		if (lt == xml.size()) break;
+
+		std::string_view rest = xml.substr(lt);
+		if (rest.starts_with("<!--")) {
+			size_t end = xml.find("-->", lt + 4);
+			if (end == std::string_view::npos) return false;
+			pos = end + 3;
+			continue;
+		}
+		if (rest.starts_with("<![CDATA[")) {
+			size_t end = xml.find("]]>", lt + 9);
+			if (end == std::string_view::npos) return false;
+			handler.Characters(xml.substr(lt + 9, end - lt - 9));
+			pos = end + 3;
+			continue;
+		}
+		if (rest.starts_with("<?")) {
+			// 処理命令（xpacketなど）
+			size_t end = xml.find("?>", lt + 2);
+			if (end == std::string_view::npos) return false;
+			pos = end + 2;
+			continue;
+		}
+		if (rest.starts_with("<!")) {
+			// DOCTYPEなど（XMPでは使われない）
+			size_t end = xml.find('>', lt + 2);
+			if (end == std::string_view::npos) return false;
+			pos = end + 1;
+			continue;
+		}
+		if (rest.starts_with("</")) {
+			size_t end = xml.find('>', lt + 2);
+			if (end == std::string_view::npos) return false;
+			handler.EndElement(Trim(xml.substr(lt + 2, end - lt - 2)));
+			pos = end + 1;
+			continue;
+		}
+
+		// 開始タグ
+		pos = lt + 1;
+		size_t nameEnd = pos;
+		while (nameEnd < xml.size() && !IsXmlSpace(xml[nameEnd]) && xml[nameEnd] != '/' && xml[nameEnd] != '>') ++nameEnd;
+		std::string_view name = xml.substr(pos, nameEnd - pos);
+		if (name.empty()) return false;
+		pos = nameEnd;
+
+		attributes.clear();
+		bool selfClosing = false;
+		for (;;) {
+			while (pos < xml.size() && IsXmlSpace(xml[pos])) ++pos;
+			if (pos >= xml.size()) return false;
+			if (xml[pos] == '>') {
+				++pos;
+				break;
+			}
+			if (xml[pos] == '/') {
+				if (pos + 1 >= xml.size() || xml[pos + 1] != '>') return false;
+				selfClosing = true;
+				pos += 2;
+				break;
+			}
+
+			// 属性名="値"
+			size_t attrStart = pos;
+			while (pos < xml.size() && !IsXmlSpace(xml[pos]) && xml[pos] != '=' && xml[pos] != '>') ++pos;
+			std::string_view attrName = xml.substr(attrStart, pos - attrStart);
+			while (pos < xml.size() && IsXmlSpace(xml[pos])) ++pos;
+			if (pos >= xml.size() || xml[pos] != '=') return false;
+			++pos;
+			while (pos < xml.size() && IsXmlSpace(xml[pos])) ++pos;
+			if (pos >= xml.size() || (xml[pos] != '"' && xml[pos] != '\'')) return false;
+			char quote = xml[pos++];
+			size_t valueEnd = xml.find(quote, pos);
+			if (valueEnd == std::string_view::npos) return false;
+
+			XmlAttribute& attr = attributes.emplace_back();
+			attr.name = attrName;
+			DecodeEntities(xml.substr(pos, valueEnd - pos), attr.value);
+			pos = valueEnd + 1;
+		}
+
+		handler.StartElement(name, attributes);
+		if (selfClosing) handler.EndElement(name);
+	}
+	return true;
+}
+
+// 必要な項目だけを拾うハンドラー
+class XmpCollector : public XmlSaxHandler {
+public:
+	explicit XmpCollector(XmpProperties& properties) : m_properties(properties) {}
+
+	void StartElement(std::string_view name, const std::vector<XmlAttribute>& attributes) override {
+		++m_depth;
+		m_scopes.push_back(m_namespaces.size());
+
+		// 名前空間の宣言を先に読む
+		for (const auto& attr : attributes) {
+			if (attr.name == "xmlns") {
+				m_namespaces.push_back({"", attr.value});
+			} else if (attr.name.starts_with("xmlns:")) {
+				m_namespaces.push_back({std::string(attr.name.substr(6)), attr.value});
+			}
+		}
+
+		auto [uri, local] = Resolve(name, true);
+
+		if (m_propertyDepth >= 0) {
+			// 言語の選択肢（rdf:Alt）は先頭（x-default）だけを使う
+			if (uri == NS_RDF && local == "Alt") m_alternative = true;
+			if (uri == NS_RDF && local == "li" && m_alternative && !m_items.empty() && m_skipDepth < 0) {
+				m_skipDepth = m_depth;
+			}
+			return;
+		}
+
+		// 属性で書かれた項目（rdf:Description dc:format="..." など）
+		for (const auto& attr : attributes) {
+			auto [attrUri, attrLocal] = Resolve(attr.name, false);
+			if (attrUri == NS_XMP_NOTE && attrLocal == "HasExtendedXMP") {
+				m_properties.extendedGuid = attr.value;
+				continue;
+			}
+			auto prefix = FieldPrefix(attrUri);
+			if (!prefix.empty() && !Trim(attr.value).empty()) {
+				Emit(prefix, attrLocal, std::string(Trim(attr.value)));
+			}
+		}
+
+		// 要素で書かれた項目
+		auto prefix = FieldPrefix(uri);
+		if (!prefix.empty()) {
+			m_propertyDepth = m_depth;
+			m_propertyPrefix = prefix;
+			m_propertyName = local;
+			m_items.clear();
+			m_alternative = false;
+			m_skipDepth = -1;
+			for (const auto& attr : attributes) {
+				auto [attrUri, attrLocal] = Resolve(attr.name, false);
+				if (attrUri == NS_RDF && attrLocal == "resource") m_items.push_back(attr.value);
+			}
+		}
+	}
+
+	void EndElement(std::string_view) override {
+		if (m_depth == m_skipDepth) m_skipDepth = -1;
+		if (m_depth == m_propertyDepth) {
+			if (!m_items.empty()) {
+				std::string value;
+				for (const auto& item : m_items) {
+					if (!value.empty()) value += ", ";
+					value += item;
+				}
+				Emit(m_propertyPrefix, m_propertyName, value);
+			}
+			m_propertyDepth = -1;
+		}
+
+		if (!m_scopes.empty()) {
+			m_namespaces.resize(m_scopes.back());
+			m_scopes.pop_back();
+		}
+		--m_depth;
+	}
+
+	void Characters(std::string_view text) override {
+		if (m_propertyDepth < 0 || m_skipDepth >= 0) return;
+		text = Trim(text);
+		if (!text.empty()) m_items.emplace_back(text);
+	}
+
+private:
+	struct Namespace {
+		std::string prefix;
+		std::string uri;
+	};
+
+	// 修飾名を名前空間URIとローカル名にする（属性は接頭辞が無ければ名前空間なし）
+	std::pair<std::string_view, std::string_view> Resolve(std::string_view name, bool element) const {
+		std::string_view prefix;
+		std::string_view local = name;
+		size_t colon = name.find(':');
+		if (colon != std::string_view::npos) {
+			prefix = name.substr(0, colon);
+			local = name.substr(colon + 1);
+		} else if (!element) {
+			return {{}, local};
+		}
+		for (auto it = m_namespaces.rbegin(); it != m_namespaces.rend(); ++it) {
+			if (it->prefix == prefix) return {it->uri, local};
+		}
+		return {{}, local};
+	}
+
+	static std::string_view FieldPrefix(std::string_view uri) {
+		for (const auto& field : XMP_FIELDS) {
+			if (field.uri == uri) return field.prefix;
+		}
+		return {};
+	}
+
+	void Emit(std::string_view prefix, std::string_view local, const std::string& value) {
+		std::string key;
+		key.reserve(prefix.size() + 1 + local.size());
+		key.append(prefix).append(":").append(local);
+		m_properties.fields.Add(key, value);
+	}
+
+	XmpProperties& m_properties;
+	std::vector<Namespace> m_namespaces;
+	std::vector<size_t> m_scopes;	// 要素ごとの宣言前の m_namespaces の長さ
+	int m_depth = 0;
+
+	// 読み取り中の項目
+	int m_propertyDepth = -1;
+	std::string_view m_propertyPrefix;
+	std::string m_propertyName;
+	std::vector<std::string> m_items;
+	bool m_alternative = false;
+	int m_skipDepth = -1;
+};
+
+XmpProperties XmpParser::Parse(std::string_view xml) {
+	XmpProperties properties;
+	Parse(xml, properties);
+	return properties;
+}
+
+void XmpParser::Parse(std::string_view xml, XmpProperties& properties) {
+	XmpCollector collector(properties);
+	ParseSax(xml, collector);
+}
+
+bool ExtendedXmp::AddSegment(std::span<const uint8_t> payload) {
+	// GUID（32文字の16進）+ 全長 + オフセット
+	if (payload.size() < 40) return false;
+	std::string_view guid(reinterpret_cast<const char*>(payload.data()), 32);
+	uint32_t total = read_be32(&payload[32]);
+	uint32_t offset = read_be32(&payload[36]);
+	auto chunk = payload.subspan(40);
+	if (total > EXTENDED_XMP_LIMIT || offset > total || chunk.size() > total - offset) return false;
+
+	auto it = m_parts.find(guid);
+	if (it == m_parts.end()) {
+		it = m_parts.emplace(std::string(guid), Part{}).first;
+		it->second.total = total;
+	} else if (it->second.total != total) {
+		return false;
+	}
+	it->second.chunks[offset] = chunk;
+	return true;
+}
+
+std::string ExtendedXmp::Assemble(std::string_view guid) const {
+	auto it = m_parts.find(guid);
+	if (it == m_parts.end()) return {};
+	const Part& part = it->second;
+
+	// 隙間なく全長を埋められる場合だけ連結する（順不同・重複は許す）
+	std::string xml(part.total, '\0');
+	size_t covered = 0;
+	for (const auto& [offset, chunk] : part.chunks) {
+		if (offset > covered) return {};
+		memcpy(&xml[offset], chunk.data(), chunk.size());
+		covered = std::max(covered, offset + chunk.size());
+	}
+	if (covered != part.total) return {};
+	return xml;
+}
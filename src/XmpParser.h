@@ -0,0 +1,61 @@
+﻿#pragma once
+#include "MetaList.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct XmlAttribute {
+	std::string_view name;	// 修飾名（prefix:local）
+	std::string value;		// 実体参照は展開済み
+};
+
+// SAX風のXMLイベントの受け取り手
+class XmlSaxHandler {
+public:
+	virtual ~XmlSaxHandler() = default;
+	virtual void StartElement(std::string_view name, const std::vector<XmlAttribute>& attributes) = 0;
+	virtual void EndElement(std::string_view name) = 0;
+	virtual void Characters(std::string_view text) = 0;
+};
+
+// XMPから取り出した項目
+struct XmpProperties {
+	MetaList fields;			// "dc:title" などのキーと値
+	std::string extendedGuid;	// xmpNote:HasExtendedXMP（拡張XMPがある場合）
+};
+
+// XMPパケットの読み取り
+// DOMは作らず、要素の開始・終了と文字データを順に流して必要な項目だけを拾う
+class XmpParser {
+public:
+	// 先頭から順にイベントを通知する（壊れた箇所があればそこで止めて false）
+	static bool ParseSax(std::string_view xml, XmlSaxHandler& handler);
+
+	// Dublin Core と photoshop の項目を取り出す
+	static XmpProperties Parse(std::string_view xml);
+	static void Parse(std::string_view xml, XmpProperties& properties);
+};
+
+// JPEGの拡張XMP（64KBを超えてAPP1に分割されたXMP）をGUIDとオフセットで組み立てる
+// セグメントのデータは画像のバッファを参照したまま保持する
+class ExtendedXmp {
+public:
+	// "http://ns.adobe.com/xmp/extension/\0" に続くペイロード（GUID・全長・オフセット・データ）
+	bool AddSegment(std::span<const uint8_t> payload);
+
+	// 指定したGUIDの拡張XMPを連結する（欠けていれば空）
+	std::string Assemble(std::string_view guid) const;
+
+	bool empty() const { return m_parts.empty(); }
+
+private:
+	struct Part {
+		uint32_t total = 0;
+		std::map<uint32_t, std::span<const uint8_t>> chunks;	// オフセット順
+	};
+	std::map<std::string, Part, std::less<>> m_parts;
+};